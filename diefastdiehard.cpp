@@ -1,9 +1,11 @@
 #include "src/stdafx.hpp"
 
+#include "base/alloc_tracker_operators.hpp"
 #include "base/serialization.hpp"
 #include "ui/player_configurator_ui.hpp"
 
 #include "engine.hpp"
+#include "asset_preloader.hpp"
 #include "command_buffer.hpp"
 #include "game_commands.hpp"
 #include "game_state.hpp"
@@ -40,6 +42,62 @@ public:
             glog().info("log ring: {}", devcons().ring_size());
     }
 
+    void cmd_log_binary(cmd_opt<std::string> path) {
+        if (!path)
+            glog().info("log binary: {}", binlog ? binlog_path : std::string("off"));
+        else if (*path == "off")
+            disable_binary_log();
+        else
+            enable_binary_log(*path);
+    }
+
+    /* Records are written with the arguments unformatted, decode with tools/log_decoder */
+    void enable_binary_log(const std::string& path) {
+        try {
+            auto acceptor = log_acceptor_binary::create(path);
+            binlog        = acceptor.get();
+            binlog_path   = path;
+            glog().add_stream("binary", std::move(acceptor));
+            glog().info("log binary: writing to {}", path);
+        }
+        catch (const std::exception& e) {
+            glog().error("log binary: {}", e.what());
+        }
+    }
+
+    void disable_binary_log() {
+        if (!binlog)
+            return;
+        glog().remove_stream("binary");
+        binlog = nullptr;
+        binlog_path.clear();
+    }
+
+    void cmd_profiler_overlay(cmd_opt<bool> opt) {
+        if (opt)
+            perfoverlay().show(opt.test());
+        else
+            perfoverlay().toggle();
+    }
+
+    void cmd_profiler_alloc() {
+        if constexpr (!alloc_tracking_enabled) {
+            glog().warn("profiler alloc: built without allocation tracking (--alloc-tracking)");
+            return;
+        }
+
+        std::string msg = "allocations of the last second:";
+        for (size_t i = 0; i < alloc_tags_count; ++i) {
+            auto& rate = alloc_meter().rates()[i];
+            format_into(msg,
+                        "\n  {}: {}/s, {} bytes/frame",
+                        alloc_tag_name(alloc_tag(i)),
+                        u64(rate.allocs_per_sec),
+                        u64(rate.bytes_per_frame));
+        }
+        glog().detail("{}", msg);
+    }
+
     void cmd_log(const std::string& cmd) {
         if (cmd == "clear") {
             devcons().clear();
@@ -57,7 +115,10 @@ public:
         command_buffer().add_handler("log time", &diefastdiehard::cmd_log_time, this);
         command_buffer().add_handler("log level", &diefastdiehard::cmd_log_level, this);
         command_buffer().add_handler("log ring", &diefastdiehard::cmd_log_ring, this);
+        command_buffer().add_handler("log binary", &diefastdiehard::cmd_log_binary, this);
         command_buffer().add_handler("profiler", &diefastdiehard::enable_profiler_print, static_cast<engine*>(this));
+        command_buffer().add_handler("profiler overlay", &diefastdiehard::cmd_profiler_overlay, this);
+        command_buffer().add_handler("profiler alloc", &diefastdiehard::cmd_profiler_alloc, this);
     }
 
 public:
@@ -66,7 +127,10 @@ public:
             apply_window_size(window().getSize().x, window().getSize().y);
         });
         gs.sig_shutdown.attach_function("shutdown", [this] { window().close(); });
-        gs.sig_execute_lua.attach_function("execute_lua", [this](const std::string& code) { lua->execute_line(code); });
+        gs.sig_execute_lua.attach_function("execute_lua", [this](const std::string& code) {
+            DFDH_ALLOC_SCOPE(lua);
+            lua->execute_line(code);
+        });
     }
 
 public:
@@ -77,16 +141,38 @@ public:
         if (args.get("--physic-debug"))
             gs.debug_physics = true;
 
+        if (auto path = args.by_key_opt("--log-binary"))
+            enable_binary_log(*path);
+
+        /* The pack wins over the loose files, except for the dev mode and the mod directory */
+        if (args.get("--loose-assets"))
+            asset_file::loose_first = true;
+        if (auto dir = args.by_key_opt("--mod-dir"))
+            asset_file::mod_root = *dir;
+
+        /* Startup assets are decoded in parallel; --no-asset-preload loads them lazily for comparison */
+        if (!args.get("--no-asset-preload")) {
+            asset_preloader preloader;
+            preloader.start();
+            preloader.finish();
+        }
+
         init_lua();
     }
 
     void on_destroy() final {
         if (!gs.ai_operators.empty())
             ai_mgr().worker_stop();
+        disable_binary_log();
     }
 
     void game_update() final {
         gs.game_update();
+
+        if (binlog)
+            binlog->flush_if_stale();
+
+        DFDH_ALLOC_SCOPE(lua);
         lua_game_update(&gs);
     }
 
@@ -233,9 +319,14 @@ private:
     std::optional<luactx_mgr>          lua;
     lua_caller<void(const sf::Event&)> lua_handle_event;
     lua_caller<void(game_state*)>      lua_game_update;
+    /* Owned by glog() under the "binary" stream name */
+    log_acceptor_binary* binlog = nullptr;
+    std::string          binlog_path;
 };
 }
 
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
+    /* AI, asset and config watcher threads log too; keep terminal writes off their paths */
+    dfdh::glog().start_async();
     return std::make_unique<dfdh::diefastdiehard>()->run(dfdh::args_view(argc, argv));
 }
@@ -18,6 +18,7 @@
 #include "base/fixed_string.hpp"
 #include "base/types.hpp"
 #include "base/vec_math.hpp"
+#include "base/perf_counters.hpp"
 #include "base/profiler.hpp"
 #include "script/lua.hpp"
 #include "ai_types.hpp"
@@ -133,8 +134,14 @@ public:
         oper->work(ai_data);
     }
 
+    [[nodiscard]]
+    profiler_scope_id profiler_id() const {
+        return prof_id;
+    }
+
 private:
     std::unique_ptr<ai_operator_base> oper;
+    profiler_scope_id                 prof_id;
 };
 
 class ai_mgr_singleton {
@@ -147,19 +154,18 @@ public:
     ai_mgr_singleton(const ai_mgr_singleton&)            = delete;
     ai_mgr_singleton& operator=(const ai_mgr_singleton&) = delete;
 
+    /* The provide_* functions and publish() are called from the game thread only:
+     * they fill the pending data, publish() hands a copy of it to the worker */
     void reset_all() {
-        std::lock_guard lock{mtx};
-
         _data.players.clear();
         _data.bullets.clear();
         _data.platforms.clear();
         _data.platform_map.clear();
+        ++_level_version;
     }
 
     template <typename C, typename F>
     void provide_players(const C& c, F get_adapter) {
-        std::lock_guard lock{mtx};
-
         for (auto& [_, p] : c) {
             auto insert_player = get_adapter(p);
             _data.players.insert_or_assign(insert_player.name, get_adapter(p));
@@ -167,8 +173,6 @@ public:
     }
 
     void provide_physic_sim(const vec2f& gravity, float time_speed, u32 last_rps, bool enable_gravity_for_bullets) {
-        std::lock_guard lock{mtx};
-
         _data.physic_sim.gravity                    = gravity;
         _data.physic_sim.time_speed                 = time_speed;
         _data.physic_sim.last_rps                   = last_rps;
@@ -176,15 +180,12 @@ public:
     }
 
     void provide_level(const vec2f& level_size) {
-        std::lock_guard lock{mtx};
-
         _data.level.level_size = level_size;
+        ++_level_version;
     }
 
     template <typename C, typename F>
     void provide_bullets(const C& c, F get_adapter) {
-        std::lock_guard lock{mtx};
-
         _data.bullets.resize(c.size());
         size_t i = 0;
         for (auto it = c.begin(); it != c.end(); ++it) _data.bullets[i++] = get_adapter(*it);
@@ -192,12 +193,16 @@ public:
 
     template <typename C, typename F>
     void provide_platforms(const C& c, F get_adapter) {
-        std::lock_guard lock{mtx};
-
         _data.platforms.resize(c.size());
         for (size_t i = 0; i < _data.platforms.size(); ++i) _data.platforms[i] = get_adapter(c[i]);
 
         rebuild_platform_map();
+        ++_level_version;
+    }
+
+    /* Hands a copy of the pending data to the worker, no locks */
+    void publish() {
+        _snapshots.publish(_data, _level_version);
     }
 
     bool running() const {
@@ -220,18 +225,42 @@ public:
     }
 
     void worker() {
+        trace_recorder::set_thread_name("ai worker");
+        DFDH_ALLOC_SCOPE(ai);
+
+        /* Utilization is published twice per second */
+        std::chrono::steady_clock::duration busy{}, total{};
+
         while (_work) {
-            auto step = std::chrono::microseconds(u64(1000000) / _data.physic_sim.last_rps);
+            _snapshots.acquire();
+            auto& snapshot = _snapshots.front();
+
+            auto step = std::chrono::microseconds(u64(1000000) / snapshot.data.physic_sim.last_rps);
 
             auto now = std::chrono::steady_clock::now();
+            if (perf_counters().enabled())
+                perf_counters().set(
+                    perf_counters().ai_snapshot_age_us,
+                    size_t(std::chrono::duration_cast<std::chrono::microseconds>(now - snapshot.published).count()));
             {
+                /* Guards the operators and the lua context, the game thread takes it only
+                 * to add, remove or replace an operator */
                 std::lock_guard lock{mtx};
-                worker_op();
+                worker_op(snapshot.data);
+            }
+            {
+                DFDH_PROF_SCOPE(_prof, "wait");
+                auto elapsed = std::chrono::steady_clock::now() - now;
+                if (elapsed < step)
+                    std::this_thread::sleep_for(step - elapsed);
+                busy += elapsed;
+            }
+
+            total += std::chrono::steady_clock::now() - now;
+            if (total >= std::chrono::milliseconds(500)) {
+                perf_counters().set(perf_counters().ai_busy_permille, size_t(busy * 1000 / total));
+                busy = total = {};
             }
-            auto prof = _prof.scope("wait");
-            auto elapsed = std::chrono::steady_clock::now() - now;
-            if (elapsed < step)
-                std::this_thread::sleep_for(step - elapsed);
         }
         _stopped = true;
     }
@@ -248,6 +277,7 @@ public:
         _operators.erase(name);
     }
 
+    /* The pending data of the game thread */
     const ai_data_t& data() const {
         return _data;
     }
@@ -291,9 +321,11 @@ private:
             worker_stop();
     }
 
-    void worker_op();
+    void worker_op(const ai_data_t& data);
 
-    ai_data_t _data;
+    ai_data_t          _data;
+    u64                _level_version = 1;
+    ai_snapshot_buffer _snapshots;
 
 public:
     std::map<player_name_t, ai_operator*> _operators;
@@ -304,7 +336,7 @@ public:
     std::thread                           _thread;
     luactx_mgr                            lua = luactx_mgr::ai();
 
-    profiler   _prof;
+    profiler   _prof{"ai"};
     profiler   _ts_prof;
     std::mutex _prof_mtx;
 
@@ -382,7 +414,7 @@ void ai_operator::set_difficulty(const std::string& difficulty) {
 }
 
 ai_operator::ai_operator(ctor_access&, const player_name_t& player_name, const std::string& difficulty):
-    oper(ai_operator_base::create(player_name, difficulty)) {
+    oper(ai_operator_base::create(player_name, difficulty)), prof_id(profiler::intern(player_name)) {
     ai_mgr().add_ai_operator(this);
 }
 
@@ -1237,11 +1269,13 @@ inline void ai_operator_native::work(const ai_data_t& ai_data) {
     move_spec.apply(*this);
 }
 
-inline void ai_mgr_singleton::worker_op() {
+inline void ai_mgr_singleton::worker_op(const ai_data_t& data) {
     for (auto& [oper_name, oper_ptr] : _operators) {
-        auto prof = _prof.scope(oper_name);
-        oper_ptr->work(_data);
+        auto prof = _prof.scope(oper_ptr->profiler_id());
+        oper_ptr->work(data);
     }
+    _prof.update_window();
+    perf_counters().set(perf_counters().ai_operators, _operators.size());
     if (_prof.print_ready()) {
         {
             std::lock_guard lock{_prof_mtx};
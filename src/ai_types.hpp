@@ -1,9 +1,12 @@
 #pragma once
 
+#include <chrono>
 #include <map>
+#include <vector>
 
 #include "base/vec2.hpp"
 #include "base/fixed_string.hpp"
+#include "base/triple_buffer.hpp"
 
 namespace dfdh
 {
@@ -72,4 +75,47 @@ struct ai_data_t {
     ai_plat_map_t                        platform_map;
     ai_level_t                           level;
 };
+
+struct ai_snapshot_t {
+    ai_data_t                             data;
+    u64                                   level_version = 0;
+    std::chrono::steady_clock::time_point published;
+};
+
+/* Hands the game data to the AI worker without locks: the game thread publishes, the worker acquires */
+class ai_snapshot_buffer {
+public:
+    /* Copies the data into the free snapshot and swaps it in.
+     * The level part is copied only into the snapshots which have an older one */
+    void publish(const ai_data_t& data, u64 level_version) {
+        auto& snapshot = _snapshots.back();
+
+        if (snapshot.level_version != level_version) {
+            snapshot.data.platforms    = data.platforms;
+            snapshot.data.platform_map = data.platform_map;
+            snapshot.data.level        = data.level;
+            snapshot.level_version     = level_version;
+        }
+
+        /* Copy assignment reuses the nodes and the storage of the old snapshot */
+        snapshot.data.players    = data.players;
+        snapshot.data.bullets    = data.bullets;
+        snapshot.data.physic_sim = data.physic_sim;
+        snapshot.published       = std::chrono::steady_clock::now();
+
+        _snapshots.publish();
+    }
+
+    bool acquire() {
+        return _snapshots.acquire();
+    }
+
+    [[nodiscard]]
+    const ai_snapshot_t& front() const {
+        return _snapshots.front();
+    }
+
+private:
+    triple_buffer<ai_snapshot_t> _snapshots;
+};
 } // namespace dfdh
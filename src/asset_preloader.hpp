@@ -0,0 +1,138 @@
+#pragma once
+
+#include <set>
+
+#include <SFML/Graphics/Image.hpp>
+
+#include "base/cfg.hpp"
+#include "base/fiber_pool.hpp"
+#include "base/log.hpp"
+
+#include "player_configurator.hpp"
+#include "sound_mgr.hpp"
+#include "texture_mgr.hpp"
+
+namespace dfdh {
+
+/* Decodes startup textures and sounds in parallel on the fiber pool.
+ * Only the GPU/OpenAL upload is done on the main (GL) thread in finish() */
+class asset_preloader {
+public:
+    struct asset_list {
+        std::set<std::string> textures;
+        std::set<std::string> sounds;
+    };
+
+    /* Collects the assets referenced by wpn_*, lvl_* and players settings configs */
+    static asset_list collect() {
+        asset_list result;
+
+        auto add_sound = [&](const std::optional<std::string>& path) {
+            if (path && *path != "none")
+                result.sounds.insert(*path);
+        };
+
+        for (auto& [sect_name, sect_mut] : cfg::global().get_sections()) {
+            auto& sect = static_cast<const cfg_section<true>&>(sect_mut);
+
+            if (sect_name.starts_with("wpn_") && sect.has_key("class")) {
+                for (int i = 0;; ++i) {
+                    auto layer = sect.try_get<std::string>("layer" + std::to_string(i));
+                    if (!layer)
+                        break;
+                    if (auto path = layer->try_get())
+                        result.textures.insert(*path);
+                }
+                if (auto shell = sect.value_or_default("shell_txtr", std::optional<std::string>{}))
+                    result.textures.insert(*shell);
+                add_sound(sect.value_or_default("shot_sound", std::optional<std::string>{}));
+
+                auto anims = sect.value_or_default("animations", std::vector<std::string>{});
+                for (auto& anim : anims) {
+                    auto anim_sect = cfg::global().try_get_section(cfg_section_name(sect_name + "_" + anim));
+                    if (!anim_sect)
+                        continue;
+                    auto frames = anim_sect->value_or_default("frames", u32(0));
+                    for (u32 frame = 0; frame < frames; ++frame)
+                        add_sound(anim_sect->value_or_default(std::to_string(frame) + "_sound",
+                                                              std::optional<std::string>{}));
+                }
+            }
+            else if (sect_name.starts_with("lvl_")) {
+                if (auto name = sect.value_or_default("name", std::optional<std::string>{})) {
+                    result.textures.insert(*name + "/end_platform.png");
+                    result.textures.insert(*name + "/platform.png");
+                    result.textures.insert(*name + "/background.png");
+                }
+            }
+        }
+
+        std::error_code ec;
+        if (fs::is_directory("data/textures/player/", ec)) {
+            for (auto& path : player_configurator::available_face_textures()) result.textures.insert(path);
+            for (auto& path : player_configurator::available_body_textures()) result.textures.insert(path);
+        }
+
+        for (auto& entry : fs::directory_iterator("data/sounds/player/", ec))
+            if (entry.is_regular_file() && entry.path().extension() == ".wav")
+                result.sounds.insert("player/" + entry.path().filename().string());
+
+        result.textures.insert("wpn/shot.png");
+
+        return result;
+    }
+
+    void start() {
+        _start  = std::chrono::steady_clock::now();
+        _assets = collect();
+
+        for (auto& path : _assets.textures)
+            _textures.emplace_back(path, submit_job([](std::string full_path) {
+                                       auto image = std::make_unique<sf::Image>();
+                                       auto asset = asset_file::try_open(full_path);
+                                       if (!asset || !image->loadFromMemory(asset->data(), asset->size()))
+                                           image.reset();
+                                       return image;
+                                   }, texture_mgr_singleton::full_path(path)));
+
+        for (auto& path : _assets.sounds)
+            _sounds.emplace_back(path, submit_job(&sound_decoder::decode, u32(0), path));
+    }
+
+    /* Waits for the decoding jobs and uploads the results. Must be called from the main thread */
+    void finish() {
+        size_t failed = 0;
+
+        for (auto& [path, future] : _textures) {
+            if (auto image = future.get())
+                texture_mgr().load(path, *image);
+            else
+                ++failed;
+        }
+
+        for (auto& [path, future] : _sounds) {
+            auto decoded = future.get();
+            if (decoded.ok)
+                sound_mgr().register_decoded(path, decoded);
+            else
+                ++failed;
+        }
+
+        glog().detail("asset preloader: {} textures and {} sounds decoded in {} ({} failed)",
+                      _textures.size(),
+                      _sounds.size(),
+                      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start),
+                      failed);
+
+        _textures.clear();
+        _sounds.clear();
+    }
+
+private:
+    std::chrono::steady_clock::time_point                                     _start;
+    asset_list                                                                _assets;
+    std::vector<std::pair<std::string, job_future<std::unique_ptr<sf::Image>>>> _textures;
+    std::vector<std::pair<std::string, job_future<sound_decoder::decoded_t>>>   _sounds;
+};
+
+} // namespace dfdh
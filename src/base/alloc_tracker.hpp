@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#include "types.hpp"
+
+/* Allocation tracking build mode: with DFDH_ALLOC_TRACKING defined the global operator new
+ * and delete count the allocations by the subsystem tag of the allocating thread.
+ * The operators live in alloc_tracker_operators.hpp, included by the main .cpp of the executable.
+ * Without the define the tags and scopes cost nothing and the counters stay zero */
+
+namespace dfdh {
+
+#ifdef DFDH_ALLOC_TRACKING
+inline constexpr bool alloc_tracking_enabled = true;
+#else
+inline constexpr bool alloc_tracking_enabled = false;
+#endif
+
+enum class alloc_tag : u8 { other = 0, physics, ai, render, ui, log, cfg, lua, sound, count };
+
+inline constexpr size_t alloc_tags_count = size_t(alloc_tag::count);
+
+inline constexpr const char* alloc_tag_name(alloc_tag tag) {
+    constexpr const char* names[] = {"other", "physics", "ai", "render", "ui", "log", "cfg", "lua", "sound"};
+    return names[size_t(tag)];
+}
+
+struct alloc_counts {
+    u64 count = 0;
+    u64 bytes = 0;
+};
+
+using alloc_counts_by_tag = std::array<alloc_counts, alloc_tags_count>;
+
+namespace details {
+    struct alignas(64) alloc_counter {
+        std::atomic<u64> count = 0;
+        std::atomic<u64> bytes = 0;
+    };
+} // namespace details
+
+class alloc_tracker {
+public:
+    static alloc_tag& current_tag() noexcept {
+        thread_local alloc_tag tag = alloc_tag::other;
+        return tag;
+    }
+
+    /* Allocations of the calling thread since its start, not disturbed by the other threads */
+    static u64& thread_count() noexcept {
+        thread_local u64 count = 0;
+        return count;
+    }
+
+    static void on_alloc(size_t size) noexcept {
+        ++thread_count();
+        auto& c = counters[size_t(current_tag())];
+        c.count.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    static void on_free() noexcept {
+        frees.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /* Allocations since the start */
+    static alloc_counts_by_tag totals() noexcept {
+        alloc_counts_by_tag res;
+        for (size_t i = 0; i < alloc_tags_count; ++i)
+            res[i] = {counters[i].count.load(std::memory_order_relaxed),
+                      counters[i].bytes.load(std::memory_order_relaxed)};
+        return res;
+    }
+
+    static u64 total_frees() noexcept {
+        return frees.load(std::memory_order_relaxed);
+    }
+
+private:
+    static inline std::array<details::alloc_counter, alloc_tags_count> counters;
+    static inline std::atomic<u64>                                     frees = 0;
+};
+
+/* Tags the allocations of the current thread until the end of the scope */
+class alloc_scope {
+public:
+    alloc_scope(alloc_tag tag) noexcept {
+        if constexpr (alloc_tracking_enabled) {
+            prev = alloc_tracker::current_tag();
+            alloc_tracker::current_tag() = tag;
+        }
+    }
+
+    ~alloc_scope() {
+        if constexpr (alloc_tracking_enabled)
+            alloc_tracker::current_tag() = prev;
+    }
+
+    alloc_scope(const alloc_scope&)            = delete;
+    alloc_scope& operator=(const alloc_scope&) = delete;
+
+private:
+    alloc_tag prev = alloc_tag::other;
+};
+
+#define DFDH_ALLOC_CONCAT_IMPL(A, B) A##B
+#define DFDH_ALLOC_CONCAT(A, B)      DFDH_ALLOC_CONCAT_IMPL(A, B)
+
+/* DFDH_ALLOC_SCOPE(physics) */
+#define DFDH_ALLOC_SCOPE(TAG) ::dfdh::alloc_scope DFDH_ALLOC_CONCAT(dfdh_alloc_scope_, __LINE__)(::dfdh::alloc_tag::TAG)
+
+/* Per tag allocations of the last second: call frame() once per frame */
+class alloc_rate_meter {
+public:
+    struct tag_rate {
+        double allocs_per_sec  = 0.0;
+        double bytes_per_frame = 0.0;
+    };
+
+    void frame() {
+        ++frames;
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - window_start < std::chrono::seconds(1))
+            return;
+
+        auto totals  = alloc_tracker::totals();
+        auto seconds = std::chrono::duration<double>(now - window_start).count();
+        for (size_t i = 0; i < alloc_tags_count; ++i) {
+            _rates[i].allocs_per_sec  = double(totals[i].count - last[i].count) / seconds;
+            _rates[i].bytes_per_frame = double(totals[i].bytes - last[i].bytes) / double(frames);
+        }
+
+        last         = totals;
+        window_start = now;
+        frames       = 0;
+    }
+
+    [[nodiscard]]
+    const std::array<tag_rate, alloc_tags_count>& rates() const {
+        return _rates;
+    }
+
+private:
+    std::array<tag_rate, alloc_tags_count> _rates       = {};
+    alloc_counts_by_tag                    last         = alloc_tracker::totals();
+    std::chrono::steady_clock::time_point  window_start = std::chrono::steady_clock::now();
+    u64                                    frames       = 0;
+};
+
+} // namespace dfdh
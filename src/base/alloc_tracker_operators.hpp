@@ -0,0 +1,116 @@
+#pragma once
+
+/* The counting global operator new and delete of the allocation tracking build mode.
+ * Include it from the main .cpp of an executable only: the definitions are not inline */
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "alloc_tracker.hpp"
+
+#ifdef DFDH_ALLOC_TRACKING
+
+namespace dfdh::details {
+inline void* tracked_alloc(size_t size, size_t align = 0) noexcept {
+    alloc_tracker::on_alloc(size);
+    if (size == 0)
+        size = 1;
+    if (align <= alignof(std::max_align_t))
+        return std::malloc(size);
+    /* aligned_alloc requires a size multiple of the alignment */
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+inline void tracked_free(void* ptr) noexcept {
+    if (ptr) {
+        alloc_tracker::on_free();
+        std::free(ptr);
+    }
+}
+
+inline void* tracked_alloc_or_throw(size_t size, size_t align = 0) {
+    while (true) {
+        if (auto ptr = tracked_alloc(size, align))
+            return ptr;
+        auto handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+} // namespace dfdh::details
+
+void* operator new(size_t size) {
+    return dfdh::details::tracked_alloc_or_throw(size);
+}
+
+void* operator new[](size_t size) {
+    return dfdh::details::tracked_alloc_or_throw(size);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    return dfdh::details::tracked_alloc_or_throw(size, size_t(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return dfdh::details::tracked_alloc_or_throw(size, size_t(align));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return dfdh::details::tracked_alloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return dfdh::details::tracked_alloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return dfdh::details::tracked_alloc(size, size_t(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return dfdh::details::tracked_alloc(size, size_t(align));
+}
+
+void operator delete(void* ptr) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    dfdh::details::tracked_free(ptr);
+}
+
+#endif
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "hash_functions.hpp"
+#include "io.hpp"
+#include "log.hpp"
+
+namespace dfdh
+{
+
+namespace fs = std::filesystem;
+
+/* Pack layout: header | file data (16-byte aligned) | path strings | index sorted by path_hash.
+ * Paths are relative to the directory of the pack, with '/' separators */
+struct asset_pack_header {
+    static constexpr char     magic_value[8]  = "DFDHPAK";
+    static constexpr uint32_t current_version = 1;
+
+    char     magic[8];
+    uint32_t version;
+    uint32_t entries_count;
+    uint64_t index_offset;
+};
+
+struct asset_pack_entry {
+    uint64_t path_hash;
+    uint64_t checksum;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t path_offset;
+    uint64_t path_size;
+};
+
+inline uint64_t asset_pack_hash(std::string_view path) {
+    return fnv1a64(path.data(), path.size());
+}
+
+/* Absolute path without "." and ".." (lexical) or with resolved symlinks (canonical).
+ * The pack root and the looked up paths are compared in the same form */
+inline std::string asset_pack_normalize(const fs::path& path, bool canonical) {
+    auto abs = fs::absolute(path);
+    return (canonical ? fs::weakly_canonical(abs) : abs.lexically_normal()).generic_string();
+}
+
+class asset_pack_error : public std::runtime_error {
+public:
+    asset_pack_error(const std::string& filename, const std::string& msg):
+        std::runtime_error("Invalid asset pack \"" + filename + "\": " + msg) {}
+};
+
+/* Read-only memory-mapped asset pack. Entry checksums are validated on the first access */
+class asset_pack {
+public:
+    static constexpr auto default_path = "data.pak";
+
+    static const asset_pack& global() {
+        static asset_pack instance = [] {
+            std::error_code ec;
+            if (!fs::exists(default_path, ec))
+                return asset_pack();
+
+            try {
+                asset_pack pack(default_path);
+                glog().detail("asset pack {} opened: {} entries", default_path, pack.entries_count());
+                return pack;
+            }
+            catch (const std::exception& e) {
+                glog().error("{}; loose files will be used", e.what());
+                return asset_pack();
+            }
+        }();
+        return instance;
+    }
+
+    asset_pack() = default;
+
+    asset_pack(const fs::path& path): _mapping(path.string().data()) {
+        if (_mapping.size() < sizeof(asset_pack_header))
+            throw asset_pack_error(path.string(), "file is too small");
+
+        auto& header = *reinterpret_cast<const asset_pack_header*>(_mapping.data());
+        if (std::string_view(header.magic, sizeof(header.magic)) !=
+                std::string_view(asset_pack_header::magic_value, sizeof(asset_pack_header::magic_value)) ||
+            header.version != asset_pack_header::current_version)
+            throw asset_pack_error(path.string(), "unknown format or version");
+
+        auto index_size = uint64_t(header.entries_count) * sizeof(asset_pack_entry);
+        if (!in_range(header.index_offset, index_size) || header.index_offset % alignof(asset_pack_entry) != 0)
+            throw asset_pack_error(path.string(), "index is out of range");
+
+        _index         = reinterpret_cast<const asset_pack_entry*>(_mapping.data() + header.index_offset);
+        _entries_count = header.entries_count;
+
+        /* Every entry is checked here, so the lookups never read outside of the mapping */
+        for (auto& entry : *this)
+            if (!in_range(entry.offset, entry.size) || !in_range(entry.path_offset, entry.path_size))
+                throw asset_pack_error(path.string(), "entry is out of range");
+
+        if (!std::is_sorted(begin(), end(), [](auto& lhs, auto& rhs) { return lhs.path_hash < rhs.path_hash; }))
+            throw asset_pack_error(path.string(), "index is not sorted");
+
+        _verified       = std::make_unique<std::atomic<u8>[]>(_entries_count);
+        _root           = asset_pack_normalize(fs::absolute(path).parent_path(), false) + '/';
+        _canonical_root = asset_pack_normalize(fs::absolute(path).parent_path(), true) + '/';
+    }
+
+    /* Returns the contents of the file or nullopt if the pack does not have it (or it is corrupted).
+     * The path is matched as given first, then with resolved symlinks (symlinked install directory) */
+    [[nodiscard]]
+    std::optional<std::string_view> find(const fs::path& path) const {
+        if (_entries_count == 0)
+            return {};
+
+        auto key = asset_pack_normalize(path, false);
+        if (auto res = find_relative(key, _root))
+            return res;
+
+        auto canonical_key = asset_pack_normalize(path, true);
+        if (canonical_key == key && _canonical_root == _root)
+            return {};
+        return find_relative(canonical_key, _canonical_root);
+    }
+
+    /* The path relative to the pack directory (as given, then with resolved symlinks),
+     * or nullopt if it is outside of it */
+    [[nodiscard]]
+    std::optional<std::string> relative_path(const fs::path& path) const {
+        if (_root.empty())
+            return {};
+
+        if (auto key = asset_pack_normalize(path, false); key.starts_with(_root))
+            return key.substr(_root.size());
+        if (auto key = asset_pack_normalize(path, true); key.starts_with(_canonical_root))
+            return key.substr(_canonical_root.size());
+        return {};
+    }
+
+    [[nodiscard]]
+    size_t entries_count() const {
+        return _entries_count;
+    }
+
+    [[nodiscard]]
+    const asset_pack_entry* begin() const {
+        return _index;
+    }
+
+    [[nodiscard]]
+    const asset_pack_entry* end() const {
+        return _index + _entries_count;
+    }
+
+    [[nodiscard]]
+    std::string_view entry_path(const asset_pack_entry& entry) const {
+        return {_mapping.data() + entry.path_offset, entry.path_size};
+    }
+
+    [[nodiscard]]
+    std::string_view entry_data(const asset_pack_entry& entry) const {
+        return {_mapping.data() + entry.offset, entry.size};
+    }
+
+private:
+    std::optional<std::string_view> find_relative(std::string_view key, std::string_view root) const {
+        if (!key.starts_with(root))
+            return {};
+        auto rel = key.substr(root.size());
+
+        auto hash  = asset_pack_hash(rel);
+        auto end   = _index + _entries_count;
+        auto found = std::lower_bound(
+            _index, end, hash, [](const asset_pack_entry& e, uint64_t h) { return e.path_hash < h; });
+
+        for (; found != end && found->path_hash == hash; ++found) {
+            if (entry_path(*found) != rel)
+                continue;
+
+            auto data = entry_data(*found);
+            if (!verify(size_t(found - _index), *found, data))
+                return {};
+            return data;
+        }
+
+        return {};
+    }
+
+    /* Overflow safe offset + size <= mapping size */
+    [[nodiscard]]
+    bool in_range(uint64_t offset, uint64_t size) const {
+        return offset <= _mapping.size() && size <= _mapping.size() - offset;
+    }
+
+    bool verify(size_t idx, const asset_pack_entry& entry, std::string_view data) const {
+        if (_verified[idx].load(std::memory_order_relaxed))
+            return true;
+
+        if (fnv1a64(data.data(), data.size()) != entry.checksum) {
+            glog().error("asset pack: checksum mismatch for {}", entry_path(entry));
+            return false;
+        }
+
+        _verified[idx].store(1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    mmap_file_range<char>              _mapping;
+    const asset_pack_entry*            _index         = nullptr;
+    size_t                             _entries_count = 0;
+    std::unique_ptr<std::atomic<u8>[]> _verified;
+    std::string                        _root;
+    std::string                        _canonical_root;
+};
+
+/* File contents from the global asset pack or, if the path is not packed, from the loose file.
+ * The pack is looked up first, the loose files under it are not even stat()ed */
+class asset_file {
+public:
+    /* Dev mode (--loose-assets): existing loose files win over the pack, for the cfg hot reload and editing */
+    static inline std::atomic<bool> loose_first = false;
+
+    /* Mods (--mod-dir): <mod_root>/<path in the pack> wins over the packed file. Set before the assets are loaded */
+    static inline fs::path mod_root;
+
+    asset_file() = default;
+
+    /* Throws cannot_open_file if the file is neither packed nor exists */
+    asset_file(const fs::path& path): asset_file(asset_pack::global(), path) {}
+
+    asset_file(const asset_pack& pack, const fs::path& path) {
+        fs::path loose_path;
+        if (auto packed = lookup(pack, path, loose_path)) {
+            _packed = *packed;
+            return;
+        }
+        _loose = file_view<char>(loose_path.string().data());
+    }
+
+    /* Returns the packed contents of the path or nullopt with the loose file to read in loose_path */
+    static std::optional<std::string_view> lookup(const asset_pack& pack, const fs::path& path, fs::path& loose_path) {
+        loose_path = path;
+
+        std::error_code ec;
+        if (loose_first.load(std::memory_order_relaxed) && fs::is_regular_file(path, ec))
+            return {};
+
+        if (!mod_root.empty())
+            if (auto rel = pack.relative_path(path))
+                if (auto mod_path = mod_root / *rel; fs::is_regular_file(mod_path, ec)) {
+                    loose_path = std::move(mod_path);
+                    return {};
+                }
+
+        return pack.find(path);
+    }
+
+    [[nodiscard]]
+    static std::optional<asset_file> try_open(const fs::path& path) {
+        try {
+            return asset_file(path);
+        }
+        catch (const std::exception&) {
+            return {};
+        }
+    }
+
+    [[nodiscard]]
+    const char* begin() const {
+        return _packed.data() ? _packed.data() : _loose.begin();
+    }
+
+    [[nodiscard]]
+    const char* end() const {
+        return _packed.data() ? _packed.data() + _packed.size() : _loose.end();
+    }
+
+    [[nodiscard]]
+    const char* data() const {
+        return begin();
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        return size_t(end() - begin());
+    }
+
+    [[nodiscard]]
+    bool is_packed() const {
+        return _packed.data();
+    }
+
+private:
+    std::string_view _packed;
+    file_view<char>  _loose;
+};
+
+struct asset_pack_input {
+    std::string path; /* in the pack */
+    fs::path    source;
+};
+
+/* Writes the files (sorted by path, without duplicates) into a pack. Returns the pack size */
+inline uint64_t write_asset_pack(const fs::path& output, const std::vector<asset_pack_input>& files) {
+    static constexpr size_t data_alignment = 16;
+
+    auto ofs = std::ofstream(output, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open())
+        throw asset_pack_error(output.string(), "cannot open for writing");
+
+    uint64_t pos           = 0;
+    auto     write_padding = [&](size_t alignment) {
+        static constexpr char zeros[data_alignment] = {};
+        auto padding = (alignment - pos % alignment) % alignment;
+        ofs.write(zeros, std::streamsize(padding));
+        pos += padding;
+    };
+
+    asset_pack_header header{};
+    std::copy(std::begin(asset_pack_header::magic_value), std::end(asset_pack_header::magic_value), header.magic);
+    header.version       = asset_pack_header::current_version;
+    header.entries_count = u32(files.size());
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    pos += sizeof(header);
+
+    std::vector<asset_pack_entry> index;
+    index.reserve(files.size());
+
+    for (auto& file : files) {
+        write_padding(data_alignment);
+
+        auto fv = file_view<char>(file.source.string().data());
+        ofs.write(fv.data(), std::streamsize(fv.size()));
+
+        auto& entry     = index.emplace_back();
+        entry.path_hash = asset_pack_hash(file.path);
+        entry.checksum  = fnv1a64(fv.data(), fv.size());
+        entry.offset    = pos;
+        entry.size      = fv.size();
+        pos += fv.size();
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        ofs.write(files[i].path.data(), std::streamsize(files[i].path.size()));
+        index[i].path_offset = pos;
+        index[i].path_size   = files[i].path.size();
+        pos += files[i].path.size();
+    }
+
+    write_padding(alignof(asset_pack_entry));
+    header.index_offset = pos;
+
+    std::stable_sort(index.begin(), index.end(), [](auto& lhs, auto& rhs) { return lhs.path_hash < rhs.path_hash; });
+    ofs.write(reinterpret_cast<const char*>(index.data()), std::streamsize(index.size() * sizeof(asset_pack_entry)));
+    pos += index.size() * sizeof(asset_pack_entry);
+
+    ofs.seekp(0);
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if (!ofs.good())
+        throw asset_pack_error(output.string(), "write failed");
+
+    return pos;
+}
+
+} // namespace dfdh
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <any>
 #include <array>
+#include <atomic>
 #include <stdexcept>
 #include <string>
 #include <memory>
@@ -8,12 +10,16 @@
 #include <filesystem>
 #include <thread>
 
-#include <poll.h>
-#include <sys/inotify.h>
-
 #include "split_view.hpp"
 #include "log.hpp"
 #include "io.hpp"
+#include "asset_pack.hpp"
+#include "cfg_writer.hpp"
+#include "hash_functions.hpp"
+#include "md5.hpp"
+#include "open_index.hpp"
+#include "serialization.hpp"
+#include "simd_scan.hpp"
 #include "ston.hpp"
 
 namespace dtls
@@ -125,15 +131,152 @@ enum class cfg_token_t : uint16_t {
     HEAD_NODE
 };
 
+/* Token text. Tokens of mapped configs (cfg_mode::mapped) view the file data
+ * and are copied into an own string on the first edit */
+class cfg_str {
+public:
+    cfg_str() = default;
+    explicit cfg_str(std::string str): _str(std::move(str)) {}
+
+    static cfg_str mapped(std::string_view view) {
+        cfg_str res;
+        res._data = view.data();
+        res._size = view.size();
+        return res;
+    }
+
+    cfg_str& operator=(std::string str) {
+        _str  = std::move(str);
+        _data = nullptr;
+        return *this;
+    }
+
+    [[nodiscard]]
+    std::string_view view() const {
+        return _data ? std::string_view(_data, _size) : std::string_view(_str);
+    }
+
+    operator std::string_view() const {
+        return view();
+    }
+
+    [[nodiscard]]
+    std::string str() const {
+        return std::string(view());
+    }
+
+    /* Copy-on-write access */
+    std::string& mutable_str() {
+        if (_data) {
+            _str.assign(_data, _size);
+            _data = nullptr;
+        }
+        return _str;
+    }
+
+    void push_back(char c) {
+        mutable_str().push_back(c);
+    }
+
+    void insert(size_t pos, std::string_view str) {
+        mutable_str().insert(pos, str);
+    }
+
+    [[nodiscard]]
+    bool is_mapped() const {
+        return _data;
+    }
+
+    [[nodiscard]]
+    const char* data() const {
+        return _data ? _data : _str.data();
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        return _data ? _size : _str.size();
+    }
+
+    [[nodiscard]]
+    bool empty() const {
+        return size() == 0;
+    }
+
+    [[nodiscard]]
+    const char* begin() const {
+        return data();
+    }
+
+    [[nodiscard]]
+    const char* end() const {
+        return data() + size();
+    }
+
+    [[nodiscard]]
+    char front() const {
+        return *data();
+    }
+
+    [[nodiscard]]
+    char back() const {
+        return data()[size() - 1];
+    }
+
+    [[nodiscard]]
+    std::string_view substr(size_t pos, size_t count = std::string_view::npos) const {
+        return view().substr(pos, count);
+    }
+
+    [[nodiscard]]
+    bool starts_with(std::string_view str) const {
+        return view().starts_with(str);
+    }
+
+    [[nodiscard]]
+    bool ends_with(std::string_view str) const {
+        return view().ends_with(str);
+    }
+
+    friend bool operator==(const cfg_str& lhs, const cfg_str& rhs) {
+        return lhs.view() == rhs.view();
+    }
+
+    friend bool operator==(const cfg_str& lhs, std::string_view rhs) {
+        return lhs.view() == rhs;
+    }
+
+    friend auto operator<=>(const cfg_str& lhs, const cfg_str& rhs) {
+        return lhs.view() <=> rhs.view();
+    }
+
+    friend auto operator<=>(const cfg_str& lhs, std::string_view rhs) {
+        return lhs.view() <=> rhs;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const cfg_str& str) {
+        return os << str.view();
+    }
+
+private:
+    std::string _str;
+    const char* _data = nullptr;
+    size_t      _size = 0;
+};
+
 struct cfg_token {
-    std::string value;
+    cfg_str     value;
     cfg_token_t type;
     bool        resync_section = false;
 };
 
-template <typename I, typename EndI>
+/* Tokens are views into the tokenized data.
+ * Vectorized skips the characters which do not change the state with simd::find_first_of(),
+ * the per-character path is kept for validation */
+template <typename I, typename EndI, bool Vectorized = true>
 class cfg_tokenizer {
 public:
+    static_assert(std::contiguous_iterator<I>, "cfg_tokenizer requires contiguous data");
+
     cfg_tokenizer(I ibegin, EndI iend): beg(ibegin), end(iend) {}
 
     enum class state_t { on_section_name = 0, on_key, on_eq, on_value, on_macro };
@@ -149,14 +292,12 @@ public:
 
     bool quote_op(char c, bool& v, char quote) {
         if (v) {
-            tk.push_back(c);
             if (c == quote)
                 v = false;
             return true;
         }
         else {
             if (c == quote) {
-                tk.push_back(c);
                 v = true;
                 return true;
             }
@@ -166,6 +307,7 @@ public:
 
     enum analyze_st { a_next = 1, a_changed = 1 << 1 };
 
+    /* Every character accepted with a_next becomes the part of the current token */
     int analyze(char c) {
         if (quote_op(c, on_quotes, '\'') || quote_op(c, on_double_quotes, '"')) {
             whitespace_frontier = false;
@@ -207,7 +349,6 @@ public:
 
         switch (state) {
         case state_t::on_section_name:
-            tk.push_back(c);
             if (c == ']') {
                 state     = state_t::on_key;
                 last_char = c;
@@ -219,16 +360,13 @@ public:
                 state = state_t::on_eq;
                 return a_changed;
             }
-            else
-                tk.push_back(c);
             break;
         case state_t::on_eq:
-            tk.push_back(c);
             state     = state_t::on_value;
             last_char = c;
             return a_next | a_changed;
         case state_t::on_value:
-        case state_t::on_macro: tk.push_back(c); break;
+        case state_t::on_macro: break;
         }
 
         last_char = c;
@@ -236,13 +374,49 @@ public:
     }
 
     struct tk_t {
-        state_t     state;
-        std::string value;
+        state_t          state;
+        std::string_view value;
     };
 
+    /* Skips the characters which analyze() would only append to the current token */
+    void skip_plain() {
+        if (state == state_t::on_eq)
+            return;
+
+        auto b = std::to_address(beg);
+        auto e = b + (end - beg);
+
+        const char* found;
+        if (whitespace_frontier)
+            found = simd::find_first_not_of<' ', '\t', '\r', '\n'>(b, e);
+        else if (on_quotes)
+            found = simd::find_first_of<'\''>(b, e);
+        /* Single quote opens inside double quotes too */
+        else if (on_double_quotes)
+            found = simd::find_first_of<'"', '\''>(b, e);
+        else if (state == state_t::on_section_name)
+            found = simd::find_first_of<']', '\n', '"', '\''>(b, e);
+        else if (state == state_t::on_key)
+            found = simd::find_first_of<'=', '\n', '"', '\''>(b, e);
+        else
+            found = simd::find_first_of<'\n', '"', '\''>(b, e);
+
+        if (found != b) {
+            last_char = found[-1];
+            beg += found - b;
+        }
+    }
+
     tk_t next_tk() {
         auto prev_state = state;
+        auto tk_start   = beg;
         while (beg != end) {
+            if constexpr (Vectorized) {
+                skip_plain();
+                if (beg == end)
+                    break;
+            }
+
             auto st = analyze(*beg);
             if (st & a_next)
                 ++beg;
@@ -250,11 +424,15 @@ public:
                 break;
         }
 
-        auto res = std::move(tk);
-        return {prev_state, res};
+        return {prev_state, std::string_view(std::to_address(tk_start), size_t(beg - tk_start))};
     }
 
-    cfg_token_t state_to_token_t(state_t state, const std::string& value) {
+    /* '\0' past the end, like std::string::operator[] at size() */
+    static char char_at(std::string_view str, size_t pos) {
+        return pos < str.size() ? str[pos] : '\0';
+    }
+
+    cfg_token_t state_to_token_t(state_t state, std::string_view value) {
         switch (state) {
         case state_t::on_section_name: return cfg_token_t::sect_declaration;
         case state_t::on_key: return cfg_token_t::key;
@@ -262,9 +440,9 @@ public:
         case state_t::on_value: return cfg_token_t::value;
         case state_t::on_macro:
             size_t pos = 1;
-            while (any_of<' ', '\t'>(value[pos])) ++pos;
-            if (std::string_view(value).substr(pos).starts_with("include") &&
-                any_of<' ', '\t'>(value[pos + sizeof("include") - 1]))
+            while (any_of<' ', '\t'>(char_at(value, pos))) ++pos;
+            if (value.substr(pos).starts_with("include") &&
+                any_of<' ', '\t'>(char_at(value, pos + sizeof("include") - 1)))
                 return cfg_token_t::include_macro;
             return cfg_token_t::comment;
         }
@@ -278,7 +456,12 @@ public:
                 if (tk.value.empty())
                     continue;
                 size_t pos = 0;
-                while (any_of<' ', '\t', '\r', '\n'>(tk.value[pos])) ++pos;
+                if constexpr (Vectorized)
+                    pos = size_t(simd::find_first_not_of<' ', '\t', '\r', '\n'>(
+                                     tk.value.data(), tk.value.data() + tk.value.size()) -
+                                 tk.value.data());
+                else
+                    while (any_of<' ', '\t', '\r', '\n'>(char_at(tk.value, pos))) ++pos;
                 if (pos != 0)
                     put(cfg_token_t::whitespace, tk.value.substr(0, pos));
 
@@ -308,16 +491,15 @@ public:
     }
 
 private:
-    void put(cfg_token_t type, std::string value) {
+    void put(cfg_token_t type, std::string_view value) {
         cur_tokens[cur_end].type  = type;
-        cur_tokens[cur_end].value = std::move(value);
+        cur_tokens[cur_end].value = cfg_str::mapped(value);
         cur_end                   = (cur_end + 1) & 0x3;
     }
 
 private:
     I           beg;
     EndI        end;
-    std::string tk;
     state_t     state               = state_t::on_key;
     bool        on_quotes           = false;
     bool        on_double_quotes    = false;
@@ -341,8 +523,15 @@ struct cfg_file_node {
     [[nodiscard]] cfg_file_iterator<true, false> begin() const;
     [[nodiscard]] cfg_file_iterator<true, true>  end() const;
 
+    /* Writes the file through cfg_writer and waits for it */
     void commit(bool force = false);
 
+    /* Passes the text to cfg_writer without waiting */
+    void commit_async(bool force = false);
+
+    [[nodiscard]]
+    std::string text() const;
+
     friend std::ostream& operator<<(std::ostream& os, const cfg_file_node& file_node);
 
     std::string              path;
@@ -351,14 +540,45 @@ struct cfg_file_node {
     bool                     commit_required = false;
 };
 
+struct cfg_node_deleter {
+    void operator()(struct cfg_node* node) const;
+};
+
+using cfg_node_ptr = std::unique_ptr<struct cfg_node, cfg_node_deleter>;
+
 struct cfg_node {
-    static std::unique_ptr<cfg_node> create(cfg_token_t type, std::string value) {
-        return std::make_unique<cfg_node>(type, std::move(value));
+    static cfg_node_ptr create(cfg_token_t type, std::string value) {
+        return cfg_node_ptr(new cfg_node(type, cfg_str(std::move(value))));
     }
 
-    cfg_node(cfg_token_t type, std::string value): tk{std::move(value), type} {}
+    cfg_node(cfg_token_t type, cfg_str value, bool iin_arena = false):
+        tk{std::move(value), type}, revision(new_revision()), in_arena(iin_arena) {}
 
-    cfg_node* insert_after(std::unique_ptr<cfg_node> node, bool commit_required = true) {
+    cfg_node(const cfg_node&) = delete;
+    cfg_node& operator=(const cfg_node&) = delete;
+
+    ~cfg_node() {
+        /* Unlink the tail iteratively: recursive destruction overflows the stack on big files */
+        while (next)
+            next = std::move(next->next);
+    }
+
+    /* Changes every time any node is created, modified or unlinked */
+    static u64 global_revision() {
+        return revision_counter().load(std::memory_order_relaxed);
+    }
+
+    static u64 new_revision() {
+        return revision_counter().fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    /* Must be called after the token was changed: drops the cached value */
+    void touch() {
+        revision = new_revision();
+        cache.reset();
+    }
+
+    cfg_node* insert_after(cfg_node_ptr node, bool commit_required = true) {
         if (file && commit_required)
             file->commit_required = true;
 
@@ -377,6 +597,7 @@ struct cfg_node {
             if (next->file && commit_required)
                 next->file->commit_required = true;
 
+            new_revision();
             next = std::move(next->next);
             if (next)
                 next->prev = this;
@@ -384,10 +605,232 @@ struct cfg_node {
         return next.get();
     }
 
-    cfg_token                 tk;
-    std::unique_ptr<cfg_node> next;
-    cfg_node*                 prev = nullptr;
-    cfg_file_node*            file = nullptr;
+    cfg_token      tk;
+    cfg_node_ptr   next;
+    cfg_node*      prev = nullptr;
+    cfg_file_node* file = nullptr;
+    u64            revision;
+    /* Last value parsed from tk.value by cfg_value<T> (of any T) */
+    std::any       cache;
+    /* Allocated by cfg_node_arena */
+    bool           in_arena;
+
+private:
+    static std::atomic<u64>& revision_counter() {
+        static std::atomic<u64> counter{0};
+        return counter;
+    }
+};
+
+inline void cfg_node_deleter::operator()(cfg_node* node) const {
+    if (node->in_arena)
+        node->~cfg_node();
+    else
+        delete node;
+}
+
+/* Bump allocator for the nodes of mapped configs. The memory of destroyed nodes
+ * is released only with the whole arena */
+class cfg_node_arena {
+public:
+    static constexpr size_t chunk_size = 4096;
+
+    cfg_node_arena() = default;
+    cfg_node_arena(const cfg_node_arena&) = delete;
+    cfg_node_arena& operator=(const cfg_node_arena&) = delete;
+
+    ~cfg_node_arena() {
+        for (auto chunk : _chunks)
+            std::allocator<cfg_node>().deallocate(chunk, chunk_size);
+    }
+
+    cfg_node_ptr create(cfg_token_t type, cfg_str value) {
+        if (_chunks.empty() || _used == chunk_size) {
+            _chunks.push_back(std::allocator<cfg_node>().allocate(chunk_size));
+            _used = 0;
+        }
+        return cfg_node_ptr(new (_chunks.back() + _used++) cfg_node(type, std::move(value), true));
+    }
+
+private:
+    std::vector<cfg_node*> _chunks;
+    size_t                 _used = 0;
+};
+
+struct cfg_cache_token {
+    u32         offset;
+    u32         size;
+    cfg_token_t type;
+
+    SS_SERIALIZE(offset, size, type)
+};
+
+struct cfg_cache_file {
+    std::string                  path;
+    i64                          mtime = 0;
+    u64                          size  = 0;
+    md5_hash                     hash;
+    std::string                  text;
+    std::vector<cfg_cache_token> tokens;
+
+    SS_SERIALIZE(path, mtime, size, hash.lo, hash.hi, text, tokens)
+};
+
+/* Binary image of the tokenized config files (cfg_mode::binary_cache), stored next to the entry config.
+ * A file is taken from the image if its mtime and size have not changed or its MD5 is the same */
+class cfg_cache {
+public:
+    static constexpr u32 version = 1;
+
+    static fs::path image_path(const fs::path& entry_config_path) {
+        auto path = entry_config_path;
+        path += ".cache";
+        return path;
+    }
+
+    cfg_cache(fs::path image_path): _path(std::move(image_path)) {
+        std::error_code ec;
+        if (!fs::exists(_path, ec))
+            return;
+
+        try {
+            auto             data = file_view<char>(_path.string().data());
+            ss::deserializer ds{std::span(data.data(), data.size())};
+
+            u32 image_version;
+            ds.read(image_version);
+            if (image_version != version)
+                return;
+
+            std::vector<cfg_cache_file> files;
+            ds.read(files);
+
+            for (auto& file : files) {
+                for (auto& tk : file.tokens)
+                    if (u64(tk.offset) + tk.size > file.text.size())
+                        throw std::out_of_range("token is out of the file text");
+                _files.insert_or_assign(file.path, std::move(file));
+            }
+        }
+        catch (const std::exception& e) {
+            glog().warn("Config cache {} is broken: {}", _path.string(), e.what());
+            _files.clear();
+        }
+    }
+
+    /* Returns the cached file and true if its tokens are valid. If not, the file text is reloaded,
+     * and the tokens must be recorded again */
+    std::pair<cfg_cache_file&, bool> open(const fs::path& path) {
+        auto str_path = path.string();
+        auto found    = _files.find(str_path);
+        _used.insert(str_path);
+
+        i64 mtime = 0;
+        u64 size  = 0;
+
+        /* Only the loose files are stat()ed (see asset_file), the packed ones have no mtime and are rehashed */
+        fs::path        loose_path;
+        std::error_code ec;
+        if (!asset_file::lookup(asset_pack::global(), path, loose_path)) {
+            if (auto time = fs::last_write_time(loose_path, ec); !ec) {
+                mtime = time.time_since_epoch().count();
+                size  = fs::file_size(loose_path, ec);
+                if (!ec && found != _files.end() && found->second.mtime == mtime && found->second.size == size) {
+                    ++_hits;
+                    return {found->second, true};
+                }
+            }
+        }
+
+        auto mfv  = asset_file(path);
+        auto text = std::string_view(mfv.begin(), mfv.end());
+        auto hash = md5(text);
+        _dirty    = true;
+
+        if (found != _files.end() && found->second.hash == hash) {
+            found->second.mtime = mtime;
+            found->second.size  = size;
+            ++_hits;
+            return {found->second, true};
+        }
+
+        ++_misses;
+        auto& file = _files.insert_or_assign(str_path, cfg_cache_file{str_path, mtime, size, hash, std::string(text), {}})
+                         .first->second;
+        return {file, false};
+    }
+
+    /* Writes the files opened since the construction, if something was changed */
+    void save() {
+        if (!_dirty)
+            return;
+
+        std::vector<char> data;
+        ss::serializer    s{data};
+        s.write(version, u64(_used.size()));
+        for (auto& path : _used) s.write(_files.at(path));
+
+        auto tmp_path = _path;
+        tmp_path += ".tmp";
+        try {
+            {
+                auto ofd = outfd<char>(tmp_path);
+                ofd.write(data.data(), data.size());
+            }
+            fs::rename(tmp_path, _path);
+            _dirty = false;
+        }
+        catch (const std::exception& e) {
+            glog().warn("Cannot write config cache {}: {}", _path.string(), e.what());
+        }
+    }
+
+    [[nodiscard]]
+    size_t hits() const {
+        return _hits;
+    }
+
+    [[nodiscard]]
+    size_t misses() const {
+        return _misses;
+    }
+
+private:
+    fs::path                              _path;
+    std::map<std::string, cfg_cache_file> _files;
+    std::set<std::string>                 _used;
+    size_t                                _hits   = 0;
+    size_t                                _misses = 0;
+    bool                                  _dirty  = false;
+};
+
+/* Replays the tokens of the cached file */
+class cfg_cached_tokenizer {
+public:
+    cfg_cached_tokenizer(std::string_view text, const std::vector<cfg_cache_token>& tokens):
+        _text(text), _tokens(tokens) {}
+
+    operator bool() const {
+        return _pos != _tokens.size();
+    }
+
+    cfg_token next() {
+        auto& tk = _tokens[_pos++];
+        return {cfg_str::mapped(_text.substr(tk.offset, tk.size)), tk.type};
+    }
+
+private:
+    std::string_view                    _text;
+    const std::vector<cfg_cache_token>& _tokens;
+    size_t                              _pos = 0;
+};
+
+/* Memory of a mapped config: node arena and token texts. Shared between configs
+ * when nodes are moved by replace_sections() */
+struct cfg_storage {
+    cfg_node_arena                            arena;
+    std::vector<std::unique_ptr<std::string>> files;
+    std::unique_ptr<cfg_cache>                cache;
 };
 
 template <bool Const, typename Derived>
@@ -603,22 +1046,31 @@ inline cfg_file_iterator<true, true>   cfg_file_node::end() const {
     return {start};
 }
 
-inline void cfg_file_node::commit(bool force) {
-    if (!commit_required && !force)
-        return;
-
-    auto ofs = outfd<char>(path);
-    //throw cfg_file_commit_error(path, "Can't open file for writing");
-
-    for (auto i = start; i && i->file->inner.contains(this); i = i->next.get()) {
+inline std::string cfg_file_node::text() const {
+    auto        self = const_cast<cfg_file_node*>(this); // NOLINT: key type of inner
+    std::string result;
+    for (auto i = start; i && i->file->inner.contains(self); i = i->next.get()) {
         if (i->file != this)
             continue;
-        ofs.write(i->tk.value.data(), i->tk.value.size());
+        result.append(i->tk.value.view());
     }
+    return result;
+}
+
+inline void cfg_file_node::commit_async(bool force) {
+    if (!commit_required && !force)
+        return;
 
+    cfg_writer::instance().push(path, text());
     commit_required = false;
 }
 
+/* Goes through the writer too, so an older pending text cannot overwrite this one */
+inline void cfg_file_node::commit(bool force) {
+    commit_async(force);
+    cfg_writer::instance().flush();
+}
+
 inline std::ostream& operator<<(std::ostream& os, const cfg_file_node& file_node) {
     for (auto& tk : file_node)
         os << tk.value;
@@ -680,14 +1132,12 @@ std::decay_t<U> cfg_cast(const std::string& str) {
         return false;
     }
     else if constexpr (Number<T>) {
-        T res = T(0);
-        try {
-            res = ston<T>(str);
-        }
-        catch (const std::exception& e) {
+        auto res = ston_parse<T>(str);
+        if (res.ec == std::errc::result_out_of_range)
+            glog().warn("Config cast error: {} is out of range", str);
+        else if (!res)
             glog().warn("Config cast error: {} not a number", str);
-        }
-        return res;
+        return res.value;
     }
     else if constexpr (std::is_same_v<T, std::string>) {
         return str;
@@ -756,10 +1206,7 @@ std::string cfg_str_cast(const U& val) {
         return val ? "true" : "false";
     }
     else if constexpr (Number<T>) {
-        /* XXX: stringstream is very slow */
-        std::stringstream ss;
-        ss << std::setprecision(9) << val;
-        return ss.str();
+        return ntos(val);
     }
     else if constexpr (std::is_same_v<T, std::string> || std::is_convertible_v<T, const char*>) {
         return val;
@@ -816,22 +1263,28 @@ public:
 
     [[nodiscard]]
     std::string raw_value() const {
-        return has_value() ? node->tk.value : std::string();
+        return has_value() ? node->tk.value.str() : std::string();
     }
 
     [[nodiscard]]
     T value() const {
         if (has_value())
-            return cfg_cast<T>(node->tk.value);
+            return cached_value();
         else
             throw cfg_no_value_exception(
-                section->tk.type == cfg_token_t::sect_declaration ? section->tk.value : std::string(),
-                key->tk.value);
+                section->tk.type == cfg_token_t::sect_declaration ? section->tk.value.str() : std::string(),
+                key->tk.value.str());
     }
 
     [[nodiscard]]
     std::optional<T> try_get() const {
-        return has_value() ? cfg_cast<T>(node->tk.value) : std::optional<T>();
+        return has_value() ? cached_value() : std::optional<T>();
+    }
+
+    /* Revision of the value node; changes only when the value was changed */
+    [[nodiscard]]
+    u64 revision() const {
+        return node->revision;
     }
 
     operator bool() const {
@@ -858,6 +1311,14 @@ public:
         return !(*this == rhs);
     }
 
+protected:
+    /* The value is parsed once per node revision and requested type */
+    const T& cached_value() const {
+        if (auto cached = std::any_cast<T>(&node->cache))
+            return *cached;
+        return node->cache.template emplace<T>(cfg_cast<T>(node->tk.value.str()));
+    }
+
 protected:
     /* May be cfg_token_t::eq or cfg_token_t::value only */
     cfg_node* section;
@@ -878,6 +1339,7 @@ public:
 
         if (this->has_value()) {
             this->node->tk.value = std::move(value);
+            this->node->touch();
             if (this->node->file)
                 this->node->file->commit_required = true;
         }
@@ -890,6 +1352,7 @@ public:
             /* The old '=' becomes value */
             this->node->tk.type  = cfg_token_t::value;
             this->node->tk.value = std::move(value);
+            this->node->touch();
         }
     }
 
@@ -915,6 +1378,7 @@ public:
             /* Value becomes '=' sign */
             prev->next->tk.type  = cfg_token_t::eq;
             prev->next->tk.value = "=";
+            prev->next->touch();
         }
     }
 };
@@ -933,7 +1397,7 @@ struct cfg_key {
 struct cfg_key_cmp {
     using is_transparent = void;
 
-    bool operator()(const cfg_key& lhs, const std::string& rhs) const {
+    bool operator()(const cfg_key& lhs, std::string_view rhs) const {
         return lhs.key->tk.value < rhs;
     }
 
@@ -941,7 +1405,7 @@ struct cfg_key_cmp {
         return operator()(lhs, rhs.key->tk.value);
     }
 
-    bool operator()(const std::string& lhs, const cfg_key& rhs) const {
+    bool operator()(std::string_view lhs, const cfg_key& rhs) const {
         return lhs < rhs.key->tk.value;
     }
 };
@@ -965,9 +1429,8 @@ public:
 
     template <typename T>
     cfg_value<T, true> get(const std::string& key) const {
-        auto found = values.find(key);
-        if (found != values.end())
-            return cfg_value<T, true>(start, found->first.key, found->second);
+        if (auto found = find_key(key))
+            return cfg_value<T, true>(start, found->key, found->value);
         else
             throw cfg_key_not_found(section_name(), key);
     }
@@ -979,16 +1442,15 @@ public:
 
     template <typename T>
     std::optional<cfg_value<T, true>> try_get(const std::string& key) const {
-        auto found = values.find(key);
-        if (found != values.end())
-            return cfg_value<T, true>(start, found->first.key, found->second);
+        if (auto found = find_key(key))
+            return cfg_value<T, true>(start, found->key, found->value);
         else
             return {};
     }
 
     [[nodiscard]]
     bool has_key(const std::string& key) const {
-        return values.contains(key);
+        return find_key(key);
     }
 
     template <typename T>
@@ -1003,7 +1465,7 @@ public:
     std::set<std::string> list_keys() const {
         std::set<std::string> result;
         for (auto& [key, _] : values)
-            result.insert(key.key->tk.value);
+            result.insert(key.key->tk.value.str());
         return result;
     }
 
@@ -1035,10 +1497,10 @@ public:
             return false;
 
         for (auto& [k, v] : values) {
-            auto found = rhs.values.find(k);
-            if (found == rhs.values.end())
+            auto found = rhs.find_key(k.key->tk.value);
+            if (!found)
                 return false;
-            if (v->tk.value != found->second->tk.value || v->tk.type != found->second->tk.type)
+            if (v->tk.value != found->value->tk.value || v->tk.type != found->value->tk.type)
                 return false;
         }
         return true;
@@ -1052,7 +1514,33 @@ public:
 protected:
     friend class cfg;
 
+    struct key_slot {
+        u64       hash  = 0;
+        cfg_node* key   = nullptr;
+        cfg_node* value = nullptr;
+    };
+
+    [[nodiscard]]
+    const key_slot* find_key(std::string_view key) const {
+        return index.find(fnv1a64(key), [key](const key_slot& slot) { return slot.key->tk.value == key; });
+    }
+
+    bool insert_key(cfg_node* key, cfg_node* value) {
+        if (!values.emplace(cfg_key{key}, value).second)
+            return false;
+        index.insert({fnv1a64(key->tk.value), key, value});
+        return true;
+    }
+
+    void erase_key(cfg_node* key) {
+        auto name = key->tk.value.view();
+        index.erase(fnv1a64(name), [key](const key_slot& slot) { return slot.key == key; });
+        values.erase(values.find(name));
+    }
+
+    /* The map keeps the keys ordered, the index is used for lookups */
     std::map<cfg_key, cfg_node*, cfg_key_cmp> values;
+    open_index<key_slot>                      index;
     cfg_node*                                 start;
 };
 
@@ -1127,27 +1615,24 @@ public:
 
     template <typename T>
     cfg_value<T, false> get(const std::string& key) {
-        auto found = values.find(key);
-        if (found != values.end())
-            return {start, found->first.key, found->second};
+        if (auto found = find_key(key))
+            return {start, found->key, found->value};
         else
             throw cfg_key_not_found(section_name(), key);
     }
 
     template <typename T>
     std::optional<cfg_value<T, false>> try_get(const std::string& key) {
-        auto found = values.find(key);
-        if (found != values.end())
-            return cfg_value<T, false>{start, found->first.key, found->second};
+        if (auto found = find_key(key))
+            return cfg_value<T, false>{start, found->key, found->value};
         else
             return {};
     }
 
     template <typename T>
     cfg_value<T, false> access(const std::string& key) {
-        auto found = this->values.find(key);
-        if (found != this->values.end())
-            return {this->start, found->first.key, found->second};
+        if (auto found = find_key(key))
+            return {this->start, found->key, found->value};
 
         auto [key_node, value_node] = try_insert(key);
         return {this->start, key_node, value_node};
@@ -1178,18 +1663,18 @@ public:
     }
 
     bool delete_key(const std::string& key) {
-        auto found = values.find(key);
-        if (found == values.end())
+        auto found = find_key(key);
+        if (!found)
             return false;
 
-        auto before_key  = found->first.key->prev;
+        auto before_key  = found->key->prev;
         if (before_key->tk.type == cfg_token_t::whitespace && before_key->tk.value.back() == '\n')
             before_key = before_key->prev;
-        auto after_value = found->second->next.get();
+        auto after_value = found->value->next.get();
 
-        while (before_key->remove_after() != after_value);
+        erase_key(found->key);
 
-        values.erase(found);
+        while (before_key->remove_after() != after_value);
 
         return true;
     }
@@ -1228,6 +1713,7 @@ public:
                 break;
         }
         values.clear();
+        index.clear();
     }
 
     cfg_section_iterator<false, false> begin() {
@@ -1243,10 +1729,13 @@ public:
         start->prev->remove_after();
         start = nullptr;
         values.clear();
+        index.clear();
     }
 
     template <bool Const2>
     void replace_by(cfg_section<Const2>&& sect, cfg_node* tail = nullptr) {
+        cfg_node::new_revision();
+
         auto prev = start->prev;
         auto old_cur = std::move(prev->next);
 
@@ -1282,8 +1771,9 @@ public:
             last->next = nullptr;
         }
 
-        start = sect.start;
+        start  = sect.start;
         values = std::move(sect.values);
+        index  = std::move(sect.index);
     }
 
 private:
@@ -1293,9 +1783,8 @@ private:
             glog().warn("cfg_section: attempt to setup key with '=' sign: '{}'", key);
             key = key.substr(0, found_eq);
             glog().warn("cfg_section:                                       ^-this key will be truncated: '{}'", key);
-            auto found_pair = values.find(key);
-            if (found_pair != values.end())
-                return {found_pair->first.key, found_pair->second};
+            if (auto found = find_key(key))
+                return {found->key, found->value};
         }
 
         cfg_node* key_node = this->start;
@@ -1337,7 +1826,7 @@ private:
         }
 
         value_node = value_node->insert_after(cfg_node::create(cfg_token_t::eq, "="));
-        values.insert_or_assign(cfg_key{key_node}, value_node);
+        insert_key(key_node, value_node);
         return {key_node, value_node};
     }
 
@@ -1363,21 +1852,21 @@ private:
         return last;
     }
 
-    /* XXX: use find in values std::map */
+    /* Returns the last value before the first greater key (keys of the section are expected to be sorted) */
     [[nodiscard]]
     cfg_node* find_lexicographicaly_prev(const std::string& key) const {
-        auto last = this->start;
-        for (auto next = last->next.get(); next && next->tk.type != cfg_token_t::sect_declaration;
-             next      = next->next.get()) {
-            switch (next->tk.type) {
-            case cfg_token_t::value: last = next; break;
-            case cfg_token_t::key:
-                if (next->tk.value > key)
-                    return last;
-                break;
-            default: break;
-            }
-        }
+        auto next = values.upper_bound(key);
+
+        cfg_node* last;
+        if (next != values.end())
+            last = next->first.key->prev;
+        else if (!values.empty())
+            last = values.rbegin()->second;
+        else
+            return this->start;
+
+        while (last != this->start && last->tk.type != cfg_token_t::value)
+            last = last->prev;
         return last;
     }
 
@@ -1483,11 +1972,11 @@ public:
         cfg_exception("Cannot insert section [" + section_name + "]") {}
 };
 
-inline fs::path parse_include(const std::string& include) {
+inline fs::path parse_include(std::string_view include) {
     auto pos = include.find("include") + sizeof("include") - 1;
     while (include[pos] == ' ' || include[pos] == '\t')
         ++pos;
-    auto path = include.substr(pos);
+    auto path = std::string(include.substr(pos));
     while (path.back() == ' ' || path.back() == '\t')
         path.pop_back();
 
@@ -1497,8 +1986,10 @@ inline fs::path parse_include(const std::string& include) {
 }
 
 struct cfg_section_name {
-    cfg_section_name(std::string section_name): name(std::move(section_name)) {}
+    cfg_section_name(std::string section_name): name(std::move(section_name)), hash(fnv1a64(name)) {}
+    cfg_section_name(std::string section_name, u64 name_hash): name(std::move(section_name)), hash(name_hash) {}
     std::string name;
+    u64         hash;
 };
 
 struct cfg_file_path {
@@ -1507,8 +1998,25 @@ struct cfg_file_path {
     std::string path;
 };
 
-cfg_section_name operator "" _sect(const char* str, size_t size) {
-    return {{str, size}};
+template <size_t N>
+struct cfg_literal {
+    constexpr cfg_literal(const char (&str)[N]) {
+        std::copy_n(str, N, data);
+    }
+
+    [[nodiscard]]
+    constexpr std::string_view view() const {
+        return {data, N - 1};
+    }
+
+    char data[N];
+};
+
+/* The section name is hashed at compile time */
+template <cfg_literal Name>
+cfg_section_name operator""_sect() {
+    static constexpr auto hash = fnv1a64(Name.view());
+    return {std::string(Name.view()), hash};
 }
 
 cfg_file_path operator "" _file(const char* str, size_t size) {
@@ -1516,7 +2024,16 @@ cfg_file_path operator "" _file(const char* str, size_t size) {
 }
 
 using cfg_mode_int = unsigned int;
-enum class cfg_mode : cfg_mode_int { none = 0, create_if_not_exists = 1 << 0, commit_at_destroy = 1 << 1, autocreate_dir = 1 << 2 };
+/* mapped: tokens view the file data, nodes are allocated from an arena (fast parsing of big configs)
+ * binary_cache: tokens are loaded from the binary image (see cfg_cache) if files were not changed, implies mapped */
+enum class cfg_mode : cfg_mode_int {
+    none                 = 0,
+    create_if_not_exists = 1 << 0,
+    commit_at_destroy    = 1 << 1,
+    autocreate_dir       = 1 << 2,
+    mapped               = 1 << 3,
+    binary_cache         = 1 << 4
+};
 
 cfg_mode operator|(cfg_mode lhs, cfg_mode rhs) {
     return cfg_mode(cfg_mode_int(lhs) | cfg_mode_int(rhs));
@@ -1525,47 +2042,6 @@ bool operator&(cfg_mode lhs, cfg_mode rhs) {
     return cfg_mode_int(lhs) & cfg_mode_int(rhs);
 }
 
-template <typename T>
-struct cfg_section_replace_helper {
-    cfg_section_replace_helper() = default;
-    ~cfg_section_replace_helper() = default;
-
-    cfg_section_replace_helper(const cfg_section_replace_helper& csrh) noexcept {
-        std::lock_guard lock{csrh.mtx};
-        queue = csrh.queue; // NOLINT
-    }
-
-    cfg_section_replace_helper(cfg_section_replace_helper&& csrh) noexcept {
-        std::lock_guard lock{csrh.mtx};
-        queue = std::move(csrh.queue); // NOLINT
-    }
-
-    cfg_section_replace_helper& operator=(cfg_section_replace_helper&& csrh) noexcept {
-        if (&csrh == this)
-            return *this;
-
-        std::lock_guard lock1{csrh.mtx};
-        std::lock_guard lock2{mtx};
-        queue = std::move(csrh.queue); // NOLINT
-
-        return *this;
-    }
-
-    cfg_section_replace_helper& operator=(const cfg_section_replace_helper& csrh) noexcept {
-        if (&csrh == this)
-            return *this;
-
-        std::lock_guard lock1{csrh.mtx};
-        std::lock_guard lock2{mtx};
-        queue = csrh.queue; // NOLINT
-
-        return *this;
-    }
-
-    std::vector<T> queue;
-    std::mutex     mtx;
-};
-
 class cfg {
 public:
     static const cfg& global() {
@@ -1573,7 +2049,7 @@ public:
     }
 
     static cfg& mutable_global() {
-        static cfg instance{"fs.cfg", cfg_mode::none, true};
+        static cfg instance{"fs.cfg", cfg_mode::binary_cache, true};
         return instance;
     }
 
@@ -1581,7 +2057,7 @@ private:
     friend class cfg_watcher;
     struct uninitialized_construct {};
     cfg(uninitialized_construct, const std::string& section_name): readonly(true) {
-        sections.emplace(section_name, cfg_section<false>{nullptr});
+        emplace_section(section_name, nullptr);
     }
 
 public:
@@ -1612,15 +2088,38 @@ public:
         }
 
         commit_at_destroy = cfg_mode_int(mode & cfg_mode::commit_at_destroy);
+        mapped            = (mode & cfg_mode::mapped) || (mode & cfg_mode::binary_cache);
+        if (mapped)
+            storages.push_back(std::make_shared<cfg_storage>());
+        if (mode & cfg_mode::binary_cache)
+            storages.front()->cache = std::make_unique<cfg_cache>(cfg_cache::image_path(entry_config_path));
+
+        /* A static config must be destroyed before the writer used by its destructor */
+        if (commit_at_destroy)
+            cfg_writer::instance();
+
+        auto start = std::chrono::steady_clock::now();
 
         head = cfg_node::create(cfg_token_t::HEAD_NODE, {});
         cfg_node* tail = head.get();
         parse(entry_config_path, tail);
+
+        if (auto cache = binary_cache()) {
+            cache->save();
+            glog().detail("cfg {}: {} files parsed, {} from cache, in {}",
+                          entry_config_path.string(),
+                          cache->hits() + cache->misses(),
+                          cache->hits(),
+                          std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                                start));
+        }
     }
 
     ~cfg() {
         if (commit_at_destroy)
             commit();
+        /* Nodes must be destroyed before the storages */
+        head.reset();
     }
 
     cfg(cfg&&) = default;
@@ -1629,6 +2128,8 @@ public:
     void parse(const fs::path& config_path) {
         auto tail = calc_tail();
         parse(config_path, tail);
+        if (auto cache = binary_cache())
+            cache->save();
     }
 
     cfg_plain_iterator<false> begin() {
@@ -1650,29 +2151,27 @@ public:
     }
 
     cfg_section<false>& get_section(const cfg_section_name& section_name) {
-        auto found = sections.find(section_name.name);
-        if (found == sections.end())
+        auto found = find_section(section_name);
+        if (!found)
             throw cfg_section_not_found(section_name.name);
-        return found->second;
+        return *found;
     }
 
     [[nodiscard]]
     const cfg_section<true>& get_section(const cfg_section_name& section_name) const {
-        auto found = sections.find(section_name.name);
-        if (found == sections.end())
+        auto found = find_section(section_name);
+        if (!found)
             throw cfg_section_not_found(section_name.name);
-        return found->second;
+        return *found;
     }
 
     cfg_section<false>* try_get_section(const cfg_section_name& section_name) {
-        auto found = sections.find(section_name.name);
-        return found != sections.end() ? &found->second : nullptr;
+        return find_section(section_name);
     }
 
     [[nodiscard]]
     const cfg_section<true>* try_get_section(const cfg_section_name& section_name) const {
-        auto found = sections.find(section_name.name);
-        return found != sections.end() ? &found->second : nullptr;
+        return find_section(section_name);
     }
 
     cfg_file_node& get_file(const cfg_file_path& file_path) {
@@ -1710,19 +2209,18 @@ public:
     cfg_section<false>& get_or_create(const cfg_section_name& sect_name,
                                       const cfg_file_path&    preffered_file_path = {},
                                       insert_mode             insert_mode_v       = insert_mode::lexicographicaly) {
-        auto found = sections.find(sect_name.name);
-        if (found != sections.end())
-            return found->second;
+        if (auto found = find_section(sect_name))
+            return *found;
         return create_section(sect_name, preffered_file_path, insert_mode_v);
     }
 
     cfg_section<false>& operator[](const cfg_section_name& sect_name) {
-        return sections.find(sect_name.name)->second;
+        return *find_section(sect_name);
     }
 
     [[nodiscard]]
     const cfg_section<false>& operator[](const cfg_section_name& sect_name) const {
-        return sections.find(sect_name.name)->second;
+        return *find_section(sect_name);
     }
 
     cfg_file_node& operator[](const cfg_file_path& file_name) {
@@ -1768,6 +2266,17 @@ public:
         return readonly;
     }
 
+    [[nodiscard]]
+    bool is_mapped() const {
+        return mapped;
+    }
+
+    /* nullptr if cfg_mode::binary_cache was not set */
+    [[nodiscard]]
+    cfg_cache* binary_cache() const {
+        return storages.empty() ? nullptr : storages.front()->cache.get();
+    }
+
     void set_readonly(bool value) {
         if (value != readonly) {
             // Write changes
@@ -1777,24 +2286,31 @@ public:
         }
     }
 
+    /* Writes changed files and waits for them */
     void commit(bool force = false) {
+        commit_async(force);
+        cfg_writer::instance().flush();
+    }
+
+    /* Passes changed files to the background writer, which rate-limits writes of the same file */
+    void commit_async(bool force = false) {
         if (!readonly) {
             for (auto& [_, file] : file_nodes)
                 if (file)
-                    file->commit(force);
+                    file->commit_async(force);
         }
     }
 
     [[nodiscard]]
     bool has_section(const std::string& section_name) const {
-        return sections.contains(section_name);
+        return find_section(cfg_section_name(section_name));
     }
 
     bool try_remove_section(const cfg_section_name& section_name) {
         auto found = sections.find(section_name.name);
         if (found != sections.end()) {
             found->second.unsafe_remove_entire_data();
-            sections.erase(found);
+            erase_section(found);
             return true;
         }
         return false;
@@ -1882,7 +2398,7 @@ public:
     cfg_section<false>& create_section(const cfg_section_name& section_name,
                                        const cfg_file_path&    file_path     = {},
                                        insert_mode             insert_mode_v = insert_mode::lexicographicaly) {
-        auto [pos, was_insert] = sections.emplace(section_name.name, cfg_section<false>{nullptr});
+        auto [pos, was_insert] = emplace_section(section_name.name, nullptr);
         if (!was_insert)
             throw cfg_section_already_exists(section_name.name);
 
@@ -1944,11 +2460,11 @@ public:
     [[nodiscard]]
     bool operator==(const cfg& rhs) const {
         for (auto& [sect_name, sect] : sections) {
-            auto found = rhs.sections.find(sect_name);
-            if (found == rhs.sections.end())
+            auto found = rhs.find_section(cfg_section_name(sect_name));
+            if (!found)
                 return false;
 
-            if (sect != found->second)
+            if (sect != *found)
                 return false;
         }
         return true;
@@ -1959,31 +2475,31 @@ public:
         return !(*this == rhs);
     }
 
-    void schedule_section_replace(cfg&& section_conf) {
-        std::lock_guard lock{section_replace_helper.mtx};
-        section_replace_helper.queue.push_back(std::move(section_conf));
-    }
-
-    std::vector<std::string> replace_changed_sections() {
+    /* Replaces sections by the sections of the section configs (cfg(file, section_name)).
+     * A section config without a section removes it. Returns the names of replaced sections */
+    std::vector<std::string> replace_sections(std::vector<cfg>&& section_confs) {
         std::vector<std::string> replaced_sections;
 
-        std::lock_guard lock{section_replace_helper.mtx};
-        for (auto& sect_conf : section_replace_helper.queue) {
+        for (auto& sect_conf : section_confs) {
+            /* Moved nodes may be allocated from the storage of the section config */
+            storages.insert(storages.end(), sect_conf.storages.begin(), sect_conf.storages.end());
+
             auto sect_name = sect_conf.get_sections().begin()->first;
             auto last_node = sect_conf.calc_tail();
-            sections.at(sect_name).replace_by(std::move(sect_conf.sections.begin()->second), last_node);
+            auto found = sections.find(sect_name);
+            if (found == sections.end())
+                continue;
+
+            found->second.replace_by(std::move(sect_conf.sections.begin()->second), last_node);
             /* Remove removed section from sections map */
             if (!last_node)
-                sections.erase(sect_name);
+                erase_section(found);
             replaced_sections.push_back(std::move(sect_name));
         }
-        section_replace_helper.queue.clear();
 
         return replaced_sections;
     }
 
-    class cfg_watcher get_watcher();
-
 private:
     [[nodiscard]]
     cfg_node* calc_tail() const {
@@ -2008,9 +2524,32 @@ private:
             throw cfg_already_parsed(str_path);
         auto& file_node = pos->second;
 
-        auto mfv       = file_view<char>(str_path.data());
-        auto mfv_begin = mfv.begin();
-        auto mfv_end   = mfv.end();
+        /* Tokens of the binary cache are used as is */
+        auto cache = start_section ? nullptr : binary_cache();
+        if (cache) {
+            auto [cached, valid] = cache->open(path);
+            auto data            = std::string_view(cached.text);
+
+            if (valid) {
+                auto tokenizer = cfg_cached_tokenizer(data, cached.tokens);
+                parse_tokens(tokenizer, config_path, str_path, file_node, tail, start_section, section_parsed);
+            }
+            else {
+                auto tokenizer = cfg_tokenizer(data.data(), data.data() + data.size());
+                parse_tokens(tokenizer, config_path, str_path, file_node, tail, start_section, section_parsed, &cached);
+            }
+            return;
+        }
+
+        auto mfv  = asset_file(path);
+        auto data = std::string_view(mfv.begin(), mfv.end());
+
+        /* Loose files may be rewritten in place (by commit() or a text editor) while mapped tokens view them */
+        if (is_mapped() && !mfv.is_packed())
+            data = *storages.front()->files.emplace_back(std::make_unique<std::string>(data));
+
+        auto mfv_begin = data.data();
+        auto mfv_end   = data.data() + data.size();
 
         /* Start parsing from specific section */
         if (start_section) {
@@ -2037,7 +2576,19 @@ private:
         }
 
         auto tokenizer = cfg_tokenizer(mfv_begin, mfv_end);
-
+        parse_tokens(tokenizer, config_path, str_path, file_node, tail, start_section, section_parsed);
+    }
+
+    /* If cached is not null, the tokens are recorded to it */
+    template <typename Tokenizer>
+    void parse_tokens(Tokenizer&                        tokenizer,
+                      const fs::path&                   config_path,
+                      const std::string&                str_path,
+                      std::unique_ptr<cfg_file_node>&   file_node,
+                      cfg_node*&                        tail,
+                      const std::optional<std::string>& start_section,
+                      bool*                             section_parsed,
+                      cfg_cache_file*                   cached = nullptr) {
         while (tokenizer) {
             auto [tk, type, _] = tokenizer.next();
 
@@ -2048,7 +2599,12 @@ private:
                 break;
             }
 
-            tail = tail->insert_after(cfg_node::create(type, std::move(tk)), false);
+            if (cached)
+                cached->tokens.push_back(
+                    cfg_cache_token{u32(tk.data() - cached->text.data()), u32(tk.size()), type});
+
+            auto node = is_mapped() ? storages.front()->arena.create(type, tk) : cfg_node::create(type, tk.str());
+            tail      = tail->insert_after(std::move(node), false);
 
             if (!file_node) {
                 file_node = std::make_unique<cfg_file_node>(str_path, tail);
@@ -2065,7 +2621,7 @@ private:
                 {
                     auto& sectname = tail->tk.value;
                     auto [pos, was_insert] =
-                        sections.emplace(sectname.substr(1, sectname.size() - 2), tail);
+                        emplace_section(std::string(sectname.substr(1, sectname.size() - 2)), tail);
                     if (!was_insert)
                         throw cfg_section_already_exists(pos->first);
                     current_section = &pos->second;
@@ -2102,6 +2658,33 @@ private:
         insert_next();
     }
 
+    using sections_t = std::map<std::string, cfg_section<false>>;
+
+    struct section_slot {
+        u64                 hash    = 0;
+        const std::string*  name    = nullptr;
+        cfg_section<false>* section = nullptr;
+    };
+
+    [[nodiscard]]
+    cfg_section<false>* find_section(const cfg_section_name& section_name) const {
+        auto found = section_index.find(section_name.hash,
+                                        [&](const section_slot& slot) { return *slot.name == section_name.name; });
+        return found ? found->section : nullptr;
+    }
+
+    std::pair<sections_t::iterator, bool> emplace_section(std::string name, cfg_node* start) {
+        auto res = sections.emplace(std::move(name), cfg_section<false>{start});
+        if (res.second)
+            section_index.insert({fnv1a64(res.first->first), &res.first->first, &res.first->second});
+        return res;
+    }
+
+    void erase_section(sections_t::iterator pos) {
+        section_index.erase(fnv1a64(pos->first), [&](const section_slot& slot) { return slot.name == &pos->first; });
+        sections.erase(pos);
+    }
+
     /* Inserts the next key/value pair */
     void insert_next() {
         if (!current_key)
@@ -2109,18 +2692,13 @@ private:
 
         if (!current_section)
             current_section =
-                &sections.emplace(std::string(), cfg_section<false>(head.get())).first->second;
+                &emplace_section(std::string(), head.get()).first->second;
 
         if (!current_eq)
-            throw cfg_key_without_eq(current_section->section_name(), current_key->tk.value);
+            throw cfg_key_without_eq(current_section->section_name(), current_key->tk.value.str());
 
-        auto was_insert =
-            current_section->values
-                .emplace(cfg_key{current_key}, current_value ? current_value : current_eq)
-                .second;
-
-        if (!was_insert)
-            throw cfg_key_already_exists(current_section->section_name(), current_key->tk.value);
+        if (!current_section->insert_key(current_key, current_value ? current_value : current_eq))
+            throw cfg_key_already_exists(current_section->section_name(), current_key->tk.value.str());
 
         current_key   = nullptr;
         current_eq    = nullptr;
@@ -2129,8 +2707,9 @@ private:
 
 private:
     std::map<std::string, std::unique_ptr<cfg_file_node>> file_nodes;
-    std::map<std::string, cfg_section<false>>             sections;
-    std::unique_ptr<cfg_node>                             head;
+    sections_t                                            sections;
+    open_index<section_slot>                              section_index;
+    cfg_node_ptr                             head;
     std::vector<cfg_file_node*>                           file_stack;
 
     cfg_section<false>* current_section = nullptr;
@@ -2140,210 +2719,70 @@ private:
 
     bool commit_at_destroy = false;
     bool readonly          = false;
+    bool mapped            = false;
 
-    cfg_section_replace_helper<cfg> section_replace_helper;
+    /* The first one is used for parsing in cfg_mode::mapped. Declared after the head,
+     * so move assignment destroys the old nodes before their storage */
+    std::vector<std::shared_ptr<cfg_storage>> storages;
 };
 
-class cfg_watcher {
+/* Typed slot bound to [section]:key.
+ * refresh() does nothing until some config node has changed, and re-parses the value only
+ * when the node of the key itself was changed (set(), replace_sections(), etc.) */
+template <typename T>
+class cfg_binding {
 public:
-    cfg_watcher(cfg* config): conf(config), inotify_fd(inotify_init()) {
-        if (inotify_fd == -1)
-            throw cfg_exception("inotify_init() failed");
-    }
-
-    ~cfg_watcher() {
-        stop();
-        close(inotify_fd);
-    }
-
-    void watch_section(const cfg_section<true>& section) {
-        std::lock_guard lock{mtx};
-
-        auto file_node = section.begin().raw_node()->file;
-        auto [pos, was_insert] = watched_sections.emplace(file_node->path, std::set<std::string>{});
-        pos->second.emplace(section.section_name());
-
-        if (!mrunning)
-            start();
-
-        if (was_insert) {
-            auto dir = fs::path(file_node->path).parent_path();
-            auto dir_str = dir.string();
-
-            auto [dir_pos, was_insert] = dir_path_to_wd.emplace(dir.string(), 0);
-            if (was_insert) {
-                auto wd = inotify_add_watch(inotify_fd, dir_pos->first.data(), IN_MODIFY);
-                dir_pos->second = wd;
-                wd_to_dir_path.emplace(wd, dir_pos->first);
-            }
-        }
-
-    }
-
-    bool remove_section(const cfg_section<true>& section) {
-        auto file_node = section.begin().raw_node()->file;
-        std::lock_guard lock{mtx};
-
-        auto pos = watched_sections.find(file_node->path);
-        if (pos == watched_sections.end())
-            return false;
+    cfg_binding(const cfg& config, std::string section, std::string key):
+        _conf(&config), _section(std::move(section)), _key(std::move(key)) {}
 
-        if (!pos->second.erase(std::string(section.section_name())))
+    /* Returns true if the value was changed since the last refresh */
+    bool refresh() {
+        auto global_revision = cfg_node::global_revision();
+        if (global_revision == _global_revision)
             return false;
+        _global_revision = global_revision;
 
-        if (pos->second.empty()) {
-            watched_sections.erase(pos);
-
-            auto parent_path = fs::path(file_node->path).parent_path().string();
-            auto lb = watched_sections.lower_bound(parent_path);
-            if (lb == watched_sections.end() || !lb->first.starts_with(parent_path)) {
-                auto dir_path_pos = dir_path_to_wd.find(parent_path);
-                if (dir_path_pos != dir_path_to_wd.end()) {
-                    auto wd = dir_path_pos->second;
-                    dir_path_to_wd.erase(dir_path_pos);
-                    wd_to_dir_path.erase(wd);
-                    inotify_rm_watch(inotify_fd, wd);
-                }
-            }
-        }
+        std::optional<cfg_value<T, true>> value;
+        if (auto sect = _conf->try_get_section(cfg_section_name(_section)))
+            value = sect->template try_get<T>(_key);
 
-        if (watched_sections.empty() && mrunning)
-            stop();
+        auto revision = value && *value ? value->revision() : 0;
+        if (revision == _revision)
+            return false;
 
+        _revision = revision;
+        _value    = revision ? value->try_get() : std::optional<T>();
         return true;
     }
 
-    std::vector<std::string> watched_section_names() const {
-        std::vector<std::string> result;
-        std::lock_guard lock{mtx};
-        for (auto& [_, sections] : watched_sections) {
-            for (auto& sect_name : sections)
-                result.push_back(sect_name);
-        }
-        return result;
+    /* nullopt if the key does not exist or has not a value */
+    const std::optional<T>& get() {
+        refresh();
+        return _value;
     }
 
-    void worker() {
-        glog().info("config watcher start");
-
-        mrunning = true;
-
-        struct pollfd pevt = {.fd = inotify_fd, .events = POLLIN, .revents = {}};
-
-        char inotify_buff[8192];
-
-        while (mrunning) {
-            /* XXX: do not use timeout */
-            if (poll(&pevt, 1, 300) < 0) {
-                glog().error("poll failed");
-                break;
-            }
-
-            if (pevt.revents & POLLIN) {
-                auto len = read(inotify_fd, inotify_buff, sizeof(inotify_buff));
-                if (len > 0) {
-                    for (auto p = inotify_buff, e = inotify_buff + len; p < e;) {
-                        struct inotify_event evt;
-                        memcpy(&evt, p, sizeof(evt));
-                        if (evt.len == 0)
-                            break;
-
-                        std::lock_guard lock{mtx};
-                        auto pos = wd_to_dir_path.find(evt.wd);
-                        if (pos != wd_to_dir_path.end()) {
-                            auto filename = p + sizeof(evt);
-                            auto path = pos->second + "/" + filename;
-                            auto found_sect = watched_sections.find(path);
-                            if (found_sect != watched_sections.end())
-                                update(evt.wd, path, found_sect->second);
-                        }
-
-                        p += evt.len;
-                    }
-                }
-            }
-        }
-
-        glog().info("config watcher stop");
+    T value_or(const T& default_value) {
+        auto& v = get();
+        return v ? *v : default_value;
     }
 
-    void update([[maybe_unused]] int wd, const std::string& file, const std::set<std::string>& sections) {
-        std::vector<std::string> to_remove;
-
-        for (auto& section_name : sections) {
-            try {
-                auto sect_conf = cfg(file, section_name);
-                if (sect_conf.get_files().size() > 1)
-                    throw cfg_exception("Updating section splitted into different files is not supported now");
-                conf->schedule_section_replace(std::move(sect_conf));
-            }
-            catch (const cfg_section_not_found&) {
-                conf->schedule_section_replace(cfg(cfg::uninitialized_construct{}, section_name));
-                to_remove.push_back(section_name);
-            }
-            catch (const std::exception& e) {
-                glog().error("Update section [{}] failed: {}", section_name);
-            }
-        }
-
-        for (auto& section_name : to_remove) {
-            auto found_sects = watched_sections.find(file);
-            if (found_sects == watched_sections.end())
-                continue;
-
-            auto& sects = found_sects->second;
-            sects.erase(section_name);
-
-            glog().info("section [{}] has been removed from watch list", section_name);
-
-            if (sects.empty()) {
-                watched_sections.erase(found_sects);
-                glog().info("file {} has been removed from watch list", file);
-
-                auto dir_path = fs::path(file).parent_path().string();
-                auto found    = watched_sections.lower_bound(dir_path);
-
-                if (found == watched_sections.end() || !found->first.starts_with(dir_path)) {
-                    auto found_wd = dir_path_to_wd.find(dir_path);
-                    auto wd       = found_wd->second;
-                    dir_path_to_wd.erase(found_wd);
-                    wd_to_dir_path.erase(wd);
-                    glog().info("directory {} has been removed from watch list", dir_path);
-                }
-            }
-        }
-    }
-
-    void start() {
-        if (!mrunning) {
-            task = std::thread(&cfg_watcher::worker, this);
-            while (!mrunning)
-                usleep(1000);
-        }
+    [[nodiscard]]
+    const std::string& section_name() const {
+        return _section;
     }
 
-    void stop() {
-        if (mrunning) {
-            mrunning = false;
-            task.join();
-        }
+    [[nodiscard]]
+    const std::string& key() const {
+        return _key;
     }
 
 private:
-    std::thread                                     task;
-    std::atomic_bool                                mrunning = false;
-    cfg*                                            conf;
-    std::map<std::string, std::set<std::string>>    watched_sections;
-
-    std::map<int, std::string> wd_to_dir_path;
-    std::map<std::string, int> dir_path_to_wd;
-    int                        inotify_fd = -1;
-
-    mutable std::mutex mtx;
+    const cfg*       _conf;
+    std::string      _section;
+    std::string      _key;
+    std::optional<T> _value;
+    u64              _global_revision = ~u64(0);
+    u64              _revision        = ~u64(0);
 };
 
-cfg_watcher cfg::get_watcher() {
-    return {this};
-}
-
 } // namespace dfdh
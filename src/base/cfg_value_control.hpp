@@ -14,7 +14,8 @@ public:
     using value_t     = std::array<std::optional<float>, 3>;
 
     cfg_value_control(std::string isection, std::string ikey, value_t isteps):
-        section(std::move(isection)), key(std::move(ikey)), steps(isteps) {}
+        section(std::move(isection)), key(std::move(ikey)), steps(isteps),
+        binding(cfg::global(), section, key) {}
 
     void handle_event(const sf::Event& evt) {
         if (evt.type == sf::Event::KeyPressed) {
@@ -51,47 +52,32 @@ public:
 
     void update(size_t idx, float step) {
         try {
-            auto value_opt = cfg::mutable_global().get_section(section).try_get<std::string>(key);
-            if (!value_opt) {
+            auto& sect = cfg::mutable_global().get_section(section);
+            auto& current = binding.get();
+            if (!current) {
                 glog().warn("cfg_value_control: key {} was not found in section [{}]", key, section);
                 return;
             }
 
-            u32 value_idx = 0;
-            value_t values;
-
-            for (auto str_value_view : value_opt->value() / split(' ', '\t')) {
-                if (value_idx > 2){
-                    glog().warn("cfg_value_control: only 3 values supported");
-                    return;
-                }
-                auto str_value = std::string(str_value_view.begin(), str_value_view.end());
-                float num;
-                try {
-                    num = ston<float>(str_value);
-                }
-                catch (...) {
-                    glog().warn("cfg_value_control: key {} in section [{}] stores not a number value",
-                            key, section);
-                    return;
-                }
-                values[value_idx] = num;
-                ++value_idx;
+            if (current->size() > 3) {
+                glog().warn("cfg_value_control: only 3 values supported");
+                return;
             }
 
-            if (values[idx]) {
-                *values[idx] += step;
+            if (idx < current->size()) {
+                auto values = *current;
+                values[idx] += step;
+
                 std::stringstream ss;
                 for (auto& v : values)
-                    if (v)
-                        ss << *v << ' ';
+                    ss << v << ' ';
 
                 std::string new_value = ss.str();
                 if (!new_value.empty() && new_value.back() == ' ')
                     new_value.pop_back();
 
-                value_opt->set(new_value);
-                cfg::mutable_global().commit();
+                sect.raw_set(key, new_value);
+                cfg::mutable_global().commit_async();
                 glog().info_update(__COUNTER__, "cfg_value_control: updated [{}]:{} = {}", section, key, new_value);
                 updated = true;
             }
@@ -114,6 +100,9 @@ private:
     std::string key;
     value_t     steps;
 
+    /* Parsed only when the value was changed, not on every key press */
+    cfg_binding<std::vector<float>> binding;
+
     bool updated = false;
 };
 
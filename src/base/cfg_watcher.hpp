@@ -0,0 +1,346 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <functional>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+#include "cfg.hpp"
+#include "profiler.hpp"
+#include "signals.hpp"
+
+namespace dfdh {
+
+/* Watches the files of the sections with inotify.
+ * Bursts of events (editors often write a file in several steps) are coalesced until
+ * the files are quiet for debounce_time. Then the watched sections of the changed files
+ * are reparsed and only the changed ones are replaced by a single task on the main thread
+ * (signal_slot_event_updater) */
+class cfg_watcher {
+public:
+    using reload_callback_t = std::function<void(const std::vector<std::string>&)>;
+
+    static constexpr auto default_debounce_time = std::chrono::milliseconds(100);
+
+    cfg_watcher(cfg*                      config,
+                reload_callback_t         on_reload     = {},
+                std::chrono::milliseconds debounce_time = default_debounce_time):
+        conf(config),
+        reload_callback(std::move(on_reload)),
+        debounce(debounce_time),
+        inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC)),
+        wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        if (inotify_fd == -1 || wake_fd == -1) {
+            close(inotify_fd);
+            close(wake_fd);
+            throw cfg_exception("cfg_watcher: inotify_init1() or eventfd() failed");
+        }
+    }
+
+    ~cfg_watcher() {
+        stop();
+        close(inotify_fd);
+        close(wake_fd);
+    }
+
+    cfg_watcher(const cfg_watcher&) = delete;
+    cfg_watcher& operator=(const cfg_watcher&) = delete;
+
+    void watch_section(const cfg_section<true>& section) {
+        auto file_node = section.begin().raw_node()->file;
+        auto sect_name = std::string(section.section_name());
+        auto hash      = section_hash(file_node->path, sect_name);
+
+        std::lock_guard lock{mtx};
+
+        auto [pos, was_insert] = watched_sections.emplace(file_node->path, std::set<std::string>{});
+        pos->second.emplace(sect_name);
+        section_hashes.insert_or_assign(sect_name, hash);
+
+        if (!mrunning)
+            start();
+
+        if (was_insert) {
+            auto dir = fs::path(file_node->path).parent_path();
+
+            auto [dir_pos, was_insert] = dir_path_to_wd.emplace(dir.string(), 0);
+            if (was_insert) {
+                /* IN_MOVED_TO: editors which save through a temporary file */
+                auto wd = inotify_add_watch(inotify_fd, dir_pos->first.data(), IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO);
+                dir_pos->second = wd;
+                wd_to_dir_path.emplace(wd, dir_pos->first);
+            }
+        }
+    }
+
+    bool remove_section(const cfg_section<true>& section) {
+        auto file_node = section.begin().raw_node()->file;
+        std::lock_guard lock{mtx};
+
+        auto pos = watched_sections.find(file_node->path);
+        if (pos == watched_sections.end())
+            return false;
+
+        if (!pos->second.erase(std::string(section.section_name())))
+            return false;
+
+        section_hashes.erase(std::string(section.section_name()));
+
+        if (pos->second.empty())
+            unwatch_file(pos);
+
+        if (watched_sections.empty() && mrunning)
+            stop();
+
+        return true;
+    }
+
+    std::vector<std::string> watched_section_names() const {
+        std::vector<std::string> result;
+        std::lock_guard lock{mtx};
+        for (auto& [_, sections] : watched_sections) {
+            for (auto& sect_name : sections)
+                result.push_back(sect_name);
+        }
+        return result;
+    }
+
+    void worker() {
+        trace_recorder::set_thread_name("cfg watcher");
+        DFDH_ALLOC_SCOPE(cfg);
+        glog().info("config watcher start");
+
+        mrunning = true;
+
+        struct pollfd pevts[] = {{.fd = inotify_fd, .events = POLLIN, .revents = {}},
+                                 {.fd = wake_fd, .events = POLLIN, .revents = {}}};
+
+        std::set<std::string>                 changed_files;
+        std::chrono::steady_clock::time_point deadline;
+
+        while (mrunning) {
+            /* Sleep until an event or the end of the debounce window */
+            int timeout = -1;
+            if (!changed_files.empty()) {
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                timeout   = std::max(int(left.count()), 0);
+            }
+
+            if (poll(pevts, 2, timeout) < 0) {
+                if (errno == EINTR)
+                    continue;
+                glog().error("config watcher: poll failed");
+                break;
+            }
+
+            if (pevts[1].revents & POLLIN) {
+                eventfd_t value;
+                eventfd_read(wake_fd, &value);
+            }
+
+            if (pevts[0].revents & POLLIN) {
+                DFDH_TRACE_SCOPE("cfg watcher events");
+                if (read_events(changed_files))
+                    deadline = std::chrono::steady_clock::now() + debounce;
+            }
+
+            if (!changed_files.empty() && std::chrono::steady_clock::now() >= deadline) {
+                DFDH_TRACE_SCOPE("cfg watcher reload");
+                update(changed_files);
+                changed_files.clear();
+            }
+        }
+
+        glog().info("config watcher stop");
+    }
+
+    void start() {
+        if (!mrunning) {
+            task = std::thread(&cfg_watcher::worker, this);
+            while (!mrunning)
+                usleep(1000);
+        }
+    }
+
+    void stop() {
+        if (mrunning) {
+            mrunning = false;
+            eventfd_write(wake_fd, 1);
+            task.join();
+        }
+    }
+
+private:
+    /* Collects the watched files from pending inotify events. Returns true if any was found */
+    bool read_events(std::set<std::string>& changed_files) {
+        alignas(struct inotify_event) char inotify_buff[8192];
+        bool found = false;
+
+        ssize_t len;
+        while ((len = read(inotify_fd, inotify_buff, sizeof(inotify_buff))) > 0) {
+            std::lock_guard lock{mtx};
+
+            for (auto p = inotify_buff, e = inotify_buff + len; p < e;) {
+                struct inotify_event evt;
+                memcpy(&evt, p, sizeof(evt));
+                auto filename = p + sizeof(evt);
+                p += sizeof(evt) + evt.len;
+
+                if (evt.len == 0)
+                    continue;
+
+                auto pos = wd_to_dir_path.find(evt.wd);
+                if (pos == wd_to_dir_path.end())
+                    continue;
+
+                auto path = pos->second + "/" + filename;
+                if (watched_sections.contains(path)) {
+                    changed_files.insert(std::move(path));
+                    found = true;
+                }
+            }
+        }
+
+        return found;
+    }
+
+    /* Hash of the section text as it is in the file; zero if the section cannot be parsed */
+    static u64 section_hash(const std::string& file, const std::string& section_name) {
+        try {
+            return fnv1a64(format("{}", cfg(file, section_name)));
+        }
+        catch (const std::exception&) {
+            return 0;
+        }
+    }
+
+    void update(const std::set<std::string>& changed_files) {
+        std::vector<cfg> changed_sections;
+
+        for (auto& file : changed_files) {
+            std::set<std::string> sections;
+            {
+                std::lock_guard lock{mtx};
+                auto found = watched_sections.find(file);
+                if (found == watched_sections.end())
+                    continue;
+                sections = found->second;
+            }
+
+            std::vector<std::string> to_remove;
+
+            for (auto& section_name : sections) {
+                try {
+                    auto sect_conf = cfg(file, section_name);
+                    if (sect_conf.get_files().size() > 1)
+                        throw cfg_exception("Updating section splitted into different files is not supported now");
+
+                    /* Skip the sections which were not changed by the write */
+                    auto hash = fnv1a64(format("{}", sect_conf));
+                    if (!exchange_hash(section_name, hash))
+                        continue;
+
+                    changed_sections.push_back(std::move(sect_conf));
+                }
+                catch (const cfg_section_not_found&) {
+                    changed_sections.push_back(cfg(cfg::uninitialized_construct{}, section_name));
+                    to_remove.push_back(section_name);
+                }
+                catch (const std::exception& e) {
+                    glog().error("Update section [{}] failed: {}", section_name, e.what());
+                }
+            }
+
+            if (!to_remove.empty())
+                remove_sections(file, to_remove);
+        }
+
+        if (changed_sections.empty())
+            return;
+
+        /* std::function requires copyable captures */
+        auto batch = std::make_shared<std::vector<cfg>>(std::move(changed_sections));
+        signal_slot_event_updater::instance().push_task([this, checker = alive.checker(), batch] {
+            auto lock = checker.lock_alive();
+            if (!lock)
+                return;
+
+            auto replaced = conf->replace_sections(std::move(*batch));
+            glog().info("config watcher: {} sections reloaded", replaced.size());
+            if (reload_callback)
+                reload_callback(replaced);
+        });
+    }
+
+    /* Returns true if the hash of the section was changed */
+    bool exchange_hash(const std::string& section_name, u64 hash) {
+        std::lock_guard lock{mtx};
+        auto [pos, was_insert] = section_hashes.emplace(section_name, hash);
+        if (!was_insert && pos->second == hash)
+            return false;
+        pos->second = hash;
+        return true;
+    }
+
+    void remove_sections(const std::string& file, const std::vector<std::string>& section_names) {
+        std::lock_guard lock{mtx};
+
+        auto found_sects = watched_sections.find(file);
+        if (found_sects == watched_sections.end())
+            return;
+
+        for (auto& section_name : section_names) {
+            found_sects->second.erase(section_name);
+            section_hashes.erase(section_name);
+            glog().info("section [{}] has been removed from watch list", section_name);
+        }
+
+        if (found_sects->second.empty()) {
+            glog().info("file {} has been removed from watch list", file);
+            unwatch_file(found_sects);
+        }
+    }
+
+    /* Must be called under the lock */
+    void unwatch_file(std::map<std::string, std::set<std::string>>::iterator pos) {
+        auto dir_path = fs::path(pos->first).parent_path().string();
+        watched_sections.erase(pos);
+
+        auto found = watched_sections.lower_bound(dir_path);
+        if (found != watched_sections.end() && found->first.starts_with(dir_path))
+            return;
+
+        auto found_wd = dir_path_to_wd.find(dir_path);
+        if (found_wd == dir_path_to_wd.end())
+            return;
+
+        auto wd = found_wd->second;
+        dir_path_to_wd.erase(found_wd);
+        wd_to_dir_path.erase(wd);
+        inotify_rm_watch(inotify_fd, wd);
+        glog().info("directory {} has been removed from watch list", dir_path);
+    }
+
+private:
+    std::thread                                  task;
+    std::atomic_bool                             mrunning = false;
+    cfg*                                         conf;
+    reload_callback_t                            reload_callback;
+    std::chrono::milliseconds                    debounce;
+    std::map<std::string, std::set<std::string>> watched_sections;
+    std::map<std::string, u64>                   section_hashes;
+    std::map<int, std::string>                   wd_to_dir_path;
+    std::map<std::string, int>                   dir_path_to_wd;
+    int                                          inotify_fd = -1;
+    int                                          wake_fd    = -1;
+
+    mutable std::mutex mtx;
+
+    /* Declared last: waits for the running reload task before the members are destroyed */
+    slot_alive_holder alive;
+};
+
+} // namespace dfdh
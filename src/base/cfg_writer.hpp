@@ -0,0 +1,174 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "finalizers.hpp"
+#include "io.hpp"
+#include "log.hpp"
+
+namespace dfdh {
+
+namespace fs = std::filesystem;
+
+/* Writes the file through a temporary one and rename(), so readers never see a partial file.
+ * The data is synced before the rename and the directory after it: after a crash the file
+ * holds the old or the new text, never an empty one */
+inline void cfg_write_file_atomic(const std::string& path, std::string_view data) {
+    auto tmp_path = path + ".tmp";
+    {
+        auto ofd = outfd<char, 8192, fd_exception_on_syswrite_fail::enable>(tmp_path);
+        ofd.write(data.data(), data.size());
+        ofd.flush();
+        if (::fsync(ofd.descriptor()) < 0)
+            throw sys_write_fail("fsync of " + tmp_path, errc::from_errno());
+    }
+    fs::rename(tmp_path, path);
+
+    auto dir   = fs::path(path).parent_path();
+    auto dirfd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        throw cannot_open_file(dir.string(), errc::from_errno());
+    auto scope_exit = finalizer([=] { ::close(dirfd); });
+    if (::fsync(dirfd) < 0)
+        throw sys_write_fail("fsync of " + dir.string(), errc::from_errno());
+}
+
+/* Background writer of config files.
+ * The latest text of a file replaces the pending one, and a file is written at most
+ * once per min_interval, so frequent commits (window resize, value control) cost one write */
+class cfg_writer {
+public:
+    static constexpr auto default_min_interval = std::chrono::milliseconds(500);
+
+    static cfg_writer& instance() {
+        static cfg_writer inst;
+        return inst;
+    }
+
+    cfg_writer(std::chrono::milliseconds min_interval = default_min_interval): interval(min_interval) {
+        worker = std::thread(&cfg_writer::work, this);
+    }
+
+    ~cfg_writer() {
+        flush();
+        {
+            std::lock_guard lock{mtx};
+            running = false;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    cfg_writer(const cfg_writer&) = delete;
+    cfg_writer& operator=(const cfg_writer&) = delete;
+
+    void push(std::string path, std::string text) {
+        {
+            std::lock_guard lock{mtx};
+            auto& file   = files[std::move(path)];
+            file.text    = std::move(text);
+            file.pending = true;
+        }
+        cv.notify_all();
+    }
+
+    /* Barrier: writes all pending files immediately and waits for them */
+    void flush() {
+        std::unique_lock lock{mtx};
+        ++flush_requests;
+        cv.notify_all();
+        cv.wait(lock, [this] { return !has_pending() && !writing; });
+        --flush_requests;
+    }
+
+    [[nodiscard]]
+    size_t writes_count() const {
+        std::lock_guard lock{mtx};
+        return writes;
+    }
+
+private:
+    struct file_t {
+        std::string                           text;
+        std::chrono::steady_clock::time_point last_write;
+        bool                                  pending = false;
+    };
+
+    [[nodiscard]]
+    bool has_pending() const {
+        for (auto& [_, file] : files)
+            if (file.pending)
+                return true;
+        return false;
+    }
+
+    void work() {
+        DFDH_ALLOC_SCOPE(cfg);
+        std::unique_lock lock{mtx};
+
+        while (running) {
+            auto now     = std::chrono::steady_clock::now();
+            auto next    = std::chrono::steady_clock::time_point::max();
+            bool written = false;
+
+            for (auto& [path, file] : files) {
+                if (!file.pending)
+                    continue;
+
+                auto due = file.last_write + interval;
+                if (flush_requests == 0 && due > now) {
+                    next = std::min(next, due);
+                    continue;
+                }
+
+                auto text       = std::move(file.text);
+                file.pending    = false;
+                file.last_write = now;
+                writing         = true;
+                ++writes;
+
+                lock.unlock();
+                try {
+                    cfg_write_file_atomic(path, text);
+                }
+                catch (const std::exception& e) {
+                    glog().error("cfg_writer: cannot write {}: {}", path, e.what());
+                }
+                lock.lock();
+
+                writing = false;
+                written = true;
+                /* The files may have been changed while unlocked */
+                break;
+            }
+
+            cv.notify_all();
+
+            if (written)
+                continue;
+            if (next == std::chrono::steady_clock::time_point::max())
+                cv.wait(lock);
+            else
+                cv.wait_until(lock, next);
+        }
+    }
+
+private:
+    std::chrono::milliseconds       interval;
+    std::map<std::string, file_t>   files;
+    size_t                          flush_requests = 0;
+    size_t                          writes         = 0;
+    bool                            writing        = false;
+    bool                            running        = true;
+    mutable std::mutex              mtx;
+    std::condition_variable         cv;
+    std::thread                     worker;
+};
+
+} // namespace dfdh
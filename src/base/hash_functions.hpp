@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string_view>
+
 #include "types.hpp"
 
 namespace dfdh
@@ -22,4 +24,12 @@ inline uint64_t fnv1a64_nullterm(const void* ptr) {
 
     return hash;
 }
+/* Same as fnv1a64(str.data(), str.size()), usable in constant expressions */
+constexpr uint64_t fnv1a64(std::string_view str) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (auto c : str) hash = (hash ^ u8(c)) * 0x100000001b3;
+
+    return hash;
+}
 } // namespace dfdh
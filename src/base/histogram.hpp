@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#include "types.hpp"
+
+namespace dfdh {
+
+/* Log-linear (HDR-style) histogram of u64 values: every power of two is split into
+ * 2^SubBits linear buckets, so a percentile is off by less than 1 / 2^SubBits of the value */
+template <size_t SubBits = 5>
+class log_histogram {
+public:
+    static constexpr size_t sub_buckets  = size_t(1) << SubBits;
+    static constexpr size_t bucket_count = (64 - SubBits + 1) * sub_buckets;
+
+    static constexpr size_t bucket_index(u64 value) {
+        auto msb = size_t(std::bit_width(value));
+        if (msb <= SubBits)
+            return size_t(value);
+        auto shift = msb - SubBits - 1;
+        return (shift + 1) * sub_buckets + size_t(value >> shift) - sub_buckets;
+    }
+
+    /* The greatest value of the bucket */
+    static constexpr u64 bucket_upper(size_t index) {
+        if (index < sub_buckets)
+            return index;
+        auto shift = index / sub_buckets - 1;
+        auto base  = u64(index % sub_buckets + sub_buckets) << shift;
+        return base + ((u64(1) << shift) - 1);
+    }
+
+    void add(u64 value) {
+        ++_buckets[bucket_index(value)];
+        ++_count;
+        _max = std::max(_max, value);
+        _min = std::min(_min, value);
+    }
+
+    void merge(const log_histogram& hist) {
+        for (size_t i = 0; i < bucket_count; ++i) _buckets[i] += hist._buckets[i];
+        _count += hist._count;
+        _max = std::max(_max, hist._max);
+        _min = std::min(_min, hist._min);
+    }
+
+    void clear() {
+        if (_count == 0)
+            return;
+        _buckets.fill(0);
+        _count = 0;
+        _max   = 0;
+        _min   = std::numeric_limits<u64>::max();
+    }
+
+    /* Value below which the q part of the values fall, q in [0, 1]. Never exceeds the max */
+    [[nodiscard]]
+    u64 percentile(double q) const {
+        if (_count == 0)
+            return 0;
+
+        auto rank = std::max(u64(std::ceil(q * double(_count))), u64(1));
+        u64  seen = 0;
+        for (size_t i = 0; i < bucket_count; ++i) {
+            seen += _buckets[i];
+            if (seen >= rank)
+                return std::clamp(bucket_upper(i), _min, _max);
+        }
+        return _max;
+    }
+
+    [[nodiscard]]
+    u64 count() const {
+        return _count;
+    }
+
+    [[nodiscard]]
+    u64 max() const {
+        return _max;
+    }
+
+    [[nodiscard]]
+    u64 min() const {
+        return _count ? _min : 0;
+    }
+
+private:
+    std::array<u32, bucket_count> _buckets = {};
+    u64                           _count   = 0;
+    u64                           _max     = 0;
+    u64                           _min     = std::numeric_limits<u64>::max();
+};
+
+} // namespace dfdh
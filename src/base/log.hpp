@@ -1,21 +1,29 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
 #include <map>
+#include <span>
+#include <unordered_set>
 #include <atomic>
+#include <thread>
 
+#include "alloc_tracker.hpp"
 #include "io.hpp"
+#include "log_binary.hpp"
+#include "mpsc_ring.hpp"
 #include "time.hpp"
 #include "ring_buffer.hpp"
 #include "print.hpp"
 #include "hash_functions.hpp"
 #include "split_view.hpp"
+#include "string_arena.hpp"
 
 namespace dfdh
 {
-inline constexpr auto log_time_format = "[hh:mm:ss.xxx]"sv;
+inline constexpr auto log_time_format = datetime_format("[hh:mm:ss.xxx]");
 enum class log_level { debug = 0, detail, info, warn, error };
 
 class log_acceptor_base {
@@ -31,6 +39,17 @@ public:
     virtual void
     write_handler(log_level level, write_type wt, std::string_view time, std::string_view msg, uint64_t times) = 0;
 
+    /* Binary acceptors take the encoded records instead of the texts */
+    [[nodiscard]]
+    virtual bool binary() const {
+        return false;
+    }
+
+    virtual void write_binary(log_level /*level*/,
+                              u64 /*format_id*/,
+                              std::string_view /*format_str*/,
+                              std::span<const char> /*record*/) {}
+
     void write(log_level level, std::string_view time, std::string_view msg, uint64_t msg_hash) {
         auto     comphash   = uint32_t((msg_hash & 0x00000000ffffffff) ^ (msg_hash >> 32));
         uint64_t d          = data.load(std::memory_order_acquire);
@@ -167,108 +186,138 @@ private:
     std::atomic<size_t> prev_record_len = 0;
 };
 
-template <typename T>
-class log_records {
+/* Writes the format string id, level, tsc timestamp and raw arguments of every record.
+ * A record costs a memcpy into the file buffer, the texts are rendered by tools/log_decoder.
+ * The buffer is written out when full, on warnings and errors and once it is older than
+ * flush_period, so a crash loses at most that much */
+class log_acceptor_binary : public log_acceptor_base {
 public:
-    template <typename I>
-    log_records(I ibegin, I iend, size_t start_pos, size_t end_pos, size_t max_pos):
-        mstart_pos(start_pos), mend_pos(end_pos), mmax_pos(max_pos) {
-        records.resize(end_pos - start_pos);
-        size_t i = 0;
-        for (auto iter = ibegin; iter != iend; ++iter) records[i++] = *iter;
-    }
-
-    [[nodiscard]]
-    auto begin() const {
-        return records.begin();
-    }
+    static constexpr size_t buffer_size  = 1 << 16;
+    static constexpr auto   flush_period = std::chrono::seconds(1);
 
-    [[nodiscard]]
-    auto end() const {
-        return records.end();
-    }
-
-    [[nodiscard]]
-    size_t start_pos() const {
-        return mstart_pos;
+    log_acceptor_binary(outfd<char, buffer_size> o):
+        ofd(std::move(o)),
+        flush_period_ticks(u64(tsc_frequency() * std::chrono::duration<double>(flush_period).count())),
+        last_flush(tsc_now()) {
+        std::vector<char> data;
+        ss::serializer    s{data};
+        s.write(binlog_header{binlog_magic, binlog_version, tsc_anchor::now()});
+        ofd.write(data.data(), data.size());
     }
 
-    [[nodiscard]]
-    size_t end_pos() const {
-        return mend_pos;
+    static std::unique_ptr<log_acceptor_binary> create(const std::string& path) {
+        return std::make_unique<log_acceptor_binary>(outfd<char, buffer_size>(path));
     }
 
     [[nodiscard]]
-    size_t max_pos() const {
-        return mmax_pos;
+    bool binary() const final {
+        return true;
     }
 
-private:
-    std::vector<T> records;
-    size_t mstart_pos;
-    size_t mend_pos;
-    size_t mmax_pos;
-};
-
-template <typename I>
-log_records(I i, I, size_t, size_t, size_t) -> log_records<std::decay_t<decltype(*i)>>;
-
-template <typename I>
-class locked_log_range {
-public:
-    locked_log_range(I ibegin, I iend, size_t start_pos, size_t end_pos, size_t max_pos, std::shared_mutex& imtx):
-        b(ibegin), e(iend), mstart_pos(start_pos), mend_pos(end_pos), mmax_pos(max_pos), mtx(imtx) {}
+    void write_binary(log_level level, u64 format_id, std::string_view format_str, std::span<const char> record) final {
+        std::lock_guard lock{mtx};
+        if (formats.insert(format_id).second) {
+            binlog_buffer definition;
+            binlog_encode_format(definition, format_id, format_str);
+            ofd.write(definition.data().data(), definition.size);
+        }
+        ofd.write(record.data(), record.size());
 
-    ~locked_log_range() {
-        mtx.unlock_shared();
+        if (level >= log_level::warn)
+            flush_unlocked(tsc_now());
+        else
+            flush_if_stale_unlocked();
     }
 
-    [[nodiscard]]
-    I begin() const {
-        return b;
-    }
+    /* Texts which are not passed through the format strings */
+    void write_handler(log_level level, write_type, std::string_view, std::string_view msg, uint64_t) final {
+        static constexpr format_string<std::string_view> format_str = "{}";
 
-    [[nodiscard]]
-    I end() const {
-        return e;
+        binlog_buffer record;
+        binlog_encode(record, u8(level), 0, format_str.hash(), tsc_now(), msg);
+        write_binary(level, format_str.hash(), format_str.str(), record.data());
     }
 
-    [[nodiscard]]
-    size_t start_pos() const {
-        return mstart_pos;
+    void flush() {
+        std::lock_guard lock{mtx};
+        flush_unlocked(tsc_now());
     }
 
-    [[nodiscard]]
-    size_t end_pos() const {
-        return mend_pos;
+    /* Call periodically to write out the records of an idle logger too */
+    void flush_if_stale() {
+        std::lock_guard lock{mtx};
+        flush_if_stale_unlocked();
     }
 
-    [[nodiscard]]
-    size_t max_pos() const {
-        return mmax_pos;
+private:
+    void flush_unlocked(u64 now) {
+        ofd.flush();
+        last_flush = now;
     }
 
-    [[nodiscard]]
-    auto copy_records() const {
-        return log_records(b, e, mstart_pos, mend_pos, mmax_pos);
+    void flush_if_stale_unlocked() {
+        if (auto now = tsc_now(); now - last_flush >= flush_period_ticks)
+            flush_unlocked(now);
     }
 
 private:
-    I                  b, e;
-    size_t             mstart_pos;
-    size_t             mend_pos;
-    size_t             mmax_pos;
-    std::shared_mutex& mtx;
+    outfd<char, buffer_size> ofd;
+    std::unordered_set<u64>  formats;
+    std::mutex               mtx;
+    u64                      flush_period_ticks;
+    u64                      last_flush;
 };
 
 class log_acceptor_ring_buffer : public log_acceptor_base {
 public:
     struct record {
-        std::string time;
-        std::string msg;
-        uint64_t    times;
-        log_level   lvl;
-        write_type  wt;
+        string_arena::ref time;
+        string_arena::ref msg;
+        uint64_t          times;
+        uint64_t          revision;
+        log_level         lvl;
+        write_type        wt;
+    };
+
+    /* Shared-locked view of the records.
+     * Record with index i has absolute index first_index() + i, which never changes while it lives in the ring */
+    class reader {
+    public:
+        reader(const log_acceptor_ring_buffer& ring): r(ring), lock(ring.mtx) {}
+
+        [[nodiscard]]
+        size_t size() const {
+            return r.records.size();
+        }
+
+        [[nodiscard]]
+        uint64_t first_index() const {
+            return r.evicted;
+        }
+
+        [[nodiscard]]
+        uint64_t revision() const {
+            return r.revision;
+        }
+
+        [[nodiscard]]
+        const record& operator[](size_t idx) const {
+            return *(r.records.begin() + ssize_t(idx));
+        }
+
+        [[nodiscard]]
+        std::string_view time(const record& rec) const {
+            return r.arena.view(rec.time);
+        }
+
+        [[nodiscard]]
+        std::string_view msg(const record& rec) const {
+            return r.arena.view(rec.msg);
+        }
+
+    private:
+        const log_acceptor_ring_buffer&       r;
+        std::shared_lock<std::shared_mutex>   lock;
     };
 
     log_acceptor_ring_buffer(size_t max_records): records(max_records) {}
@@ -279,13 +328,15 @@ public:
     void
     write_handler(log_level level, write_type wt, std::string_view time, std::string_view msg, uint64_t times) final {
         std::unique_lock lock{mtx};
+        ++revision;
 
         if (wt == write_type::new_record || records.empty()) {
-            std::string tm{time};
+            auto tm = time;
             last_lines_count = 0;
             for (auto line : msg / split('\n', '\r')) {
                 /* Specify time in first line only */
-                records.push({std::move(tm), {line.begin(), line.end()}, times, level, wt});
+                push_record(tm, std::string_view(line.begin(), line.end()), times, level, wt);
+                tm = {};
                 ++last_lines_count;
             }
         }
@@ -294,57 +345,46 @@ public:
             auto b      = records.begin() + ssize_t(offset);
 
             b->lvl   = level;
-            b->time  = time;
             b->wt    = wt;
             b->times = times;
+            b->time  = arena.replace(b->time, time);
+
+            /* Readers look for the changed records from the tail, every line of the record is stamped */
+            for (auto it = b; it != records.end(); ++it) it->revision = revision;
 
             if (wt == write_type::update) {
                 size_t lines_count = 0;
                 for (auto line : msg / split('\n', '\r')) {
                     if (b != records.end())
-                        b->msg = std::string(line.begin(), line.end());
+                        b->msg = arena.replace(b->msg, std::string_view(line.begin(), line.end()));
                     else
-                        records.push({{}, {line.begin(), line.end()}, times, level, wt});
+                        push_record({}, std::string_view(line.begin(), line.end()), times, level, wt);
                     ++lines_count;
                     ++b;
                 }
 
                 while (lines_count < last_lines_count) {
+                    release(records.back());
                     records.pop();
-                    --lines_count;
+                    --last_lines_count;
                 }
 
                 last_lines_count = lines_count;
             }
         }
-    }
 
-    auto read_lock(size_t preferred_start, size_t max_records) const {
-        mtx.lock_shared();
-        if (records.size() < max_records) {
-            return locked_log_range(records.begin(), records.end(), 0, records.size(), records.size(), mtx);
-        }
-        else if (preferred_start + max_records > records.size()) {
-            preferred_start = records.size() - max_records;
-            return locked_log_range(records.begin() + ssize_t(preferred_start),
-                                    records.end(),
-                                    preferred_start,
-                                    records.size(),
-                                    records.size(),
-                                    mtx);
-        }
-        else {
-            return locked_log_range(records.begin() + ssize_t(preferred_start),
-                                    records.begin() + ssize_t(preferred_start + max_records),
-                                    preferred_start,
-                                    preferred_start + max_records,
-                                    records.size(),
-                                    mtx);
-        }
+        if (arena.compaction_required())
+            arena.compact([this](auto&& rebind) {
+                for (auto& rec : records) {
+                    rebind(rec.time);
+                    rebind(rec.msg);
+                }
+            });
     }
 
-    auto get_records(size_t preferred_start, size_t max_records) const {
-        return read_lock(preferred_start, max_records).copy_records();
+    [[nodiscard]]
+    reader read() const {
+        return reader(*this);
     }
 
     [[nodiscard]]
@@ -360,44 +400,131 @@ public:
     }
 
     void max_size(size_t value) {
+        /* The ring keeps at least one record */
+        value = std::max(value, size_t(1));
+
         std::unique_lock lock{mtx};
+        ++revision;
+
+        auto count = records.size();
+        auto b     = records.begin();
+        for (; count > value; --count, ++b) {
+            release(*b);
+            ++evicted;
+        }
         records.resize(value);
     }
 
     void clear() {
         std::unique_lock lock{mtx};
+        ++revision;
+        evicted += records.size();
         records.clear();
+        arena.clear();
+        last_lines_count = 0;
+    }
+
+private:
+    void push_record(std::string_view time, std::string_view msg, uint64_t times, log_level level, write_type wt) {
+        if (records.size() == records.max_size()) {
+            release(*records.begin());
+            ++evicted;
+        }
+        records.push({arena.push(time), arena.push(msg), times, revision, level, wt});
+    }
+
+    void release(const record& rec) {
+        arena.release(rec.time);
+        arena.release(rec.msg);
     }
 
 private:
     ring_buffer<record>       records;
+    string_arena              arena;
     size_t                    last_lines_count = 0;
+    uint64_t                  evicted          = 0;
+    uint64_t                  revision         = 0;
     mutable std::shared_mutex mtx;
 };
 
+/* What to do with a record when the async queue is full */
+enum class log_overflow { drop = 0, block };
+
 class logger {
 public:
+    static constexpr size_t default_async_queue_size = 4096;
+    static constexpr size_t queued_args_reserve      = 128;
+
     logger() {
         add_stream("stdout", log_acceptor_fd::create(outfd<char>::stdout()));
     }
 
     ~logger() {
+        stop_async();
         info("******* log close *******\n");
     }
 
+    /* Moves the formatting, hashing, timestamp formatting and writes to the acceptors into a drain thread.
+     * Callers only encode the arguments like the binary log does and push them into the bounded
+     * lock-free queue; the arguments without a binary form are still formatted by the callers */
+    void start_async(size_t queue_size = default_async_queue_size, log_overflow policy = log_overflow::drop) {
+        std::lock_guard lock{async_mtx};
+        if (async_enabled.load())
+            return;
+
+        queue           = std::make_unique<mpsc_ring<record>>(queue_size);
+        overflow_policy = policy;
+        drain_running   = true;
+        drain_thread    = std::thread(&logger::drain_worker, this);
+        async_enabled.store(true);
+    }
+
+    /* Writes the pending records and returns to the synchronous mode */
+    void stop_async() {
+        std::lock_guard lock{async_mtx};
+        if (!async_enabled.load())
+            return;
+
+        async_enabled.store(false);
+        /* Pushes which have seen the async mode must land in the queue before the drain stops */
+        while (pushing.load() != 0) std::this_thread::yield();
+
+        drain_running.store(false);
+        wake();
+        drain_thread.join();
+        queue.reset();
+    }
+
+    /* Waits until the records pushed before the call are written */
+    void flush() {
+        auto target = pushed.load();
+        while (async_enabled.load() && written.load() < target) {
+            wake();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+
+    [[nodiscard]]
+    uint64_t dropped_count() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
     void add_stream(const std::string& name, std::unique_ptr<log_acceptor_base> log_acceptor) {
         std::unique_lock lock{mtx};
         streams.insert_or_assign(name, std::move(log_acceptor));
+        count_streams();
     }
 
     void add_stream(const std::string& name, outfd<char> ofd) {
         std::unique_lock lock{mtx};
         streams.insert_or_assign(name, log_acceptor_fd::create(std::move(ofd)));
+        count_streams();
     }
 
     void remove_stream(const std::string& name) {
         std::unique_lock lock{mtx};
         streams.erase(name);
+        count_streams();
     }
 
     std::unique_ptr<log_acceptor_base> take_stream(const std::string& name) {
@@ -406,37 +533,39 @@ public:
         if (found != streams.end()) {
             auto res = std::move(found->second);
             streams.erase(found);
+            count_streams();
             return res;
         }
         return {};
     }
 
+    /* Binary acceptors get the arguments without the text formatting, which is skipped
+     * if there are no text acceptors */
     template <typename... Ts>
-    void log(log_level level, std::string_view format_str, Ts&&... args) {
-        auto msg  = format(format_str, std::forward<Ts>(args)...);
-        auto hash = fnv1a64(msg.data(), msg.size());
-        auto time = current_datetime(log_time_format);
-
-        std::shared_lock lock{mtx};
-        for (auto& [_, stream] : streams) stream->write(level, time, msg, hash);
+    void log(log_level level, format_string<Ts...> format_str, Ts&&... args) {
+        DFDH_ALLOC_SCOPE(log);
+        if (binary_streams.load(std::memory_order_relaxed))
+            write_binary(level, 0, format_str, args...);
+        if (text_streams.load(std::memory_order_relaxed))
+            submit(level, 0, false, format_str, args...);
     }
 
     template <typename... Ts>
-    void log_update(log_level level, uint16_t update_id, std::string_view format_str, Ts&&... args) {
-        auto msg  = format(format_str, std::forward<Ts>(args)...);
-        auto time = current_datetime(log_time_format);
-
-        std::shared_lock lock{mtx};
-        for (auto& [_, stream] : streams) stream->write_update(update_id, level, time, msg);
+    void log_update(log_level level, uint16_t update_id, format_string<Ts...> format_str, Ts&&... args) {
+        DFDH_ALLOC_SCOPE(log);
+        if (binary_streams.load(std::memory_order_relaxed))
+            write_binary(level, update_id, format_str, args...);
+        if (text_streams.load(std::memory_order_relaxed))
+            submit(level, update_id, true, format_str, args...);
     }
 
 #define def_log_func(level)                                                                                            \
     template <typename... Ts>                                                                                          \
-    void level(std::string_view format_str, Ts&&... args) {                                                            \
+    void level(format_string<Ts...> format_str, Ts&&... args) {                                                        \
         log(log_level::level, format_str, std::forward<Ts>(args)...);                                                  \
     }                                                                                                                  \
     template <typename... Ts>                                                                                          \
-    void level##_update(uint16_t update_id, std::string_view format_str, Ts&&... args) {                               \
+    void level##_update(uint16_t update_id, format_string<Ts...> format_str, Ts&&... args) {                           \
         log_update(log_level::level, update_id, format_str, std::forward<Ts>(args)...);                                \
     }
 
@@ -447,9 +576,171 @@ public:
     def_log_func(error)
 #undef def_log_func
 
+private:
+    struct record {
+        std::string                           msg;
+        std::chrono::system_clock::time_point time;
+        log_level                             level     = log_level::info;
+        uint16_t                              update_id = 0;
+        bool                                  update    = false;
+        /* Queued records: msg is rendered by the drain thread from the format and the encoded arguments */
+        std::string_view format_str = {};
+        binlog_buffer    args       = {};
+    };
+
+    template <typename... Ts>
+    void submit(log_level level, uint16_t update_id, bool update, format_string<Ts...> format_str, const Ts&... args) {
+        auto now = std::chrono::system_clock::now();
+
+        if (async_enabled.load(std::memory_order_relaxed)) {
+            pushing.fetch_add(1);
+            if (async_enabled.load()) {
+                record rec{{}, now, level, update_id, update, format_str.str(), {}};
+                /* One allocation instead of the growth steps of the buffer */
+                rec.args.storage.resize(queued_args_reserve);
+                binlog_encode_args(rec.args, args...);
+                push(std::move(rec));
+                pushing.fetch_sub(1);
+                return;
+            }
+            pushing.fetch_sub(1);
+        }
+
+        write({format(format_str, args...), now, level, update_id, update});
+    }
+
+    void push(record&& rec) {
+        while (!queue->try_push(std::move(rec))) {
+            if (overflow_policy == log_overflow::drop) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            wake();
+            std::this_thread::yield();
+        }
+
+        pushed.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (drain_sleeping.load())
+            wake();
+    }
+
+    void write(const record& rec) {
+        /* Per thread: the synchronous mode writes from the calling threads */
+        thread_local datetime_cache time_cache{log_time_format};
+        auto time = time_cache(rec.time);
+
+        std::string_view msg = rec.msg;
+        if (!rec.format_str.empty()) {
+            thread_local std::string rendered;
+            rendered.clear();
+            auto ds = ss::deserializer{rec.args.data()};
+            binlog_render(rendered, rec.format_str, ds);
+            msg = rendered;
+        }
+
+        std::shared_lock lock{mtx};
+        if (rec.update) {
+            for (auto& [_, stream] : streams)
+                if (!stream->binary())
+                    stream->write_update(rec.update_id, rec.level, time, msg);
+        }
+        else {
+            auto hash = fnv1a64(msg.data(), msg.size());
+            for (auto& [_, stream] : streams)
+                if (!stream->binary())
+                    stream->write(rec.level, time, msg, hash);
+        }
+    }
+
+    template <typename... Ts>
+    void write_binary(log_level level, uint16_t update_id, format_string<Ts...> format_str, const Ts&... args) {
+        thread_local binlog_buffer record;
+        record.clear();
+        binlog_encode(record, u8(level), update_id, format_str.hash(), tsc_now(), args...);
+
+        std::shared_lock lock{mtx};
+        for (auto& [_, stream] : streams)
+            if (stream->binary())
+                stream->write_binary(level, format_str.hash(), format_str.str(), record.data());
+    }
+
+    /* Must be called under the unique lock */
+    void count_streams() {
+        u32 binary = 0;
+        for (auto& [_, stream] : streams)
+            if (stream->binary())
+                ++binary;
+        binary_streams.store(binary, std::memory_order_relaxed);
+        text_streams.store(u32(streams.size()) - binary, std::memory_order_relaxed);
+    }
+
+    void wake() {
+        wake_seq.fetch_add(1);
+        wake_seq.notify_one();
+    }
+
+    void drain_worker() {
+        DFDH_ALLOC_SCOPE(log);
+        record   rec;
+        uint64_t reported_drops = 0;
+
+        while (true) {
+            while (queue->try_pop(rec)) {
+                write(rec);
+                written.fetch_add(1);
+            }
+
+            if (auto drops = dropped.load(std::memory_order_relaxed); drops != reported_drops) {
+                write({format("logger: {} records dropped on the queue overflow", drops - reported_drops),
+                       std::chrono::system_clock::now(),
+                       log_level::warn});
+                reported_drops = drops;
+            }
+
+            if (!drain_running.load()) {
+                /* The last records of stop_async() */
+                if (!queue->try_pop(rec))
+                    break;
+                write(rec);
+                written.fetch_add(1);
+                continue;
+            }
+
+            /* Sleep until push() sees drain_sleeping; recheck the queue to not miss a wake() */
+            auto seq = wake_seq.load();
+            drain_sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!queue->try_pop(rec)) {
+                if (drain_running.load())
+                    wake_seq.wait(seq);
+            }
+            else {
+                write(rec);
+                written.fetch_add(1);
+            }
+            drain_sleeping.store(false);
+        }
+    }
+
 private:
     std::map<std::string, std::unique_ptr<log_acceptor_base>> streams;
     mutable std::shared_mutex                                 mtx;
+
+    std::unique_ptr<mpsc_ring<record>> queue;
+    log_overflow                       overflow_policy = log_overflow::drop;
+    std::thread                        drain_thread;
+    std::mutex                         async_mtx;
+    std::atomic<bool>                  async_enabled  = false;
+    std::atomic<bool>                  drain_running  = false;
+    std::atomic<bool>                  drain_sleeping = false;
+    std::atomic<u32>                   wake_seq       = 0;
+    std::atomic<size_t>                pushing        = 0;
+    std::atomic<uint64_t>              pushed         = 0;
+    std::atomic<uint64_t>              written        = 0;
+    std::atomic<uint64_t>              dropped        = 0;
+    std::atomic<u32>                   text_streams   = 0;
+    std::atomic<u32>                   binary_streams = 0;
 };
 
 /* Global logger */
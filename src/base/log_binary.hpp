@@ -0,0 +1,203 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "print.hpp"
+#include "serialization.hpp"
+#include "tsc.hpp"
+
+namespace dfdh
+{
+/* Binary log file: a header and entries. An entry is a format definition, written at the first
+ * use of a format string, or a record, which refers to the format by id and keeps the arguments
+ * as tagged raw bytes. The texts are rendered offline by tools/log_decoder */
+inline constexpr u32 binlog_magic   = 0x4c424644; // DFBL
+inline constexpr u32 binlog_version = 1;
+
+enum class binlog_entry : u8 { format = 0, record };
+enum class binlog_arg : u8 { int64 = 0, uint64, float32, float64, boolean, character, string };
+
+struct binlog_header {
+    u32        magic   = binlog_magic;
+    u32        version = binlog_version;
+    tsc_anchor anchor;
+
+    SS_SERIALIZE(magic, version, anchor.tsc, anchor.system_ns, anchor.frequency)
+};
+
+struct binlog_record {
+    u8                                    level     = 0;
+    u16                                   update_id = 0;
+    std::chrono::system_clock::time_point time;
+    std::string                           msg;
+};
+
+/* Serializer backend for the records: appends to the reused storage without zero filling */
+struct binlog_buffer {
+    void write(const char* ptr, size_t count) {
+        if (size + count > storage.size())
+            storage.resize(std::max(storage.size() * 2, size + count));
+        std::memcpy(storage.data() + size, ptr, count);
+        size += count;
+    }
+
+    [[nodiscard]]
+    std::span<const char> data() const {
+        return {storage.data(), size};
+    }
+
+    void clear() {
+        size = 0;
+    }
+
+    std::vector<char> storage;
+    size_t            size = 0;
+};
+
+namespace details {
+    template <typename S, typename T>
+    void binlog_write_arg(S& s, const T& value) {
+        if constexpr (std::is_same_v<T, bool>)
+            s.write(u8(binlog_arg::boolean), value);
+        else if constexpr (AnyOfType<T, char, signed char, unsigned char>)
+            s.write(u8(binlog_arg::character), char(value));
+        else if constexpr (std::is_floating_point_v<T> && sizeof(T) == sizeof(float))
+            s.write(u8(binlog_arg::float32), value);
+        else if constexpr (std::is_floating_point_v<T>)
+            s.write(u8(binlog_arg::float64), double(value));
+        else if constexpr (Integral<T> && std::is_signed_v<T>)
+            s.write(u8(binlog_arg::int64), i64(value));
+        else if constexpr (Integral<T>)
+            s.write(u8(binlog_arg::uint64), u64(value));
+        else if constexpr (FormatString<T>)
+            s.write(u8(binlog_arg::string), std::string_view(value));
+        else {
+            /* No binary form: printer<T>, ranges and streamable types */
+            std::string str;
+            format_value(str, value);
+            s.write(u8(binlog_arg::string), str);
+        }
+    }
+} // namespace details
+
+/* Appends the tagged arguments. Only the arguments without a binary form are formatted */
+template <typename... Ts>
+void binlog_encode_args(binlog_buffer& out, const Ts&... args) {
+    ss::serializer s{out};
+    (details::binlog_write_arg(s, args), ...);
+}
+
+/* Appends the record entry */
+template <typename... Ts>
+void binlog_encode(binlog_buffer& out, u8 level, u16 update_id, u64 format_id, u64 tsc, const Ts&... args) {
+    ss::serializer s{out};
+    s.write(u8(binlog_entry::record), format_id, level, update_id, tsc);
+    binlog_encode_args(out, args...);
+}
+
+inline void binlog_encode_format(binlog_buffer& out, u64 format_id, std::string_view format_str) {
+    ss::serializer s{out};
+    s.write(u8(binlog_entry::format), format_id, format_str);
+}
+
+namespace details {
+    template <typename D>
+    void binlog_render_arg(std::string& out, D& ds) {
+        u8 type;
+        ds.read(type);
+
+        auto read_value = [&]<typename T>(T value) {
+            ds.read(value);
+            format_value(out, value);
+        };
+
+        switch (binlog_arg(type)) {
+        case binlog_arg::int64: read_value(i64(0)); break;
+        case binlog_arg::uint64: read_value(u64(0)); break;
+        case binlog_arg::float32: read_value(0.f); break;
+        case binlog_arg::float64: read_value(0.0); break;
+        case binlog_arg::boolean: read_value(false); break;
+        case binlog_arg::character: read_value('\0'); break;
+        case binlog_arg::string: read_value(std::string()); break;
+        default: throw std::runtime_error("binlog: unknown argument type " + std::to_string(unsigned(type)));
+        }
+    }
+} // namespace details
+
+/* Appends the format with the arguments of binlog_encode_args() read from ds: the same text as format() gives */
+template <typename D>
+void binlog_render(std::string& out, std::string_view format_str, D& ds) {
+    for (size_t i = 0; i < format_str.size(); ++i) {
+        if (format_str[i] != '{') {
+            out += format_str[i];
+            continue;
+        }
+        i = format_str.find('}', i);
+        if (i == std::string_view::npos)
+            throw std::runtime_error("binlog: unclosed placeholder in the format");
+        details::binlog_render_arg(out, ds);
+    }
+}
+
+/* Renders the records of a binary log to the same texts as format() does */
+class binlog_reader {
+public:
+    binlog_reader(std::span<const char> data): ds(data) {
+        ds.read(_header);
+        if (_header.magic != binlog_magic)
+            throw std::runtime_error("binlog: invalid magic");
+        if (_header.version != binlog_version)
+            throw std::runtime_error("binlog: unsupported version " + std::to_string(_header.version));
+    }
+
+    /* Returns the next record, the format definitions are consumed on the way */
+    std::optional<binlog_record> next() {
+        while (ds.available()) {
+            u8 entry;
+            ds.read(entry);
+
+            if (entry == u8(binlog_entry::format)) {
+                u64         id;
+                std::string format_str;
+                ds.read(id, format_str);
+                formats.insert_or_assign(id, std::move(format_str));
+                continue;
+            }
+            if (entry != u8(binlog_entry::record))
+                throw std::runtime_error("binlog: unknown entry " + std::to_string(unsigned(entry)));
+
+            binlog_record rec;
+            u64           id;
+            u64           tsc;
+            ds.read(id, rec.level, rec.update_id, tsc);
+            rec.time = _header.anchor.to_system(tsc);
+
+            auto found = formats.find(id);
+            if (found == formats.end())
+                throw std::runtime_error("binlog: record refers to an undefined format");
+            binlog_render(rec.msg, found->second, ds);
+
+            return rec;
+        }
+        return {};
+    }
+
+    [[nodiscard]]
+    const binlog_header& header() const {
+        return _header;
+    }
+
+private:
+    using deserializer_t = decltype(ss::deserializer{std::declval<const std::span<const char>&>()});
+
+    deserializer_t                       ds;
+    binlog_header                        _header;
+    std::unordered_map<u64, std::string> formats;
+};
+} // namespace dfdh
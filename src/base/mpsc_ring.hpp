@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+
+#include "types.hpp"
+
+namespace dfdh {
+
+/* Bounded lock-free queue for many producers and one consumer.
+ * Every slot has a sequence number: pos means free for the push at pos, pos + 1 means filled */
+template <typename T>
+class mpsc_ring {
+public:
+    mpsc_ring(size_t capacity):
+        _mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1), _slots(std::make_unique<slot[]>(_mask + 1)) {
+        for (size_t i = 0; i <= _mask; ++i) _slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    /* Returns false if the queue is full */
+    bool try_push(T&& value) {
+        auto pos = _tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& s    = _slots[pos & _mask];
+            auto  seq  = s.seq.load(std::memory_order_acquire);
+            auto  diff = ssize_t(seq - pos);
+
+            if (diff == 0) {
+                if (_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    s.value = std::move(value);
+                    s.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0) {
+                return false;
+            }
+            else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /* Must be called from the consumer thread only */
+    bool try_pop(T& value) {
+        auto& s = _slots[_head & _mask];
+        if (s.seq.load(std::memory_order_acquire) != _head + 1)
+            return false;
+
+        value = std::move(s.value);
+        s.seq.store(_head + _mask + 1, std::memory_order_release);
+        ++_head;
+        return true;
+    }
+
+    [[nodiscard]]
+    size_t capacity() const {
+        return _mask + 1;
+    }
+
+private:
+    struct slot {
+        std::atomic<size_t> seq;
+        T                   value;
+    };
+
+    size_t                   _mask;
+    std::unique_ptr<slot[]>  _slots;
+    alignas(64) std::atomic<size_t> _tail = 0;
+    alignas(64) size_t              _head = 0;
+};
+
+} // namespace dfdh
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <vector>
+
+#include "types.hpp"
+
+namespace dfdh
+{
+
+/* Open-addressing hash index with linear probing and backward shift deletion.
+ * Slot must have the u64 hash member, hash 0 marks an empty slot (see slot_hash()).
+ * Keys are compared by the predicate passed to find() and erase(), so slots may only refer to them */
+template <typename Slot>
+class open_index {
+public:
+    static constexpr size_t min_capacity = 8;
+
+    static constexpr u64 slot_hash(u64 hash) {
+        return hash ? hash : 1;
+    }
+
+    template <typename F>
+    [[nodiscard]]
+    const Slot* find(u64 hash, F&& key_equal) const {
+        if (_size == 0)
+            return nullptr;
+
+        hash = slot_hash(hash);
+        for (auto i = size_t(hash) & mask();; i = (i + 1) & mask()) {
+            auto& slot = _slots[i];
+            if (slot.hash == 0)
+                return nullptr;
+            if (slot.hash == hash && key_equal(slot))
+                return &slot;
+        }
+    }
+
+    template <typename F>
+    [[nodiscard]]
+    Slot* find(u64 hash, F&& key_equal) {
+        return const_cast<Slot*>(static_cast<const open_index&>(*this).find(hash, key_equal));
+    }
+
+    /* Does not check for duplicates */
+    void insert(Slot slot) {
+        if ((_size + 1) * 2 > _slots.size())
+            rehash(_slots.empty() ? min_capacity : _slots.size() * 2);
+
+        slot.hash = slot_hash(slot.hash);
+        place(slot);
+        ++_size;
+    }
+
+    template <typename F>
+    bool erase(u64 hash, F&& key_equal) {
+        auto found = find(hash, key_equal);
+        if (!found)
+            return false;
+
+        auto i = size_t(found - _slots.data());
+        for (auto j = (i + 1) & mask(); _slots[j].hash != 0; j = (j + 1) & mask()) {
+            /* Move the slot back if its ideal position is not in (i, j] */
+            auto ideal = size_t(_slots[j].hash) & mask();
+            if (i <= j ? (ideal <= i || ideal > j) : (ideal <= i && ideal > j)) {
+                _slots[i] = _slots[j];
+                i         = j;
+            }
+        }
+
+        _slots[i] = Slot{};
+        --_size;
+        return true;
+    }
+
+    void clear() {
+        _slots.clear();
+        _size = 0;
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        return _size;
+    }
+
+private:
+    [[nodiscard]]
+    size_t mask() const {
+        return _slots.size() - 1;
+    }
+
+    void place(const Slot& slot) {
+        auto i = size_t(slot.hash) & mask();
+        while (_slots[i].hash != 0) i = (i + 1) & mask();
+        _slots[i] = slot;
+    }
+
+    void rehash(size_t capacity) {
+        auto old = std::move(_slots);
+        _slots.assign(capacity, Slot{});
+        for (auto& slot : old)
+            if (slot.hash != 0)
+                place(slot);
+    }
+
+private:
+    std::vector<Slot> _slots;
+    size_t            _size = 0;
+};
+
+} // namespace dfdh
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+
+#include "types.hpp"
+
+namespace dfdh {
+
+/* Counters for the performance overlay. The subsystems store them with relaxed atomics
+ * from their own threads, the overlay copies them once per frame: no locks on either side */
+class perf_counters_singleton {
+public:
+    static perf_counters_singleton& instance() {
+        static perf_counters_singleton inst;
+        return inst;
+    }
+
+    perf_counters_singleton(const perf_counters_singleton&)            = delete;
+    perf_counters_singleton& operator=(const perf_counters_singleton&) = delete;
+
+    struct snapshot_t {
+        u32 physic_primitives  = 0;
+        u32 physic_pairs       = 0;
+        u32 bullets            = 0;
+        u32 ai_operators       = 0;
+        u32 ai_busy_permille   = 0;
+        u32 ai_snapshot_age_us = 0;
+        u32 ai_publish_us      = 0;
+        u32 sound_voices       = 0;
+        u32 sound_max_voices   = 0;
+        u64 allocations        = 0;
+        u64 allocated_bytes    = 0;
+    };
+
+    /* Publishing of the counters which are not free to collect is skipped while nobody reads them */
+    [[nodiscard]]
+    bool enabled() const {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    void enable(bool value) {
+        _enabled.store(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    snapshot_t snapshot() const {
+        return {
+            .physic_primitives  = physic_primitives.load(std::memory_order_relaxed),
+            .physic_pairs       = physic_pairs.load(std::memory_order_relaxed),
+            .bullets            = bullets.load(std::memory_order_relaxed),
+            .ai_operators       = ai_operators.load(std::memory_order_relaxed),
+            .ai_busy_permille   = ai_busy_permille.load(std::memory_order_relaxed),
+            .ai_snapshot_age_us = ai_snapshot_age_us.load(std::memory_order_relaxed),
+            .ai_publish_us      = ai_publish_us.load(std::memory_order_relaxed),
+            .sound_voices       = sound_voices.load(std::memory_order_relaxed),
+            .sound_max_voices   = sound_max_voices.load(std::memory_order_relaxed),
+            .allocations        = allocations.load(std::memory_order_relaxed),
+            .allocated_bytes    = allocated_bytes.load(std::memory_order_relaxed),
+        };
+    }
+
+    static void set(std::atomic<u32>& counter, size_t value) {
+        counter.store(u32(value), std::memory_order_relaxed);
+    }
+
+    std::atomic<u32> physic_primitives  = 0;
+    std::atomic<u32> physic_pairs       = 0; /* narrow phase tests in the last tick */
+    std::atomic<u32> bullets            = 0;
+    std::atomic<u32> ai_operators       = 0;
+    std::atomic<u32> ai_busy_permille   = 0; /* worker time spent out of the sleep */
+    std::atomic<u32> ai_snapshot_age_us = 0; /* world snapshot age when the worker takes it */
+    std::atomic<u32> ai_publish_us      = 0; /* game thread time spent on the ai world data */
+    std::atomic<u32> sound_voices       = 0;
+    std::atomic<u32> sound_max_voices   = 0;
+    std::atomic<u64> allocations        = 0; /* per frame, while the allocation tracking is on */
+    std::atomic<u64> allocated_bytes    = 0;
+
+private:
+    perf_counters_singleton() = default;
+
+    std::atomic<bool> _enabled = false;
+};
+
+inline perf_counters_singleton& perf_counters() {
+    return perf_counters_singleton::instance();
+}
+
+} // namespace dfdh
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "types.hpp"
+
+namespace dfdh {
+
+enum class hw_counter : u8 { cycles = 0, instructions, l1d_misses, llc_misses, branch_misses, count };
+
+inline constexpr size_t hw_counters_count = size_t(hw_counter::count);
+
+using hw_values = std::array<u64, hw_counters_count>;
+
+inline constexpr const char* hw_counter_name(hw_counter counter) {
+    constexpr const char* names[] = {"cycles", "instructions", "l1d misses", "llc misses", "branch misses"};
+    return names[size_t(counter)];
+}
+
+/* Hardware counters of the calling thread in one perf_event_open group, read at once.
+ * The counters which the cpu or the hypervisor does not provide are skipped,
+ * if none is opened (perf_event_paranoid, no PMU in a VM) the group is not available */
+class perf_event_group {
+public:
+    perf_event_group() {
+        _fds.fill(-1);
+        _slots.fill(-1);
+
+        for (size_t i = 0; i < hw_counters_count; ++i) {
+            auto fd = open_counter(hw_counter(i), _leader);
+            if (fd < 0) {
+                if (_error.empty())
+                    _error = std::string(hw_counter_name(hw_counter(i))) + ": " + std::strerror(errno);
+                continue;
+            }
+
+            if (_leader < 0)
+                _leader = fd;
+            _fds[i]   = fd;
+            _slots[i] = int(_opened++);
+        }
+
+        if (_leader >= 0) {
+            ioctl(_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    ~perf_event_group() {
+        for (auto fd : _fds)
+            if (fd >= 0)
+                ::close(fd);
+    }
+
+    perf_event_group(const perf_event_group&)            = delete;
+    perf_event_group& operator=(const perf_event_group&) = delete;
+
+    [[nodiscard]]
+    bool available() const {
+        return _leader >= 0;
+    }
+
+    [[nodiscard]]
+    bool has(hw_counter counter) const {
+        return _slots[size_t(counter)] >= 0;
+    }
+
+    /* The first failure: empty if all counters are opened */
+    [[nodiscard]]
+    const std::string& error() const {
+        return _error;
+    }
+
+    /* Current values, zeros for the missing counters. One read syscall */
+    [[nodiscard]]
+    hw_values read() const {
+        hw_values res = {};
+        if (_leader < 0)
+            return res;
+
+        /* PERF_FORMAT_GROUP layout: nr, values[nr] */
+        std::array<u64, hw_counters_count + 1> buf;
+        if (::read(_leader, buf.data(), sizeof(buf)) < ssize_t(sizeof(u64) * (_opened + 1)))
+            return res;
+
+        for (size_t i = 0; i < hw_counters_count; ++i)
+            if (_slots[i] >= 0)
+                res[i] = buf[size_t(_slots[i]) + 1];
+        return res;
+    }
+
+private:
+    static int open_counter(hw_counter counter, int group_fd) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.disabled       = group_fd < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.read_format    = PERF_FORMAT_GROUP;
+
+        constexpr auto cache_miss = [](u64 cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        };
+
+        switch (counter) {
+        case hw_counter::cycles:
+            attr.type   = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case hw_counter::instructions:
+            attr.type   = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case hw_counter::l1d_misses:
+            attr.type   = PERF_TYPE_HW_CACHE;
+            attr.config = cache_miss(PERF_COUNT_HW_CACHE_L1D);
+            break;
+        case hw_counter::llc_misses:
+            attr.type   = PERF_TYPE_HW_CACHE;
+            attr.config = cache_miss(PERF_COUNT_HW_CACHE_LL);
+            break;
+        case hw_counter::branch_misses:
+            attr.type   = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case hw_counter::count: return -1;
+        }
+
+        /* This thread on any cpu */
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+    }
+
+private:
+    std::array<int, hw_counters_count> _fds;
+    std::array<int, hw_counters_count> _slots;
+    int                                _leader = -1;
+    size_t                             _opened = 0;
+    std::string                        _error;
+};
+
+} // namespace dfdh
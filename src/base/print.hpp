@@ -1,12 +1,17 @@
 #pragma once
 
+#include <array>
+#include <charconv>
 #include <iostream>
 #include <sstream>
 #include <tuple>
 #include <optional>
 #include <chrono>
+#include <string>
+#include <string_view>
 
 #include "types.hpp"
+#include "hash_functions.hpp"
 
 namespace dfdh {
 
@@ -160,62 +165,132 @@ void println(const Ts&... args) {
     fprintln(std::cout, args...);
 }
 
-template <size_t I = 0, typename... Ts>
-void fprintf(std::ostream& os, std::string_view format_str, const Ts&... args) {
-    size_t fmt_start = 0;
-    size_t fmt_size  = 0;
-    bool on_fmt = false;
-
-    for (size_t i = 0; i < format_str.size(); ++i) {
-        auto c = format_str[i];
-
-        if (on_fmt) {
-            if (c == '}') {
-                // TODO: formats
-                //auto fmt = format_str.substr(fmt_start, fmt_size);
-                on_fmt = false;
-                if constexpr (I < sizeof...(Ts)) {
-                    print_any(os, std::get<I>(std::tuple<const Ts&...>(args...)));
-                    fprintf<I + 1>(os, format_str.substr(fmt_start + fmt_size + 1), args...);
-                    return;
-                }
-            } else
-                ++fmt_size;
-        } else {
-            if (c == '{') {
-                on_fmt = true;
-                fmt_start = i + 1;
-                fmt_size = 0;
-            } else  {
-                os << c;
-            }
+namespace details {
+    /* Not constexpr: a call from the consteval constructor below is a compile error */
+    inline void format_placeholders_count_mismatch() {}
+    inline void format_unclosed_placeholder() {}
+
+    template <typename T>
+    concept FormatString = std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view> ||
+                           AnyOfType<std::decay_t<T>, const char*, char*>;
+
+    template <typename T>
+    void format_value(std::string& out, const T& value) {
+        if constexpr (std::is_same_v<T, bool>)
+            out += value ? "true" : "false";
+        else if constexpr (AnyOfType<T, char, signed char, unsigned char>)
+            out += char(value);
+        else if constexpr (Number<T>) {
+            char buf[64];
+            std::to_chars_result res;
+            /* %g with precision 6, like the default std::ostream output */
+            if constexpr (std::is_floating_point_v<T>)
+                res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::general, 6);
+            else
+                res = std::to_chars(buf, buf + sizeof(buf), value);
+            out.append(buf, res.ptr);
+        }
+        else if constexpr (FormatString<T>)
+            out += std::string_view(value);
+        else {
+            std::ostringstream ss;
+            print_any(ss, value);
+            out += ss.view();
         }
     }
+} // namespace details
+
+/* Format string parsed at compile time: positions of the N placeholders are found once
+ * and a format string with other count of placeholders does not compile */
+template <size_t N>
+class format_spec {
+public:
+    template <typename S> requires std::convertible_to<const S&, std::string_view>
+    consteval format_spec(const S& str): _str(str), _hash(fnv1a64(_str)) {
+        size_t count = 0;
+        for (size_t i = 0; i < _str.size(); ++i) {
+            if (_str[i] != '{')
+                continue;
+
+            auto end = _str.find('}', i);
+            if (end == std::string_view::npos)
+                details::format_unclosed_placeholder();
+            if (count == N)
+                details::format_placeholders_count_mismatch();
+
+            // TODO: formats between the braces
+            _marks[count++] = {i, end + 1};
+            i = end;
+        }
+        if (count != N)
+            details::format_placeholders_count_mismatch();
+    }
+
+    [[nodiscard]]
+    constexpr std::string_view str() const {
+        return _str;
+    }
+
+    /* Identifies the format string in the binary logs */
+    [[nodiscard]]
+    constexpr u64 hash() const {
+        return _hash;
+    }
+
+    /* The text before the I-th placeholder, I == N is the tail */
+    [[nodiscard]]
+    constexpr std::string_view literal(size_t i) const {
+        auto b = i == 0 ? 0 : _marks[i - 1].second;
+        auto e = i == N ? _str.size() : _marks[i].first;
+        return _str.substr(b, e - b);
+    }
+
+private:
+    std::string_view                         _str;
+    u64                                      _hash;
+    std::array<std::pair<size_t, size_t>, N> _marks = {};
+};
+
+template <typename... Ts>
+using format_string = format_spec<sizeof...(Ts)>;
+
+/* Appends to out, so the same string may be reused without allocations */
+template <typename... Ts>
+void format_into(std::string& out, format_string<Ts...> format_str, const Ts&... args) {
+    [&]<size_t... Is>(std::index_sequence<Is...>) {
+        ((out += format_str.literal(Is), details::format_value(out, args)), ...);
+    }(std::index_sequence_for<Ts...>());
+    out += format_str.literal(sizeof...(Ts));
+}
+
+template <typename... Ts>
+std::string format(format_string<Ts...> format_str, const Ts&... args) {
+    std::string res;
+    format_into(res, format_str, args...);
+    return res;
 }
 
 template <typename... Ts>
-void printf(std::string_view format_str, const Ts&... args) {
+void fprintf(std::ostream& os, format_string<Ts...> format_str, const Ts&... args) {
+    os << format(format_str, args...);
+}
+
+template <typename... Ts>
+void printf(format_string<Ts...> format_str, const Ts&... args) {
     fprintf(std::cout, format_str, args...);
 }
 
 template <typename... Ts>
-void fprintfln(std::ostream& os, std::string_view format_str, const Ts&... args) {
+void fprintfln(std::ostream& os, format_string<Ts...> format_str, const Ts&... args) {
     fprintf(os, format_str, args...);
     os << std::endl;
 }
 
 template <typename... Ts>
-void printfln(std::string_view format_str, const Ts&... args) {
+void printfln(format_string<Ts...> format_str, const Ts&... args) {
     fprintfln(std::cout, format_str, args...);
 }
 
-template <typename... Ts>
-std::string format(std::string_view format, const Ts&... args) {
-    std::stringstream ss;
-    fprintf(ss, format, args...);
-    return ss.str();
-}
-
 template <typename Rep, typename Period>
 struct printer<std::chrono::duration<Rep, Period>> {
     inline static std::string nanotime_str(std::chrono::nanoseconds time_nano) {
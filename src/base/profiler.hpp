@@ -1,103 +1,339 @@
 #pragma once
 
-#include <map>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
-#include <x86intrin.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string_view>
+#include <vector>
 
 #include "types.hpp"
+#include "histogram.hpp"
+#include "io.hpp"
+#include "perf_events.hpp"
 #include "print.hpp"
+#include "trace.hpp"
+#include "tsc.hpp"
+
+/* Interns the scope name once per call site, the expression is the scope id */
+#define DFDH_PROF_ID(NAME)                                                                                             \
+    [] {                                                                                                               \
+        static const auto id = ::dfdh::profiler::intern(NAME);                                                         \
+        return id;                                                                                                     \
+    }()
+
+#define DFDH_PROF_CONCAT_IMPL(A, B) A##B
+#define DFDH_PROF_CONCAT(A, B)      DFDH_PROF_CONCAT_IMPL(A, B)
+
+/* Measures the rest of the enclosing block: DFDH_PROF_SCOPE(prof, "name"[, increment_counter]) */
+#define DFDH_PROF_SCOPE(PROF, NAME, ...)                                                                               \
+    auto DFDH_PROF_CONCAT(dfdh_prof_scope_, __LINE__) = (PROF).scope(DFDH_PROF_ID(NAME) __VA_OPT__(, ) __VA_ARGS__)
+
+/* Records the rest of the enclosing block into the trace only */
+#define DFDH_TRACE_SCOPE(NAME)                                                                                         \
+    ::dfdh::trace_scope DFDH_PROF_CONCAT(dfdh_trace_scope_, __LINE__)(DFDH_PROF_ID(NAME).value)
 
 namespace dfdh {
 using namespace std::chrono_literals;
 
-inline uint64_t rdtsc() {
-    return __rdtsc();
-}
+struct profiler_scope_id {
+    u32 value;
+};
 
+/* Measures are stored in a flat array indexed by the interned scope ids and timed with the tsc.
+ * A profiler must be used from one thread, the names registry is shared.
+ * A named profiler also keeps a histogram per measure and publishes its percentiles
+ * every window period, see update_window() and profiler::windows().
+ * With profiler::hw_counters(true) the named profilers also read the hardware counters
+ * of their threads around the scopes (one read syscall per scope boundary) */
 class profiler {
 public:
     struct time_data {
-        std::chrono::steady_clock::time_point start;
-        std::chrono::steady_clock::duration   last_min_dur = 24h;
-        std::chrono::steady_clock::duration   last_max_dur = 0s;
-        std::chrono::steady_clock::duration   dur_sum      = 0s;
-        u64                                   count        = 0;
+        u64  min_ticks = std::numeric_limits<u64>::max();
+        u64  max_ticks = 0;
+        u64  sum_ticks = 0;
+        u64  count     = 0;
+        u64  pending   = 0; /* ticks of the not counted parts of the current sample */
+        u64  last      = 0; /* ticks of the last counted sample with its not counted parts */
+        bool used      = false;
 
         friend std::ostream& operator<<(std::ostream& os, const time_data& time) {
-            fprint(os, time.last_min_dur, '|', time.last_max_dur, '|', time.dur_sum / (time.count ? time.count : 1));
+            fprint(os,
+                   ticks_to_duration(time.count ? time.min_ticks : 0),
+                   '|',
+                   ticks_to_duration(time.max_ticks),
+                   '|',
+                   ticks_to_duration(time.sum_ticks / (time.count ? time.count : 1)));
             return os;
         }
     };
 
     struct profiler_scope {
-        profiler_scope(std::string measure_name, profiler& prof_instance, bool increment_counter = true):
-            name(std::move(measure_name)), prof(prof_instance), increment(increment_counter) {
-            prof.start(name);
-        }
+        profiler_scope(profiler& prof_instance, profiler_scope_id scope_id, bool increment_counter = true):
+            prof(prof_instance),
+            id(scope_id),
+            increment(increment_counter),
+            hw(prof_instance.hw_group()),
+            hw_start(hw ? hw->read() : hw_values{}),
+            start(tsc_now()) {}
 
         ~profiler_scope() {
-            prof.end(name, increment);
+            auto end = tsc_now();
+            if (hw)
+                prof.end_hw(id, hw->read(), hw_start);
+            prof.end(id, end - start, increment);
+            trace_recorder::record(id.value, start, end);
         }
 
-        std::string name;
-        profiler&   prof;
-        bool        increment;
+        profiler_scope(const profiler_scope&) = delete;
+        profiler_scope& operator=(const profiler_scope&) = delete;
+
+        profiler&         prof;
+        profiler_scope_id id;
+        bool              increment;
+        perf_event_group* hw;
+        hw_values         hw_start;
+        u64               start;
     };
 
-    void start(const std::string& measure_name) {
-        measures[measure_name].start = std::chrono::steady_clock::now();
-    }
-
-    void end(const std::string& measure_name, bool increment_counter) {
-        auto found = measures.find(measure_name);
-        if (found != measures.end()) {
-            auto& cur = found->second;
-            auto  dur = std::chrono::steady_clock::now() - found->second.start;
-            cur.dur_sum += dur;
-            if (increment_counter) {
-                ++cur.count;
-                if (dur > cur.last_max_dur)
-                    cur.last_max_dur = dur;
-                if (dur < cur.last_min_dur)
-                    cur.last_min_dur = dur;
+    /* Percentiles of a measure over the last window */
+    struct window_stats {
+        std::string              scope;
+        u64                      count = 0;
+        std::chrono::nanoseconds p50   = {};
+        std::chrono::nanoseconds p90   = {};
+        std::chrono::nanoseconds p99   = {};
+        std::chrono::nanoseconds p999  = {};
+        std::chrono::nanoseconds max   = {};
+
+        /* Hardware counters per sample, if they were on during the window */
+        bool   hw            = false;
+        double ipc           = 0.0;
+        double l1d_misses    = 0.0;
+        double llc_misses    = 0.0;
+        double branch_misses = 0.0;
+    };
+
+    using histogram_t = log_histogram<>;
+
+    profiler(std::string profiler_name = {}): _name(std::move(profiler_name)) {
+        /* Calibrates the counter before the first measure */
+        tsc_frequency();
+    }
+
+    static profiler_scope_id intern(std::string_view name) {
+        auto& reg = registry();
+        std::lock_guard lock{reg.mtx};
+        auto [pos, inserted] = reg.ids.emplace(name, u32(reg.names.size()));
+        if (inserted)
+            reg.names.push_back(&pos->first);
+        return {pos->second};
+    }
+
+    static std::string_view name(profiler_scope_id id) {
+        auto& reg = registry();
+        std::lock_guard lock{reg.mtx};
+        return *reg.names.at(id.value);
+    }
+
+    static std::chrono::nanoseconds ticks_to_duration(u64 ticks) {
+        return std::chrono::nanoseconds(i64(double(ticks) * 1e9 / tsc_frequency()));
+    }
+
+    /* Writes the trace of the last duration in the Chrome Trace Event format */
+    static void write_trace(const std::string& path, std::chrono::nanoseconds duration) {
+        auto json = trace_recorder::chrome_json(trace_recorder::instance().snapshot(duration),
+                                                [](u32 id) { return name({id}); });
+        auto ofd  = outfd<char>(path);
+        ofd.write(json.data(), json.size());
+    }
+
+    void end(profiler_scope_id id, u64 ticks, bool increment_counter) {
+        if (id.value >= measures.size())
+            measures.resize(id.value + 1);
+
+        auto& cur = measures[id.value];
+        cur.used = true;
+        cur.sum_ticks += ticks;
+        if (increment_counter) {
+            ++cur.count;
+            cur.max_ticks = std::max(cur.max_ticks, ticks);
+            cur.min_ticks = std::min(cur.min_ticks, ticks);
+
+            cur.last    = cur.pending + ticks;
+            cur.pending = 0;
+            if (!_name.empty()) {
+                if (id.value >= hists.size())
+                    hists.resize(id.value + 1);
+                hists[id.value].add(cur.last);
             }
         }
+        else {
+            cur.pending += ticks;
+        }
+    }
+
+    void end_hw(profiler_scope_id id, const hw_values& now, const hw_values& start) {
+        if (id.value >= hw_sums.size())
+            hw_sums.resize(id.value + 1);
+        for (size_t i = 0; i < hw_counters_count; ++i) hw_sums[id.value][i] += now[i] - start[i];
+    }
+
+    /* Turns the hardware counters on or off for all named profilers.
+     * Every profiler opens its counters at the first scope on its thread */
+    static void hw_counters(bool enable) {
+        hw_requested().store(enable, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    static bool hw_counters() {
+        return hw_requested().load(std::memory_order_relaxed);
     }
 
-    profiler_scope scope(const std::string& measure_name, bool increment_counter = true) {
-        return {measure_name, *this, increment_counter};
+    template <typename Rep, typename Period>
+    void set_window_period(const std::chrono::duration<Rep, Period>& period) {
+        window_period = std::chrono::duration_cast<decltype(window_period)>(period);
+    }
+
+    /* Publishes the percentiles and starts a new window if the window period passed.
+     * Call it once per frame or tick from the profiler thread */
+    void update_window() {
+        auto now = std::chrono::steady_clock::now();
+        if (_name.empty() || now - window_start < window_period)
+            return;
+        window_start = now;
+
+        std::vector<window_stats> stats;
+        for (u32 i = 0; i < u32(hists.size()); ++i) {
+            auto& hist = hists[i];
+            if (hist.count() == 0)
+                continue;
+
+            auto& st = stats.emplace_back(window_stats{std::string(name({i})),
+                                                       hist.count(),
+                                                       ticks_to_duration(hist.percentile(0.5)),
+                                                       ticks_to_duration(hist.percentile(0.9)),
+                                                       ticks_to_duration(hist.percentile(0.99)),
+                                                       ticks_to_duration(hist.percentile(0.999)),
+                                                       ticks_to_duration(hist.max())});
+
+            if (i < hw_sums.size() && hw_sums[i] != hw_values{}) {
+                auto& hw_sum = hw_sums[i];
+                auto  per_sample = [&](hw_counter counter) {
+                    return double(hw_sum[size_t(counter)]) / double(hist.count());
+                };
+
+                st.hw            = true;
+                st.ipc           = hw_sum[size_t(hw_counter::cycles)]
+                                       ? double(hw_sum[size_t(hw_counter::instructions)]) /
+                                             double(hw_sum[size_t(hw_counter::cycles)])
+                                       : 0.0;
+                st.l1d_misses    = per_sample(hw_counter::l1d_misses);
+                st.llc_misses    = per_sample(hw_counter::llc_misses);
+                st.branch_misses = per_sample(hw_counter::branch_misses);
+                hw_sum           = {};
+            }
+            hist.clear();
+        }
+        std::ranges::sort(stats, {}, &window_stats::scope);
+
+        auto& reg = registry();
+        std::lock_guard lock{reg.mtx};
+        reg.windows.insert_or_assign(_name, std::move(stats));
+    }
+
+    /* Last published windows of all named profilers */
+    static std::map<std::string, std::vector<window_stats>> windows() {
+        auto& reg = registry();
+        std::lock_guard lock{reg.mtx};
+        return reg.windows;
+    }
+
+    /* profiler,scope,count,p50_us,p90_us,p99_us,p99.9_us,max_us,ipc,l1d_misses,llc_misses,branch_misses
+     * The hardware columns are per sample and empty if the counters were off */
+    static void write_windows_csv(std::ostream& os) {
+        auto us = [](std::chrono::nanoseconds dur) {
+            return double(dur.count()) / 1000.0;
+        };
+
+        fprintfln(os, "profiler,scope,count,p50_us,p90_us,p99_us,p99.9_us,max_us,ipc,l1d_misses,llc_misses,branch_misses");
+        for (auto& [prof_name, stats] : windows()) {
+            for (auto& st : stats) {
+                fprintf(os,
+                        "{},{},{},{},{},{},{},{},",
+                        prof_name,
+                        st.scope,
+                        st.count,
+                        us(st.p50),
+                        us(st.p90),
+                        us(st.p99),
+                        us(st.p999),
+                        us(st.max));
+                if (st.hw)
+                    fprintfln(os, "{},{},{},{}", st.ipc, st.l1d_misses, st.llc_misses, st.branch_misses);
+                else
+                    fprintfln(os, ",,,");
+            }
+        }
+    }
+
+    [[nodiscard]]
+    const std::string& profiler_name() const {
+        return _name;
+    }
+
+    profiler_scope scope(profiler_scope_id id, bool increment_counter = true) {
+        return {*this, id, increment_counter};
+    }
+
+    /* Interns the name on every call, use DFDH_PROF_SCOPE or a stored id on hot paths */
+    profiler_scope scope(std::string_view measure_name, bool increment_counter = true) {
+        return {*this, intern(measure_name), increment_counter};
     }
 
     friend std::ostream& operator<<(std::ostream& os, const profiler& prof) {
+        auto sorted = prof.sorted_measures();
+
         if (prof.short_print_format()) {
-            auto sum = 0.f;
-            for (auto& [_, time] : prof.measures)
-                sum +=
-                    std::chrono::duration_cast<std::chrono::duration<float>>(time.dur_sum).count() / float(time.count);
+            auto avg = [](const time_data& time) {
+                return double(time.sum_ticks) / double(time.count);
+            };
+
+            auto sum = 0.0;
+            for (auto& [_, time] : sorted) sum += avg(*time);
 
             print_any(os, '{');
-            for (auto i = prof.measures.begin(); i != prof.measures.end();) {
+            for (auto i = sorted.begin(); i != sorted.end();) {
                 print_any(os, '{');
 
                 print_any(os, i->first);
                 print_any(os, ", ");
-                auto t = 100.f *
-                         (std::chrono::duration_cast<std::chrono::duration<float>>(i->second.dur_sum) /
-                          float(i->second.count))
-                             .count() /
-                         sum;
                 char st[32];
-                sprintf(st, "%05.2f%%", t);
+                snprintf(st, sizeof(st), "%05.2f%%", 100.0 * avg(*i->second) / sum);
                 print_any(os, st);
 
                 auto next = std::next(i);
-                print_any(os, next == prof.measures.end() ? "}" : "}, ");
+                print_any(os, next == sorted.end() ? "}" : "}, ");
                 i = next;
             }
             print_any(os, '}');
         }
         else {
-            print_any(os, prof.measures);
+            print_any(os, '{');
+            for (auto i = sorted.begin(); i != sorted.end();) {
+                print_any(os, '{');
+                print_any(os, i->first);
+                print_any(os, ", ");
+                print_any(os, *i->second);
+                auto next = std::next(i);
+                print_any(os, next == sorted.end() ? "}" : "}, ");
+                i = next;
+            }
+            print_any(os, '}');
         }
         return os;
     }
@@ -126,12 +362,12 @@ public:
     }
 
     void reset() {
-        for (auto& [_, time] : measures) {
-            time.count        = 0;
-            time.dur_sum      = 0s;
-            time.last_min_dur = 24h;
-            time.last_max_dur = 0s;
-        }
+        for (auto& time : measures) time = {.used = time.used};
+    }
+
+    [[nodiscard]]
+    const time_data* find(profiler_scope_id id) const {
+        return id.value < measures.size() && measures[id.value].used ? &measures[id.value] : nullptr;
     }
 
     bool print_ready() {
@@ -152,7 +388,61 @@ public:
     }
 
 private:
-    std::map<std::string, time_data> measures;
+    struct registry_t {
+        std::map<std::string, u32, std::less<>>          ids;
+        std::vector<const std::string*>                  names;
+        std::map<std::string, std::vector<window_stats>> windows;
+        std::mutex                                       mtx;
+    };
+
+    static registry_t& registry() {
+        static registry_t reg;
+        return reg;
+    }
+
+    static std::atomic<bool>& hw_requested() {
+        static std::atomic<bool> requested = false;
+        return requested;
+    }
+
+    /* Opens the counters on the first use, a failed open is not retried */
+    perf_event_group* hw_group() {
+        if (_name.empty() || hw_failed || !hw_requested().load(std::memory_order_relaxed))
+            return nullptr;
+
+        if (!hw) {
+            hw = std::make_shared<perf_event_group>();
+            if (!hw->available()) {
+                hw.reset();
+                hw_failed = true;
+                return nullptr;
+            }
+        }
+        return hw.get();
+    }
+
+    /* Used measures ordered by name */
+    [[nodiscard]]
+    std::map<std::string_view, const time_data*> sorted_measures() const {
+        std::map<std::string_view, const time_data*> res;
+        for (u32 i = 0; i < u32(measures.size()); ++i)
+            if (measures[i].used)
+                res.emplace(name({i}), &measures[i]);
+        return res;
+    }
+
+private:
+    std::string              _name;
+    std::vector<time_data>   measures;
+    std::vector<histogram_t> hists;
+    std::vector<hw_values>   hw_sums;
+
+    /* Shared by the copies, which are made for printing on the other threads */
+    std::shared_ptr<perf_event_group> hw;
+    bool                              hw_failed = false;
+
+    std::chrono::steady_clock::time_point window_start  = std::chrono::steady_clock::now();
+    std::chrono::nanoseconds              window_period = 5s;
 
     std::chrono::steady_clock::time_point last_print = std::chrono::steady_clock::now();
     std::chrono::nanoseconds              print_period = 1s;
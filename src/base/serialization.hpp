@@ -426,7 +426,7 @@ struct serializer_base {
     void write_impl(T v) {
         VERBOSE("[enum]: ", v);
         VERBOSE_IN();
-        write_impl(static_cast<std::underlying_type<T>>(v));
+        write_impl(static_cast<std::underlying_type_t<T>>(v));
         VERBOSE_OUT();
     }
 
@@ -623,7 +623,7 @@ struct deserializer_base {
         VERBOSE("[enum]");
         VERBOSE_IN();
 
-        std::underlying_type<T> res;
+        std::underlying_type_t<T> res;
         read_impl(res);
         v = static_cast<T>(res);
 
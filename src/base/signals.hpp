@@ -77,15 +77,20 @@ public:
         task_queue.push_back(std::move(task));
     }
 
+    /* Tasks are run outside the lock, so they may push new tasks */
     void operate_tasks() {
-        auto lock = std::lock_guard{mtx};
-        for (auto& task : task_queue) task();
-        task_queue.clear();
+        {
+            auto lock = std::lock_guard{mtx};
+            std::swap(task_queue, running_queue);
+        }
+        for (auto& task : running_queue) task();
+        running_queue.clear();
     }
 
 private:
     /* MPSC queue */
     std::vector<std::function<void()>> task_queue;
+    std::vector<std::function<void()>> running_queue;
     mutable std::mutex                 mtx;
 };
 
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <bit>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "types.hpp"
+
+namespace dfdh::simd
+{
+
+template <char... Cs>
+constexpr bool is_any_of(char c) {
+    return ((c == Cs) || ...);
+}
+
+namespace details
+{
+#if defined(__AVX2__)
+    static constexpr size_t block_size = 32;
+    static constexpr u32    full_mask  = 0xffffffff;
+
+    /* Bit i is set if the i-th char of the block is one of Cs */
+    template <char... Cs>
+    inline u32 match_mask(const char* p) {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto eq    = _mm256_setzero_si256();
+        ((eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(Cs)))), ...);
+        return u32(_mm256_movemask_epi8(eq));
+    }
+#elif defined(__SSE2__)
+    static constexpr size_t block_size = 16;
+    static constexpr u32    full_mask  = 0xffff;
+
+    template <char... Cs>
+    inline u32 match_mask(const char* p) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto eq    = _mm_setzero_si128();
+        ((eq = _mm_or_si128(eq, _mm_cmpeq_epi8(block, _mm_set1_epi8(Cs)))), ...);
+        return u32(_mm_movemask_epi8(eq));
+    }
+#endif
+} // namespace details
+
+/* Returns the pointer to the first char from Cs or e */
+template <char... Cs>
+const char* find_first_of(const char* b, const char* e) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; size_t(e - b) >= details::block_size; b += details::block_size)
+        if (auto mask = details::match_mask<Cs...>(b))
+            return b + std::countr_zero(mask);
+#endif
+
+    while (b != e && !is_any_of<Cs...>(*b)) ++b;
+    return b;
+}
+
+/* Returns the pointer to the first char not from Cs or e */
+template <char... Cs>
+const char* find_first_not_of(const char* b, const char* e) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; size_t(e - b) >= details::block_size; b += details::block_size)
+        if (auto mask = ~details::match_mask<Cs...>(b) & details::full_mask)
+            return b + std::countr_zero(mask);
+#endif
+
+    while (b != e && is_any_of<Cs...>(*b)) ++b;
+    return b;
+}
+
+} // namespace dfdh::simd
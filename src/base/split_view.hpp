@@ -3,6 +3,7 @@
 #include <array>
 #include "types.hpp"
 #include "range.hpp"
+#include "simd_scan.hpp"
 #include <algorithm>
 
 namespace dfdh {
@@ -43,6 +44,17 @@ struct skip_whitespace_outside_quotes {
         }
         return false;
     }
+
+    /* Returns the first char which may be a delimiter in the current state */
+    [[nodiscard]]
+    const char* find_delim(const char* b, const char* e) const {
+        switch (state) {
+        case no_quote: return simd::find_first_of<' ', '\t', '"', '\''>(b, e);
+        case on_single: return simd::find_first_of<'\''>(b, e);
+        case on_double: return simd::find_first_of<'"'>(b, e);
+        }
+        return b;
+    }
 };
 
 template <typename I, size_t Ndelims>
@@ -229,9 +241,7 @@ private:
         if (!allow_empty)
             while (b != end && _op(*b))
                 ++b;
-        e = b;
-        while (e != end && !_op(*e))
-            ++e;
+        e = find_delim(b);
     }
 
     void next() {
@@ -242,14 +252,26 @@ private:
             if (b == end)
                 return;
 
-            e = ++b;
-            while (e != end && !_op(*e))
-                ++e;
+            e = find_delim(++b);
 
             repeat = !allow_empty && b == e;
         }
     }
 
+    /* Predicates over contiguous chars may provide find_delim() to skip non-delimiters in blocks */
+    I find_delim(I i) {
+        if constexpr (std::contiguous_iterator<I> && requires(const F& op, const char* p) { op.find_delim(p, p); }) {
+            if (i != end) {
+                auto p = std::to_address(i);
+                i += _op.find_delim(p, p + (end - i)) - p;
+            }
+        }
+
+        while (i != end && !_op(*i))
+            ++i;
+        return i;
+    }
+
 private:
     I b, e, end;
     F _op;
@@ -1,25 +1,85 @@
 #pragma once
 
+#include <charconv>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include "types.hpp"
 
 namespace dfdh
 {
 template <typename T>
-inline T ston(const std::string& str) {
-    static_assert(Integral<T> || AnyOfType<T, double, float>, "T is not a number");
+struct ston_result {
+    T         value = T(0);
+    std::errc ec    = std::errc::invalid_argument;
+    /* Count of parsed chars, like the pos argument of std::stoll */
+    size_t    pos   = 0;
 
-    if constexpr (Integral<T>) {
-        if constexpr (Unsigned<T>)
-            return static_cast<T>(std::stoull(str));
-        else
-            return static_cast<T>(std::stoll(str));
-    }
-    else if constexpr (std::is_same_v<float, T>) {
-        return std::stof(str);
+    explicit operator bool() const {
+        return ec == std::errc{};
     }
-    else if constexpr (std::is_same_v<double, T>) {
-        return std::stod(str);
+};
+
+/* Parses the number at the start of str without locale and allocations.
+ * Like std::sto*, leading whitespace and '+' are skipped and the trailing chars are ignored
+ * (check pos to require the whole string). Out of range values of T are errors, not truncated */
+template <typename T>
+ston_result<T> ston_parse(std::string_view str) noexcept {
+    static_assert(Integral<T> || AnyOfType<T, double, float>, "T is not a number");
+
+    ston_result<T> result;
+
+    auto b = str.data();
+    auto e = b + str.size();
+    while (b != e && (*b == ' ' || (*b >= '\t' && *b <= '\r'))) ++b;
+    if (b != e && *b == '+') {
+        ++b;
+        if (b != e && *b == '-')
+            return result;
     }
+
+    std::from_chars_result res;
+    if constexpr (Integral<T>)
+        res = std::from_chars(b, e, result.value);
+    else
+        res = std::from_chars(b, e, result.value, std::chars_format::general);
+
+    result.ec = res.ec;
+    if (res.ec == std::errc{})
+        result.pos = size_t(res.ptr - str.data());
+    else
+        result.value = T(0);
+
+    return result;
+}
+
+template <typename T>
+std::optional<T> try_ston(std::string_view str) noexcept {
+    if (auto res = ston_parse<T>(str))
+        return res.value;
+    return {};
+}
+
+/* Throws std::invalid_argument or std::out_of_range like std::sto* */
+template <typename T>
+inline T ston(std::string_view str) {
+    auto res = ston_parse<T>(str);
+    if (res.ec == std::errc::result_out_of_range)
+        throw std::out_of_range("ston: " + std::string(str) + " is out of range");
+    if (res.ec != std::errc{})
+        throw std::invalid_argument("ston: " + std::string(str) + " is not a number");
+    return res.value;
+}
+
+/* The shortest representation which is parsed back to the same value */
+template <typename T>
+std::string ntos(T value) {
+    static_assert(Integral<T> || AnyOfType<T, double, float>, "T is not a number");
+
+    char buf[64];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    return {buf, res.ptr};
 }
 } // namespace dfdh
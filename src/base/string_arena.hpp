@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "types.hpp"
+
+namespace dfdh
+{
+
+/* Append-only storage for many small strings.
+ * Strings are referenced by offset/size pairs; released space is reclaimed by compact(),
+ * which asks the owner to enumerate every live reference */
+class string_arena {
+public:
+    static constexpr size_t min_compact_size = 64 * 1024;
+
+    struct ref {
+        u32 offset = 0;
+        u32 size   = 0;
+    };
+
+    string_arena(size_t initial_capacity = 0) {
+        _buf.reserve(initial_capacity);
+    }
+
+    ref push(std::string_view str) {
+        ref r{u32(_buf.size()), u32(str.size())};
+        _buf.append(str);
+        _live += str.size();
+        return r;
+    }
+
+    void release(const ref& r) {
+        _live -= r.size;
+    }
+
+    /* Overwrites the string in place if it fits, otherwise appends a new one */
+    [[nodiscard]]
+    ref replace(const ref& r, std::string_view str) {
+        if (str.size() > r.size) {
+            release(r);
+            return push(str);
+        }
+
+        _buf.replace(r.offset, str.size(), str);
+        _live -= r.size - str.size();
+        return {r.offset, u32(str.size())};
+    }
+
+    [[nodiscard]]
+    std::string_view view(const ref& r) const {
+        return {_buf.data() + r.offset, r.size};
+    }
+
+    [[nodiscard]]
+    bool compaction_required() const {
+        return _buf.size() > min_compact_size && _buf.size() > _live * 2;
+    }
+
+    /* for_each_live_ref(rebind) must call rebind(ref&) for every live reference */
+    template <typename F>
+    void compact(F&& for_each_live_ref) {
+        std::string new_buf;
+        new_buf.reserve(_live * 2);
+
+        for_each_live_ref([&](ref& r) {
+            auto offset = u32(new_buf.size());
+            new_buf.append(_buf, r.offset, r.size);
+            r.offset = offset;
+        });
+
+        _buf = std::move(new_buf);
+    }
+
+    void clear() {
+        _buf.clear();
+        _live = 0;
+    }
+
+    [[nodiscard]]
+    size_t size() const {
+        return _buf.size();
+    }
+
+    [[nodiscard]]
+    size_t live_size() const {
+        return _live;
+    }
+
+private:
+    std::string _buf;
+    size_t      _live = 0;
+};
+
+} // namespace dfdh
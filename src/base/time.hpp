@@ -1,8 +1,11 @@
 #pragma once
 
-#include <sstream>
+#include <algorithm>
+#include <array>
 #include <chrono>
-#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 
 #include "types.hpp"
 
@@ -17,11 +20,11 @@ struct time_info_t {
     std::chrono::nanoseconds  nanosecond;
 };
 
-inline time_info_t get_current_time() {
+inline time_info_t get_time_info(std::chrono::system_clock::time_point time_point) {
     namespace chr = std::chrono;
     using namespace std::chrono_literals;
 
-    auto now = chr::system_clock::now().time_since_epoch();
+    auto now = time_point.time_since_epoch();
     time_info_t t; // NOLINT
 
     auto acc = 0ns + chr::floor<chr::days>(now);
@@ -41,60 +44,163 @@ inline time_info_t get_current_time() {
     return t;
 }
 
-inline std::string current_datetime(std::string_view format) {
-    namespace chr = std::chrono;
+inline time_info_t get_current_time() {
+    return get_time_info(std::chrono::system_clock::now());
+}
 
-    std::stringstream ss;
+/* Datetime format compiled once: a run of the same letter is a zero padded field of the run width.
+ * h, m, s - hours, minutes, seconds; x, u, n - milli, micro, nanoseconds; D, M, Y are reserved */
+class datetime_format {
+public:
+    static constexpr size_t max_segments = 16;
+    static constexpr size_t max_length   = 64;
+
+    constexpr datetime_format(std::string_view format) {
+        size_t literal_start = 0;
+        for (size_t i = 0; i < format.size();) {
+            auto c = format[i];
+            if (!is_field(c)) {
+                ++i;
+                continue;
+            }
 
-    auto time = get_current_time();
+            auto run_end = format.find_first_not_of(c, i);
+            if (run_end == std::string_view::npos)
+                run_end = format.size();
 
-    std::array<bool, 256> charmap = {false};
-    charmap['D'] = charmap['M'] = charmap['Y'] = charmap['h'] = charmap['m'] = charmap['s'] =
-        charmap['x'] = charmap['u'] = charmap['n'] = true;
+            push_segment(format.substr(literal_start, i - literal_start), c, run_end - i);
+            i = literal_start = run_end;
+        }
+        push_segment(format.substr(literal_start), '\0', 0);
 
-    static constexpr auto padprint = [](std::stringstream& ss, int c, auto v) {
-        ss << std::setfill('0') << std::setw(c) << v;
-    };
+        if (length > max_length)
+            throw std::length_error("datetime format is too long");
+    }
 
-    int counter = 0;
-
-    auto printtm = [&](char f) {
-        if (counter) {
-            switch (f) {
-            //case 'D': padprint(ss, counter, u32(ymd.day)); break;
-            //case 'M': padprint(ss, counter, u32(ymd.month)); break;
-            //case 'Y': padprint(ss, counter, int(ymd.year)); break;
-            case 'h': padprint(ss, counter, time.hour.count()); break;
-            case 'm': padprint(ss, counter, time.minute.count()); break;
-            case 's': padprint(ss, counter, time.second.count()); break;
-            case 'x': padprint(ss, counter, time.millisecond.count()); break;
-            case 'u': padprint(ss, counter, time.microsecond.count()); break;
-            case 'n': padprint(ss, counter, time.nanosecond.count()); break;
+    /* Writes the segments [first, last) and returns the end of the written text */
+    char* write(char* out, const time_info_t& time, size_t first = 0, size_t last = max_segments) const {
+        last = std::min(last, count);
+        for (size_t i = first; i < last; ++i) {
+            auto& seg = segments[i];
+            out = std::copy(seg.literal.begin(), seg.literal.end(), out);
+
+            switch (seg.field) {
+            case 'h': out = write_padded(out, time.hour.count(), seg.width); break;
+            case 'm': out = write_padded(out, time.minute.count(), seg.width); break;
+            case 's': out = write_padded(out, time.second.count(), seg.width); break;
+            case 'x': out = write_padded(out, time.millisecond.count(), seg.width); break;
+            case 'u': out = write_padded(out, time.microsecond.count(), seg.width); break;
+            case 'n': out = write_padded(out, time.nanosecond.count(), seg.width); break;
             default: break;
             }
-            counter = 0;
         }
+        return out;
+    }
+
+    /* Index of the first segment which changes within a second */
+    [[nodiscard]]
+    constexpr size_t subsecond_segment() const {
+        for (size_t i = 0; i < count; ++i)
+            if (is_subsecond(segments[i].field))
+                return i;
+        return count;
+    }
+
+    [[nodiscard]]
+    constexpr size_t segments_count() const {
+        return count;
+    }
+
+private:
+    struct segment {
+        std::string_view literal;
+        char             field = '\0';
+        size_t           width = 0;
     };
 
-    char last_fmt = '\0';
-    for (auto c : format) {
-        auto is_fmt = charmap[static_cast<u8>(c)];
+    static constexpr bool is_field(char c) {
+        return c == 'D' || c == 'M' || c == 'Y' || c == 'h' || c == 'm' || c == 's' || is_subsecond(c);
+    }
 
-        if (!is_fmt || last_fmt != c)
-            printtm(last_fmt);
+    static constexpr bool is_subsecond(char c) {
+        return c == 'x' || c == 'u' || c == 'n';
+    }
 
-        if (is_fmt)
-            ++counter;
+    constexpr void push_segment(std::string_view literal, char field, size_t width) {
+        if (count == max_segments)
+            throw std::length_error("datetime format has too many fields");
+
+        segments[count++] = {literal, field, width};
+        /* Values of the fields have 3 digits at most */
+        length += literal.size() + (field == '\0' ? 0 : std::max<size_t>(width, 3));
+    }
+
+    template <typename T>
+    static char* write_padded(char* out, T value, size_t width) {
+        char digits[20];
+        auto end = digits + sizeof(digits);
+        auto p   = end;
+        auto v   = u64(value);
+        do {
+            *--p = char('0' + v % 10);
+            v /= 10;
+        } while (v);
+
+        for (auto n = size_t(end - p); n < width; ++n) *out++ = '0';
+        return std::copy(p, end, out);
+    }
+
+private:
+    std::array<segment, max_segments> segments = {};
+    size_t                            count    = 0;
+    size_t                            length   = 0;
+};
+
+/* Formats timestamps into a fixed buffer. The text up to the first sub-second field is
+ * kept while the second is the same, only the sub-second digits are written again */
+class datetime_cache {
+public:
+    datetime_cache(const datetime_format& format): fmt(format), subsecond(format.subsecond_segment()) {}
+
+    /* The view is valid until the next call */
+    std::string_view operator()(std::chrono::system_clock::time_point time_point) {
+        namespace chr = std::chrono;
+
+        auto since_epoch = time_point.time_since_epoch();
+        auto second      = chr::floor<chr::seconds>(since_epoch);
+
+        if (second != cached_second) {
+            time          = get_time_info(time_point);
+            prefix_length = size_t(fmt.write(buf.data(), time, 0, subsecond) - buf.data());
+            cached_second = second;
+        }
         else {
-            ss << c;
-            counter = 0;
+            auto ns          = chr::duration_cast<chr::nanoseconds>(since_epoch - second).count();
+            time.millisecond = chr::milliseconds(ns / 1000000);
+            time.microsecond = chr::microseconds(ns / 1000 % 1000);
+            time.nanosecond  = chr::nanoseconds(ns % 1000);
         }
 
-        if (is_fmt && last_fmt != c)
-            last_fmt = c;
+        auto end = fmt.write(buf.data() + prefix_length, time, subsecond);
+        return {buf.data(), size_t(end - buf.data())};
     }
-    printtm(last_fmt);
 
-    return ss.str();
+private:
+    datetime_format                               fmt;
+    size_t                                        subsecond;
+    std::array<char, datetime_format::max_length> buf           = {};
+    time_info_t                                   time          = {};
+    size_t                                        prefix_length = 0;
+    std::chrono::seconds                          cached_second = std::chrono::seconds::min();
+};
+
+inline std::string datetime(std::string_view format, std::chrono::system_clock::time_point time_point) {
+    std::array<char, datetime_format::max_length> buf; // NOLINT
+    auto end = datetime_format(format).write(buf.data(), get_time_info(time_point));
+    return {buf.data(), end};
+}
+
+inline std::string current_datetime(std::string_view format) {
+    return datetime(format, std::chrono::system_clock::now());
 }
 } // namespace dfdh
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "print.hpp"
+#include "tsc.hpp"
+
+namespace dfdh {
+
+/* Flight recorder of the profiler scopes. Every thread writes complete (begin + end) events
+ * into its own ring buffer, so recording is a few stores and may stay on in playtests.
+ * A dump takes the events of the last seconds and writes the Chrome Trace Event JSON */
+class trace_recorder {
+public:
+    static constexpr size_t events_per_thread       = 1 << 16;
+    static constexpr double dead_thread_retention_s = 60.0;
+
+    struct event {
+        u64 start;
+        u64 end;
+        u32 id;
+    };
+
+    struct thread_events {
+        std::string        name;
+        u32                tid;
+        std::vector<event> events;
+    };
+
+    static trace_recorder& instance() {
+        static trace_recorder inst;
+        return inst;
+    }
+
+    static void record(u32 id, u64 start, u64 end) {
+        if (!instance().enabled.load(std::memory_order_relaxed))
+            return;
+
+        auto& buf  = *this_thread_buffer().buf;
+        auto  head = buf.head.load(std::memory_order_relaxed);
+        auto& slot = buf.slots[head & (events_per_thread - 1)];
+        slot.start.store(start, std::memory_order_relaxed);
+        slot.end.store(end, std::memory_order_relaxed);
+        slot.id.store(id, std::memory_order_relaxed);
+        buf.head.store(head + 1, std::memory_order_release);
+    }
+
+    /* Names the calling thread in the trace */
+    static void set_thread_name(std::string name) {
+        auto& buf = *this_thread_buffer().buf;
+        std::lock_guard lock{instance().mtx};
+        buf.name = std::move(name);
+    }
+
+    void enable(bool value) {
+        enabled.store(value, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]]
+    bool is_enabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /* Copies the events which ended in the last duration. Writers are not stopped:
+     * the slots which may have been overwritten during the copy are dropped */
+    std::vector<thread_events> snapshot(std::chrono::nanoseconds duration) const {
+        auto now  = tsc_now();
+        auto span = u64(double(duration.count()) * tsc_frequency() / 1e9);
+        auto from = now > span ? now - span : 0;
+
+        std::vector<thread_events> result;
+        std::lock_guard            lock{mtx};
+        for (auto& buf : buffers) {
+            auto& te = result.emplace_back(thread_events{buf->name, buf->tid, {}});
+
+            auto head  = buf->head.load(std::memory_order_acquire);
+            auto first = head > events_per_thread ? head - events_per_thread : 0;
+            for (auto i = first; i < head; ++i) {
+                auto& slot = buf->slots[i & (events_per_thread - 1)];
+                te.events.push_back({slot.start.load(std::memory_order_relaxed),
+                                     slot.end.load(std::memory_order_relaxed),
+                                     slot.id.load(std::memory_order_relaxed)});
+            }
+
+            /* The writer fills the slot of head before it bumps the head: the oldest
+             * slot still in the ring may be in the middle of a write */
+            auto overwritten = buf->head.load(std::memory_order_acquire);
+            auto valid_from  = overwritten >= events_per_thread ? overwritten - events_per_thread + 1 : 0;
+            if (valid_from > first)
+                te.events.erase(te.events.begin(),
+                                te.events.begin() + ssize_t(std::min(valid_from - first, u64(te.events.size()))));
+
+            std::erase_if(te.events, [from](const event& e) { return e.end < from; });
+        }
+        return result;
+    }
+
+    /* Chrome Trace Event JSON, loadable by chrome://tracing and Perfetto UI */
+    template <typename NameF>
+    static std::string chrome_json(const std::vector<thread_events>& threads, NameF&& name_of) {
+        u64 base = std::numeric_limits<u64>::max();
+        for (auto& te : threads)
+            for (auto& e : te.events) base = std::min(base, e.start);
+
+        std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool        first = true;
+        auto        comma = [&] {
+            if (!first)
+                json += ',';
+            first = false;
+        };
+
+        /* Fixed nanosecond precision: the shortest %g form drops the microseconds after a second */
+        auto append_us = [&json, us_per_tick = 1e6 / tsc_frequency()](u64 ticks) {
+            char buf[32];
+            auto res = std::to_chars(buf, buf + sizeof(buf), double(ticks) * us_per_tick, std::chars_format::fixed, 3);
+            json.append(buf, res.ptr);
+        };
+
+        for (auto& te : threads) {
+            comma();
+            json += "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+            details::format_value(json, te.tid);
+            json += ",\"args\":{\"name\":\"";
+            append_escaped(json, te.name.empty() ? format("thread {}", te.tid) : te.name);
+            json += "\"}}";
+
+            for (auto& e : te.events) {
+                comma();
+                json += "\n{\"name\":\"";
+                append_escaped(json, name_of(e.id));
+                json += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+                details::format_value(json, te.tid);
+                json += ",\"ts\":";
+                append_us(e.start - base);
+                json += ",\"dur\":";
+                append_us(e.end - e.start);
+                json += '}';
+            }
+        }
+        json += "\n]}\n";
+        return json;
+    }
+
+private:
+    struct slot_t {
+        std::atomic<u64> start = 0;
+        std::atomic<u64> end   = 0;
+        std::atomic<u32> id    = 0;
+    };
+
+    struct buffer_t {
+        std::unique_ptr<slot_t[]> slots = std::make_unique<slot_t[]>(events_per_thread);
+        std::atomic<u64>          head  = 0;
+        std::string               name;
+        u32                       tid   = 0;
+        std::atomic<bool>         alive = true;
+    };
+
+    /* The buffer of an exited thread stays dumpable for the retention time */
+    struct thread_holder {
+        thread_holder(): buf(instance().register_thread()) {}
+        ~thread_holder() {
+            buf->alive.store(false);
+        }
+
+        std::shared_ptr<buffer_t> buf;
+    };
+
+    static thread_holder& this_thread_buffer() {
+        thread_local thread_holder holder;
+        return holder;
+    }
+
+    std::shared_ptr<buffer_t> register_thread() {
+        auto buf = std::make_shared<buffer_t>();
+
+        auto retention = u64(dead_thread_retention_s * tsc_frequency());
+        auto now       = tsc_now();
+
+        std::lock_guard lock{mtx};
+        std::erase_if(buffers, [&](auto& b) {
+            auto head = b->head.load(std::memory_order_acquire);
+            return !b->alive.load() &&
+                   (head == 0 || b->slots[(head - 1) & (events_per_thread - 1)].end.load() + retention < now);
+        });
+        buf->tid = next_tid++;
+        buffers.push_back(buf);
+        return buf;
+    }
+
+    static void append_escaped(std::string& out, std::string_view str) {
+        for (auto c : str) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            }
+            else if (u8(c) < 0x20) {
+                static constexpr auto hex = "0123456789abcdef";
+                out += "\\u00";
+                out += hex[u8(c) >> 4];
+                out += hex[u8(c) & 0xf];
+            }
+            else
+                out += c;
+        }
+    }
+
+private:
+    std::vector<std::shared_ptr<buffer_t>> buffers;
+    u32                                    next_tid = 0;
+    std::atomic<bool>                      enabled  = true;
+    mutable std::mutex                     mtx;
+};
+
+/* Records a block into the trace without a profiler */
+struct trace_scope {
+    trace_scope(u32 scope_id): id(scope_id), start(tsc_now()) {}
+    ~trace_scope() {
+        trace_recorder::record(id, start, tsc_now());
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+    u32 id;
+    u64 start;
+};
+
+} // namespace dfdh
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "types.hpp"
+
+namespace dfdh {
+
+/* Single writer, single reader triple buffer. The writer fills its back slot and swaps it
+ * with the middle one, the reader swaps the middle slot with its front one when a newer value
+ * is there. Neither side waits for the other and the reader always sees a complete value.
+ * The back slot keeps the value of two publishes ago: the writer must overwrite it entirely */
+template <typename T>
+class triple_buffer {
+public:
+    /* Writer side */
+    T& back() {
+        return _slots[_back];
+    }
+
+    void publish() {
+        _back = u8(_middle.exchange(u8(_back | fresh_bit), std::memory_order_acq_rel) & index_mask);
+    }
+
+    /* Reader side: takes the last published value, false if there is nothing new */
+    bool acquire() {
+        if (!(_middle.load(std::memory_order_relaxed) & fresh_bit))
+            return false;
+        _front = u8(_middle.exchange(_front, std::memory_order_acq_rel) & index_mask);
+        return true;
+    }
+
+    [[nodiscard]]
+    const T& front() const {
+        return _slots[_front];
+    }
+
+private:
+    static constexpr u8 index_mask = 0b011;
+    static constexpr u8 fresh_bit  = 0b100;
+
+    std::array<T, 3> _slots;
+
+    alignas(64) std::atomic<u8> _middle = 1;
+    alignas(64) u8 _back                = 0;
+    alignas(64) u8 _front               = 2;
+};
+
+} // namespace dfdh
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "types.hpp"
+
+namespace dfdh
+{
+/* Time stamp counter: a few cycles per read. The invariant TSC of modern x86 cpus is assumed,
+ * on other architectures the steady clock nanoseconds are used */
+inline u64 tsc_now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return u64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count());
+#endif
+}
+
+/* Counter ticks per second, measured once against the steady clock */
+inline double tsc_frequency() {
+#if defined(__x86_64__) || defined(__i386__)
+    static const double frequency = [] {
+        auto time  = std::chrono::steady_clock::now();
+        auto ticks = tsc_now();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - time);
+        return double(tsc_now() - ticks) / elapsed.count();
+    }();
+    return frequency;
+#else
+    return 1e9;
+#endif
+}
+
+/* A counter value with the system time at the same moment, maps ticks to the system time */
+struct tsc_anchor {
+    u64    tsc       = 0;
+    i64    system_ns = 0;
+    double frequency = 1e9;
+
+    static tsc_anchor now() {
+        auto frequency = tsc_frequency();
+        auto system    = std::chrono::system_clock::now();
+        return {tsc_now(),
+                std::chrono::duration_cast<std::chrono::nanoseconds>(system.time_since_epoch()).count(),
+                frequency};
+    }
+
+    [[nodiscard]]
+    std::chrono::system_clock::time_point to_system(u64 ticks) const {
+        auto ns = i64(double(i64(ticks - tsc)) * 1e9 / frequency);
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(system_ns + ns)));
+    }
+};
+} // namespace dfdh
@@ -171,14 +171,17 @@ public:
                     return;
                 }
                 if constexpr (Number<inner_type<arg_type>> && !std::is_same_v<inner_type<arg_type>, bool>) {
-                    std::decay_t<arg_type> v;
-                    try {
-                        v = ston<inner_type<arg_type>>(str);
+                    auto parsed = ston_parse<inner_type<arg_type>>(str);
+                    if (parsed.ec == std::errc::result_out_of_range) {
+                        glog().error("{}: argument[{}] is out of range", command_name, I);
+                        return;
                     }
-                    catch (const std::exception& e) {
+                    if (!parsed) {
                         glog().error("{}: argument[{}] must be a number", command_name, I);
                         return;
                     }
+                    std::decay_t<arg_type> v;
+                    v = parsed.value;
                     command_dispatch<F, I + 1>(
                         command_name, std::forward<F>(func), ++arg_begin, arg_end, std::forward<Ts>(args)..., v);
                     return;
@@ -224,7 +227,8 @@ public:
             insert = insert_was;
             node = pos->second.get();
         }
-        if (!insert) {
+        /* The node may exist without a handler when a subcommand was registered first */
+        if (!insert && node->handler) {
             glog().error("command '{}' already registered", command);
             return;
         }
@@ -264,7 +268,7 @@ public:
             insert = insert_was;
             node = pos->second.get();
         }
-        if (!insert) {
+        if (!insert && node->handler) {
             glog().error("command '{}' already registered", command);
             return;
         }
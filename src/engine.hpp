@@ -3,6 +3,7 @@
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Window/Event.hpp>
 
+#include "base/alloc_tracker.hpp"
 #include "base/args_view.hpp"
 #include "base/cfg.hpp"
 #include "base/profiler.hpp"
@@ -10,6 +11,7 @@
 #include "ui/nuklear.hpp"
 #include "ui/devconsole.hpp"
 #include "ui/main_menu.hpp"
+#include "ui/perf_overlay.hpp"
 
 #include "command_buffer.hpp"
 
@@ -31,13 +33,15 @@ public:
         _conf(config_path, cfg_mode::create_if_not_exists | cfg_mode::commit_at_destroy | cfg_mode::autocreate_dir),
         _engine_conf(_conf.get_or_create("engine"_sect)),
         _wnd(video_mode(_engine_conf.value_or_default_and_set("window_size", defaults::window_size)), "diefastdiehard"),
-        _devcons(ui) {
+        _devcons(ui),
+        _perf_overlay(ui) {
 
         _wnd.setActive(true);
         ui = ui_ctx(_wnd);
     }
 
     virtual ~engine() {
+        /* Flush barrier: waits for the pending background writes of all configs */
         _conf.commit();
     }
 
@@ -53,20 +57,22 @@ public:
         _wnd.setFramerateLimit(_engine_conf.value_or_default_and_set("framerate_limit", 60U));
 
         profiler_print = _engine_conf.value_or_default_and_set("profiler", false);
+        trace_recorder::set_thread_name("main");
 
         while (_wnd.isOpen()) {
             {
-                auto prof = loop_prof.scope("logic");
+                DFDH_PROF_SCOPE(loop_prof, "logic");
                 game_update();
             }
 
             {
-                auto prof = loop_prof.scope("events");
+                DFDH_PROF_SCOPE(loop_prof, "events");
                 ui.input_begin();
                 sf::Event evt;
                 while (_wnd.pollEvent(evt)) {
                     ui.handle_event(evt);
                     _devcons.handle_event(evt);
+                    _perf_overlay.handle_event(evt);
 
                     if (evt.type == sf::Event::Closed) {
                         _wnd.close();
@@ -85,34 +91,52 @@ public:
             }
 
             {
-                auto prof = loop_prof.scope("ui", false);
+                DFDH_PROF_SCOPE(loop_prof, "ui", false);
+                DFDH_ALLOC_SCOPE(ui);
                 ui_update();
             }
 
             {
-                auto prof = loop_prof.scope("render");
+                DFDH_PROF_SCOPE(loop_prof, "render");
+                DFDH_ALLOC_SCOPE(render);
                 _wnd.clear();
                 render_update(_wnd);
             }
 
             {
-                auto prof = loop_prof.scope("ui");
+                DFDH_PROF_SCOPE(loop_prof, "ui");
+                DFDH_ALLOC_SCOPE(ui);
                 ui.render();
             }
 
             {
-                auto prof = loop_prof.scope("swapbuffers");
+                DFDH_PROF_SCOPE(loop_prof, "swapbuffers");
                 _wnd.display();
             }
 
+            if (!_first_frame_shown) {
+                _first_frame_shown = true;
+                glog().detail("time to first frame: {}",
+                              std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                                    _start_time));
+            }
+
             {
-                auto prof = loop_prof.scope("commands");
+                DFDH_PROF_SCOPE(loop_prof, "commands");
                 command_buffer().run_handlers();
             }
+            loop_prof.update_window();
+            _perf_overlay.push_frame(loop_prof);
+            if constexpr (alloc_tracking_enabled)
+                alloc_frame();
 
             if (profiler_print) {
-                loop_prof.try_print(
-                    [](auto& prof) { glog().detail(prof.short_print_format() ? "{}" : "min|max|avg: {}", prof); });
+                loop_prof.try_print([](auto& prof) {
+                    if (prof.short_print_format())
+                        glog().detail("{}", prof);
+                    else
+                        glog().detail("min|max|avg: {}", prof);
+                });
             }
         }
 
@@ -133,8 +157,17 @@ end:
         return _main_menu;
     }
 
+    perf_overlay& perfoverlay() {
+        return _perf_overlay;
+    }
+
+    const alloc_rate_meter& alloc_meter() const {
+        return _alloc_meter;
+    }
+
     virtual void ui_update() {
         devcons().update_internal();
+        _perf_overlay.update_internal();
     }
 
     virtual void on_init(args_view args) = 0;
@@ -147,6 +180,8 @@ end:
     virtual void on_window_resize(u32 width, u32 height) {
         _engine_conf.set("window_size", vec2u{width, height});
         _engine_conf.set("window_pos", window_position());
+        /* Resize events come in bursts; cfg_writer writes engine.cfg once per interval */
+        _conf.commit_async();
     }
 
     void enable_profiler_print(bool value) {
@@ -176,6 +211,19 @@ end:
     }
 
 private:
+    void alloc_frame() {
+        _alloc_meter.frame();
+
+        u64 count = 0, bytes = 0;
+        for (auto& c : alloc_tracker::totals()) {
+            count += c.count;
+            bytes += c.bytes;
+        }
+        perf_counters().allocations.store(count - _last_allocs.count, std::memory_order_relaxed);
+        perf_counters().allocated_bytes.store(bytes - _last_allocs.bytes, std::memory_order_relaxed);
+        _last_allocs = {count, bytes};
+    }
+
     void init_window() {
         auto wnd_size  = window_size();
         auto screen_sz = screen_size();
@@ -196,13 +244,19 @@ protected:
     ui_ctx ui;
 
 private:
+    std::chrono::steady_clock::time_point _start_time = std::chrono::steady_clock::now();
+
     cfg                 _conf;
     cfg_section<false>  _engine_conf;
     sf::ContextSettings _settings{24, 8, 4, 3, 3};
     sf::RenderWindow    _wnd;
     devconsole          _devcons;
     main_menu           _main_menu;
-    profiler            loop_prof;
+    perf_overlay        _perf_overlay;
+    alloc_rate_meter    _alloc_meter;
+    alloc_counts        _last_allocs;
+    profiler            loop_prof{"engine"};
     bool                profiler_print = false;
+    bool                _first_frame_shown = false;
 };
 }
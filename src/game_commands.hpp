@@ -1,5 +1,7 @@
 #pragma once
 
+#include <fstream>
+
 #include "base/ston.hpp"
 #include "game_state.hpp"
 #include "command_buffer.hpp"
@@ -29,8 +31,13 @@ public:
         command_buffer().add_handler("ai", &game_commands::cmd_ai, this);
         command_buffer().add_handler("ai difficulty", &game_commands::cmd_ai_difficulty, this);
         command_buffer().add_handler("ai profiler", &game_commands::cmd_ai_profiler, this);
+        command_buffer().add_handler("profiler trace", &game_commands::cmd_profiler_trace, this);
+        command_buffer().add_handler("profiler stats", &game_commands::cmd_profiler_stats, this);
+        command_buffer().add_handler("profiler csv", &game_commands::cmd_profiler_csv, this);
+        command_buffer().add_handler("profiler hw", &game_commands::cmd_profiler_hw, this);
         command_buffer().add_handler("shutdown", &game_commands::cmd_shutdown, this);
         command_buffer().add_handler("sound volume", &game_commands::cmd_sound_volume, this);
+        command_buffer().add_handler("sound stats", &game_commands::cmd_sound_stats, this);
 
         if (gs.lua_cmd_enabled)
             command_buffer().add_handler("lua", &game_commands::cmd_lua, this);
@@ -46,6 +53,11 @@ public:
         command_buffer().remove_handler("ai");
         command_buffer().remove_handler("connect");
         command_buffer().remove_handler("srv init");
+        /* The profiler node and its other subcommands belong to diefastdiehard */
+        command_buffer().remove_handler("profiler trace");
+        command_buffer().remove_handler("profiler stats");
+        command_buffer().remove_handler("profiler csv");
+        command_buffer().remove_handler("profiler hw");
         command_buffer().remove_handler("shutdown");
     }
 
@@ -64,10 +76,11 @@ public:
         }
         else if (cmd == "log") {
             help = "available commands:\n"
-                   "  log time [on/off]  - enables or disables time showing\n"
-                   "  log level [on/off] - enables or disables level showing\n"
-                   "  log ring  [uint]   - setup log ring buffer size\n"
-                   "  log clear          - clear devconsole log";
+                   "  log time [on/off]      - enables or disables time showing\n"
+                   "  log level [on/off]     - enables or disables level showing\n"
+                   "  log ring  [uint]       - setup log ring buffer size\n"
+                   "  log binary [file|off]? - write binary log records to the file (--log-binary [file])\n"
+                   "  log clear              - clear devconsole log";
         }
         else if (cmd == "cfg") {
             help = "shows loaded configs\n"
@@ -106,9 +119,25 @@ public:
             help = "Lua interpreter\n"
                    "lua [command]    - execute lua line";
         }
+        else if (cmd == "profiler") {
+            help = "Profiler statistics and scope trace recorder\n"
+                   "profiler [on/off]                  - enable/disable the engine loop profiler log output\n"
+                   "profiler overlay [on/off]?         - show/hide the performance overlay (F3)\n"
+                   "profiler alloc                     - allocations per second and bytes per frame by\n"
+                   "                                     subsystem (build-plz --alloc-tracking)\n"
+                   "profiler stats [profiler]?         - show p50/p90/p99/p99.9/max of the last window (5s)\n"
+                   "                                     for engine, physics and ai profilers\n"
+                   "profiler csv [file]?               - write the last windows in CSV (dfdh_profiler.csv)\n"
+                   "profiler hw [on/off]?              - read cpu counters (IPC, cache and branch misses)\n"
+                   "                                     around the scopes, shown by stats and csv\n"
+                   "profiler trace [duration] [file]?  - write the last duration (5s, 500ms) of the profiler\n"
+                   "                                     scopes in the Chrome trace format (dfdh_trace.json)\n"
+                   "profiler trace [on/off]            - enable/disable recording";
+        }
         else if (cmd == "sound") {
             help = "Sound settings\n"
-                   "sound volume [0 - 100]  - set or get sound volume";
+                   "sound volume [0 - 100]  - set or get sound volume\n"
+                   "sound stats             - show voice pool counters";
         }
 
         if (!help.empty())
@@ -470,6 +499,104 @@ public:
         gs.ai_profiler_enabled = value;
     }
 
+    void cmd_profiler_stats(const std::optional<std::string>& prof_name) {
+        auto us = [](std::chrono::nanoseconds dur) {
+            return double(dur.count()) / 1000.0;
+        };
+
+        std::string msg = "scope: count p50 p90 p99 p99.9 max (us)";
+        for (auto& [name, stats] : profiler::windows()) {
+            if (prof_name && name != *prof_name)
+                continue;
+
+            format_into(msg, "\n{}:", name);
+            for (auto& st : stats) {
+                format_into(msg,
+                            "\n  {}: {} {} {} {} {} {}",
+                            st.scope,
+                            st.count,
+                            us(st.p50),
+                            us(st.p90),
+                            us(st.p99),
+                            us(st.p999),
+                            us(st.max));
+                if (st.hw)
+                    format_into(msg,
+                                " | ipc {} l1d {} llc {} branch {} misses",
+                                st.ipc,
+                                st.l1d_misses,
+                                st.llc_misses,
+                                st.branch_misses);
+            }
+        }
+        glog().detail("{}", msg);
+    }
+
+    void cmd_profiler_csv(const std::optional<std::string>& path) {
+        auto file = path.value_or("dfdh_profiler.csv");
+        auto ofs  = std::ofstream(file, std::ios::trunc);
+        if (!ofs.is_open()) {
+            glog().error("profiler csv: cannot open {}", file);
+            return;
+        }
+        profiler::write_windows_csv(ofs);
+        glog().info("profiler csv: written to {}", file);
+    }
+
+    void cmd_profiler_hw(cmd_opt<bool> enable) {
+        if (!enable) {
+            glog().info("profiler hw: {}", cmd_opt<bool>(profiler::hw_counters()));
+            return;
+        }
+
+        if (*enable) {
+            /* Every thread opens its own counters, the probe only reports why they are not available */
+            perf_event_group probe;
+            if (!probe.available()) {
+                glog().warn("profiler hw: counters are not available: {}", probe.error());
+                return;
+            }
+            if (!probe.error().empty())
+                glog().warn("profiler hw: some counters are not available: {}", probe.error());
+        }
+        profiler::hw_counters(*enable);
+    }
+
+    void cmd_profiler_trace(const std::string& arg, const std::optional<std::string>& path) {
+        if (arg == "on" || arg == "off") {
+            trace_recorder::instance().enable(arg == "on");
+            return;
+        }
+        if (arg == "help") {
+            cmd_help("profiler");
+            return;
+        }
+
+        auto number = std::string_view(arg);
+        auto unit   = 1e9;
+        if (number.ends_with("ms")) {
+            number.remove_suffix(2);
+            unit = 1e6;
+        }
+        else if (number.ends_with('s'))
+            number.remove_suffix(1);
+
+        auto value = try_ston<double>(number);
+        if (!value || *value <= 0.0) {
+            glog().error("profiler trace: invalid duration {}", arg);
+            return;
+        }
+
+        auto file = path.value_or("dfdh_trace.json");
+        try {
+            profiler::write_trace(file, std::chrono::nanoseconds(i64(*value * unit)));
+            glog().info("profiler trace: written to {}", file);
+        }
+        catch (const std::exception& e) {
+            glog().error("profiler trace: {}", e.what());
+        }
+    }
+
     void cmd_ai(const std::string& cmd, const std::optional<std::string>& value) {
         if (cmd == "list") {
             std::string msg = "active AI operators:\n";
@@ -545,6 +672,28 @@ public:
         }
     }
 
+    void cmd_sound_stats() {
+        auto& st = sound_mgr().stats();
+        glog().info("sound stats: registered: {} loaded: {} active voices: {}/{} plays: {} reuses: {} steals: {} "
+                    "dropped: {} lazy registrations: {} buffer switches: {}\n"
+                    "  first plays: {} (max latency {}) sync loads: {} ({} total) max bank load: {}",
+                    sound_mgr().registered_count(),
+                    sound_mgr().loaded_count(),
+                    sound_mgr().active_voices(),
+                    sound_mgr_singleton::max_voices,
+                    st.plays,
+                    st.voice_reuses,
+                    st.voice_steals,
+                    st.dropped,
+                    st.lazy_registrations,
+                    st.buffer_switches,
+                    st.first_plays,
+                    st.first_play_max,
+                    st.sync_loads,
+                    st.sync_load_time,
+                    st.bank_ready_max);
+    }
+
     void cmd_shutdown() {
         gs.sig_shutdown.emit_deferred();
     }
@@ -4,6 +4,8 @@
 
 #include "base/types.hpp"
 #include "base/cfg_value_control.hpp"
+#include "base/cfg_watcher.hpp"
+#include "base/perf_counters.hpp"
 #include "base/signals.hpp"
 #include "ui/player_configurator_ui.hpp"
 #include "bullet.hpp"
@@ -21,7 +23,10 @@ public:
     game_state():
         blt_mgr("blt_mgr", sim, player_hit_callback),
         kick_mgr("kick_mgr", sim, player_hit_callback),
-        conf_watcher(&cfg::mutable_global()) {
+        conf_watcher(&cfg::mutable_global(), [this](const std::vector<std::string>& section_names) {
+            for (auto& section_name : section_names)
+                reload_section(section_name);
+        }) {
         sim.add_update_callback("player", [this](const physic_simulation& sim, float timestep) {
             for (auto& [_, p] : players)
                 p->physic_update(sim, timestep);
@@ -161,7 +166,7 @@ public:
             if (was_insert)
                 glog().info("level {} was cached", level_name);
             else
-                glog().info("level {} already cached");
+                glog().info("level {} already cached", level_name);
             return true;
         }
         catch (const std::exception& e) {
@@ -171,10 +176,18 @@ public:
     }
 
     void game_run(bool value = true) {
-        if (on_game)
-            glog().info(value ? "game already running" : "game stopped");
-        else
-            glog().info(value ? "game running" : "game already stopped");
+        if (on_game) {
+            if (value)
+                glog().info("game already running");
+            else
+                glog().info("game stopped");
+        }
+        else {
+            if (value)
+                glog().info("game running");
+            else
+                glog().info("game already stopped");
+        }
         on_game = value;
     }
 
@@ -333,9 +346,7 @@ public:
     };
 
     void game_update() {
-        /* Try reload watched sections */
-        for (auto& section_name : cfg::mutable_global().replace_changed_sections())
-            reload_section(section_name);
+        sound_mgr().update();
 
         if (on_game) {
             sim.update(60, game_speed);
@@ -363,12 +374,21 @@ public:
 
             if (ai_profiler_enabled)
                 ai_mgr().profiler_print([](auto& prof) {
-                    glog().detail(prof.short_print_format() ? "ai worker: {}" : "ai_worker: min|max|avg: {}", prof);
+                    if (prof.short_print_format())
+                        glog().detail("ai worker: {}", prof);
+                    else
+                        glog().detail("ai_worker: min|max|avg: {}", prof);
                 });
         }
         else {
             sim.update_pass();
         }
+
+        if (perf_counters().enabled()) {
+            perf_counters().set(perf_counters().bullets, blt_mgr.bullets().size());
+            perf_counters().set(perf_counters().sound_voices, sound_mgr().active_voices());
+            perf_counters().set(perf_counters().sound_max_voices, sound_mgr_singleton::max_voices);
+        }
     }
 
     /* AI operators */
@@ -397,6 +417,9 @@ public:
     }
 
     void ai_provide_player_level_sim_info() {
+        DFDH_ALLOC_SCOPE(ai);
+        auto start = std::chrono::steady_clock::now();
+
         ai_mgr().provide_bullets(blt_mgr.bullets(), [](const bullet& bl) {
             return ai_bullet_t{
                 bl.physic()->get_position(),
@@ -438,6 +461,13 @@ public:
         });
 
         ai_mgr().provide_physic_sim(sim.gravity(), sim.last_speed(), sim.last_rps(), gravity_for_bullets);
+        ai_mgr().publish();
+
+        if (perf_counters().enabled())
+            perf_counters().set(perf_counters().ai_publish_us,
+                                size_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                           std::chrono::steady_clock::now() - start)
+                                           .count()));
     }
 
     void ai_provide_level_info() {
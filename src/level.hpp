@@ -10,6 +10,7 @@
 #include "base/vec_math.hpp"
 #include "base/cfg.hpp"
 #include "physic/physic_simulation.hpp"
+#include "texture_mgr.hpp"
 
 namespace dfdh {
 
@@ -44,14 +45,13 @@ public:
         _view_size   = sect.value<vec2f>("view_size");
         _level_size  = sect.value<vec2f>("level_size");
 
-        auto txtr_path              = fs::current_path() / "data/textures/" / _name;
-        auto end_platform_txtr_path = txtr_path / "end_platform.png";
-        auto platform_txtr_path     = txtr_path / "platform.png";
-        auto background_txtr_path   = txtr_path / "background.png";
+        auto end_platform_txtr_path = _name + "/end_platform.png";
+        auto platform_txtr_path     = _name + "/platform.png";
+        auto background_txtr_path   = _name + "/background.png";
 
 #define load_if_path_changed(txtr) \
         if (_##txtr##_path != txtr##_path) { \
-            _##txtr.loadFromFile(txtr##_path); \
+            _##txtr = &texture_mgr().load(txtr##_path); \
             _##txtr##_path = txtr##_path; \
         }
 
@@ -61,16 +61,16 @@ public:
 
 #undef load_if_path_changed
 
-        _end_platform.setTexture(_end_platform_txtr);
-        _platform.setTexture(_platform_txtr);
+        _end_platform.setTexture(*_end_platform_txtr);
+        _platform.setTexture(*_platform_txtr);
 
-        _end_platform.setScale({_platform_sz / float(_end_platform_txtr.getSize().x),
-                                _platform_sz / float(_end_platform_txtr.getSize().y)});
-        _platform.setScale({_platform_sz / float(_platform_txtr.getSize().x),
-                            _platform_sz / float(_platform_txtr.getSize().y)});
+        _end_platform.setScale({_platform_sz / float(_end_platform_txtr->getSize().x),
+                                _platform_sz / float(_end_platform_txtr->getSize().y)});
+        _platform.setScale({_platform_sz / float(_platform_txtr->getSize().x),
+                            _platform_sz / float(_platform_txtr->getSize().y)});
 
-        _background.setTexture(_background_txtr);
-        auto background_size = _background_txtr.getSize();
+        _background.setTexture(*_background_txtr);
+        auto background_size = _background_txtr->getSize();
         _background.setScale(vec2f(_level_size.x / float(background_size.x),
                                           _level_size.y / float(background_size.y)));
 
@@ -88,8 +88,9 @@ public:
         u32 pl = 0;
         while (auto pl_data =
                    cfg::global().get_section(sect_name).try_get<std::array<float, 3>>("pl" + std::to_string(pl))) {
+            auto [x, y, length] = pl_data->value();
             platforms.push_back(
-                platform_t{physic_platform({(pl_data->value())[0], (pl_data->value())[1]}, (pl_data->value())[2]),
+                platform_t{physic_platform({x, y}, length),
                            platform_border,
                            platform_border,
                            platform});
@@ -144,9 +145,10 @@ private:
     sf::Sprite  _platform;
     sf::Sprite  _background;
 
-    sf::Texture _end_platform_txtr;
-    sf::Texture _platform_txtr;
-    sf::Texture _background_txtr;
+    /* Owned by texture_mgr, shared with the preloaded ones */
+    const sf::Texture* _end_platform_txtr = nullptr;
+    const sf::Texture* _platform_txtr     = nullptr;
+    const sf::Texture* _background_txtr   = nullptr;
 
     std::string _end_platform_txtr_path;
     std::string _platform_txtr_path;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <vector>
 #include <map>
 
@@ -167,27 +168,27 @@ public:
             }
 
             p = g->_elements.front().first.get();
-            idxs.push_back(0);
+            push_index();
         }
     }
 
     group_tree_iterator& operator++() {
-        if (!idxs.empty()) {
-            ++idxs.back();
+        if (depth) {
+            ++idxs[depth - 1];
 
-            while (!idxs.empty() && idxs.back() == g->_elements.size()) {
-                idxs.pop_back();
-                if (idxs.empty()) {
+            while (depth && idxs[depth - 1] == g->_elements.size()) {
+                --depth;
+                if (!depth) {
                     p = nullptr;
                     break;
                 } else {
-                    ++idxs.back();
+                    ++idxs[depth - 1];
                     g = g->_group.lock().get();
                 }
             }
 
-            if (!idxs.empty()) {
-                p = g->_elements[idxs.back()].first.get();
+            if (depth) {
+                p = g->_elements[idxs[depth - 1]].first.get();
                 while (auto grp = dynamic_cast<physic_group*>(p)) {
                     g = grp;
                     if (g->_elements.empty()) {
@@ -197,7 +198,7 @@ public:
                     }
 
                     p = g->_elements.front().first.get();
-                    idxs.push_back(0);
+                    push_index();
                 }
             }
         } else {
@@ -225,9 +226,20 @@ public:
     }
 
 private:
-    physic_point* p;
-    std::vector<u32> idxs;
-    physic_group* g = nullptr;
+    void push_index() {
+        if (depth == idxs.size())
+            throw std::runtime_error("Groups are nested too deep");
+        idxs[depth++] = 0;
+    }
+
+private:
+    /* The collision loop walks a tree per primitive pair: a fixed stack does not allocate */
+    static constexpr size_t max_depth = 8;
+
+    physic_point*              p;
+    std::array<u32, max_depth> idxs  = {};
+    size_t                     depth = 0;
+    physic_group*              g     = nullptr;
 };
 
 class group_tree_view {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <map>
 #include <set>
 #include <vector>
@@ -15,6 +16,8 @@
 #include "physic_group.hpp"
 #include "physic_platform.hpp"
 #include "base/log.hpp"
+#include "base/perf_counters.hpp"
+#include "base/profiler.hpp"
 
 namespace dfdh {
 
@@ -85,17 +88,25 @@ public:
     };
 
     void update(uint rps = 60, float speed = 1.f) {
+        DFDH_ALLOC_SCOPE(physics);
         auto min_timestep = milliseconds(uint(1000.f / float(rps)));
         _last_speed = speed;
         _last_rps   = rps;
 
         auto now = tp_now();
         while (now > _next_update_time) {
+            DFDH_PROF_SCOPE(_prof, "tick");
             update_immediate(duration_cast<float_seconds>(min_timestep).count() * speed, now);
             _next_update_time += min_timestep;
         }
 
         _interpolation_factor = duration_cast<float_seconds>(now + min_timestep - _next_update_time) / min_timestep;
+        _prof.update_window();
+
+        if (perf_counters().enabled()) {
+            perf_counters().set(perf_counters().physic_primitives, _pointonly.size() + _lineonly.size());
+            perf_counters().set(perf_counters().physic_pairs, _pair_tests);
+        }
     }
 
     void update_pass() {
@@ -106,6 +117,7 @@ public:
     void update_immediate(float timestep, auto now) {
         _current_update_time = now;
         _last_timestep = timestep;
+        _pair_tests = 0;
 
         constexpr auto update_move =
             [](auto& primitives, auto& i, float timestep) {
@@ -124,12 +136,13 @@ public:
         for (auto i = _lineonly.begin(); i != _lineonly.end();)
             update_move(_lineonly, i, timestep);
 
-        std::set<std::pair<physic_point*, physic_point*>> collisions;
+        /* Only a few pairs collide per tick: a reused vector keeps the tick free of allocations */
+        _collisions.clear();
 
         for (auto& line : _lineonly) {
             for (auto ni : group_tree_view(line.get())) {
                 for (auto& point : _pointonly) {
-                    if (collisions.contains(std::pair{line.get(), point.get()}))
+                    if (std::ranges::find(_collisions, std::pair{line.get(), point.get()}) != _collisions.end())
                         continue;
 
                     bool collide = false;
@@ -138,6 +151,7 @@ public:
                             continue;
 
                         if (ni->bb().intersects(nj->bb())) {
+                            ++_pair_tests;
                             if (analyze(timestep, ni, nj)) {
                                 collide = true;
                                 break;
@@ -146,7 +160,7 @@ public:
                     }
 
                     if (collide)
-                        collisions.insert(std::pair{line.get(), point.get()});
+                        _collisions.emplace_back(line.get(), point.get());
                 }
             }
         }
@@ -439,9 +453,9 @@ private:
                                               collide_callback_arg_generic_t b,
                                               collision_result               cr) {
             std::visit(
-                [b, callback, cr](auto a) {
+                [b, &callback, cr](auto a) {
                     std::visit(
-                        [a, callback, cr](auto b) {
+                        [a, &callback, cr](auto b) {
                             if constexpr (std::is_invocable_v<decltype(callback),
                                                               decltype(a),
                                                               decltype(b),
@@ -467,6 +481,10 @@ private:
     float                                   _last_speed           = 1.f;
     steady_clock::time_point                _next_update_time     = steady_clock::now();
     float                                   _interpolation_factor = 0.f;
+    profiler                                _prof{"physics"};
+    size_t                                  _pair_tests = 0;
+
+    std::vector<std::pair<physic_point*, physic_point*>> _collisions;
 
     std::chrono::steady_clock::time_point _current_update_time = std::chrono::steady_clock::now();
 
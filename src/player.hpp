@@ -246,6 +246,24 @@ public:
         _long_shot_enabled = false;
     }
 
+    struct sounds_t {
+        sound_id                headshot;
+        std::array<sound_id, 2> bullethit;
+        std::array<sound_id, 3> step;
+        std::array<sound_id, 2> fall;
+    };
+
+    /* Registered once, so playing doesn't touch sound paths */
+    static const sounds_t& sounds() {
+        static const sounds_t snds{
+            sound_mgr().register_sound("player/headshot0.wav"),
+            sound_mgr().register_sounds<2>({"player/bullethit0.wav", "player/bullethit1.wav"}),
+            sound_mgr().register_sounds<3>({"player/step0.wav", "player/step1.wav", "player/step2.wav"}),
+            sound_mgr().register_sounds<2>({"player/fall0.wav", "player/fall1.wav"}),
+        };
+        return snds;
+    }
+
     static int player_group_getter(const physic_point* p) {
         return std::any_cast<player*>(p->get_user_any())->get_group();
     }
@@ -259,11 +277,21 @@ public:
                      F&&                bullet_spawn_callback = nullptr) {
         /* Hit player sounds */
         if (_hit_sound_info) {
-            sound_mgr().play(_hit_sound_info->pwned ? "player/headshot0.wav"s
-                                                    : ("player/bullethit"s + rand_num('0', '1') + ".wav"),
-                             _group,
-                             (_hit_sound_info->position - cam_position),
-                             sim.last_speed());
+            auto& snds = sounds();
+            if (_hit_sound_info->pwned)
+                sound_mgr().play(snds.headshot,
+                                 _group,
+                                 (_hit_sound_info->position - cam_position),
+                                 sim.last_speed(),
+                                 100.f,
+                                 sound_priority::critical);
+            else
+                sound_mgr().play(snds.bullethit[rand_num<size_t>(0, snds.bullethit.size() - 1)],
+                                 _group,
+                                 (_hit_sound_info->position - cam_position),
+                                 sim.last_speed(),
+                                 100.f,
+                                 sound_priority::high);
             _hit_sound_info.reset();
         }
 
@@ -280,21 +308,24 @@ public:
         if (_step_sound_active) {
             float period = 65.f / (std::abs(_collision_box->get_velocity().x) * sim.last_speed());
             if (_step_sound_timer.getElapsedTime().asSeconds() > period) {
-                sound_mgr().play("player/step"s + rand_num('0', '2') + ".wav",
+                sound_mgr().play(sounds().step[rand_num<size_t>(0, sounds().step.size() - 1)],
                                  _group,
                                  get_position() - cam_position,
-                                 sim.last_speed());
+                                 sim.last_speed(),
+                                 100.f,
+                                 sound_priority::low);
                 _step_sound_timer.restart();
             }
         }
         if (_fall_velocity) {
             auto volume = inverse_lerp(0.f, 1800.f, std::clamp(*_fall_velocity, 0.f, 1800.f));
             volume *= volume * 100.f;
-            sound_mgr().play("player/fall"s + rand_num('0', '1') + ".wav",
+            sound_mgr().play(sounds().fall[rand_num<size_t>(0, sounds().fall.size() - 1)],
                              _group,
                              get_position() - cam_position,
                              sim.last_speed(),
-                             volume);
+                             volume,
+                             sound_priority::low);
             _fall_velocity.reset();
         }
 
@@ -650,6 +681,13 @@ public:
     }
 
     void set_from_config() {
+        auto& snds = sounds();
+        std::vector<sound_id> bank{snds.headshot};
+        bank.insert(bank.end(), snds.bullethit.begin(), snds.bullethit.end());
+        bank.insert(bank.end(), snds.step.begin(), snds.step.end());
+        bank.insert(bank.end(), snds.fall.begin(), snds.fall.end());
+        sound_mgr().preload_bank("player", std::move(bank));
+
         player_configurator pc{_name};
         set_body(pc.body_texture_path(), pc.body_color);
         set_face(pc.face_texture_path());
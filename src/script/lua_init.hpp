@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lua.hpp"
+#include "base/asset_pack.hpp"
 
 #include "typeinit/vec2f_init.hpp"
 #include "typeinit/game_state_init.hpp"
@@ -41,7 +42,9 @@ void luactx_mgr::load() {
         auto dir = fs::current_path() / "data/scripts";
         auto fullpath = (dir / (file_name + ".lua")).string();
 
-        _ctx->load_and_call(fullpath.data());
+        /* The entry script may come from the asset pack; modules are still required from loose files */
+        auto script = asset_file(fullpath);
+        _ctx->load_and_call(luacpp::lua_code{std::string(script.begin(), script.end())});
         loaded = true;
 
         auto ofd = std::ofstream(dir / (assist_file_name + ".lua"));
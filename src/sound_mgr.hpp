@@ -1,67 +1,277 @@
 #pragma once
 
 #include <map>
+#include <deque>
 #include <string>
 #include <filesystem>
-#include <list>
+#include <thread>
+#include <condition_variable>
 
 #include <SFML/Audio/SoundBuffer.hpp>
 #include <SFML/Audio/Sound.hpp>
+#include <SFML/Audio/InputSoundFile.hpp>
 
+#include "base/asset_pack.hpp"
 #include "base/log.hpp"
 #include "base/vec2.hpp"
+#include "base/vec_math.hpp"
+#include "base/signals.hpp"
 
 namespace dfdh {
 
 namespace fs = std::filesystem;
 
+/* Handle of the registered sound */
+using sound_id = u32;
+
+namespace sound_priority {
+    inline constexpr float low      = 0.5f;
+    inline constexpr float normal   = 1.f;
+    inline constexpr float high     = 1.5f;
+    inline constexpr float critical = 2.f;
+}
+
+inline fs::path sound_path(std::string_view path) {
+    return fs::current_path() / "data/sounds" / path;
+}
+
+/* Decodes sound files on the background thread.
+ * Decoded samples are uploaded to sf::SoundBuffer by the owner on the main thread */
+class sound_decoder {
+public:
+    struct decoded_t {
+        u32                    id;
+        bool                   ok = false;
+        std::vector<sf::Int16> samples;
+        unsigned               channels    = 0;
+        unsigned               sample_rate = 0;
+    };
+
+    sound_decoder() = default;
+
+    ~sound_decoder() {
+        {
+            std::lock_guard lock{mtx};
+            work = false;
+        }
+        cv.notify_one();
+        if (thread.joinable())
+            thread.join();
+    }
+
+    sound_decoder(const sound_decoder&) = delete;
+    sound_decoder& operator=(const sound_decoder&) = delete;
+
+    void push(u32 id, std::string path) {
+        {
+            std::lock_guard lock{mtx};
+            if (!thread.joinable())
+                thread = std::thread(&sound_decoder::worker, this);
+            queue.emplace_back(id, std::move(path));
+        }
+        cv.notify_one();
+    }
+
+    void take_decoded(std::vector<decoded_t>& result) {
+        std::lock_guard lock{mtx};
+        std::move(decoded.begin(), decoded.end(), std::back_inserter(result));
+        decoded.clear();
+    }
+
+    static decoded_t decode(u32 id, const std::string& path) {
+        decoded_t          result;
+        result.id = id;
+        auto asset = asset_file::try_open(sound_path(path));
+        if (!asset)
+            return result;
+
+        sf::InputSoundFile file;
+        if (!file.openFromMemory(asset->data(), asset->size()))
+            return result;
+
+        result.samples.resize(size_t(file.getSampleCount()));
+        result.channels    = file.getChannelCount();
+        result.sample_rate = file.getSampleRate();
+        result.ok          = file.read(result.samples.data(), result.samples.size()) == result.samples.size();
+        return result;
+    }
+
+private:
+    void worker() {
+        std::unique_lock lock{mtx};
+        while (true) {
+            cv.wait(lock, [this] { return !work || !queue.empty(); });
+            if (!work)
+                break;
+
+            auto [id, path] = std::move(queue.front());
+            queue.pop_front();
+
+            lock.unlock();
+            auto result = decode(id, path);
+            lock.lock();
+
+            decoded.push_back(std::move(result));
+        }
+    }
+
+private:
+    std::deque<std::pair<u32, std::string>> queue;
+    std::vector<decoded_t>                  decoded;
+    std::mutex                              mtx;
+    std::condition_variable                 cv;
+    bool                                    work = true;
+    std::thread                             thread;
+};
+
 class sound_mgr_singleton {
 public:
-    static constexpr size_t max_sounds    = 128;
+    static constexpr size_t max_voices    = 128;
     static constexpr float  position_coef = 0.0002f;
 
+    struct stats_t {
+        u64 plays              = 0;
+        u64 voice_reuses       = 0;
+        u64 voice_steals       = 0;
+        u64 dropped            = 0;
+        /* Plays by path of the sound which was not registered before (allocating path) */
+        u64 lazy_registrations = 0;
+        /* Voices switched to another buffer: SFML adds the voice to the sound set of the buffer,
+         * which may allocate. The other plays do not allocate in sound_mgr; the allocations of
+         * SFML are counted under the "sound" tag of 'profiler alloc' in the --alloc-tracking build */
+        u64 buffer_switches    = 0;
+
+        /* Sounds played before the background decoder finished them (loaded on the main thread) */
+        u64                      sync_loads     = 0;
+        std::chrono::nanoseconds sync_load_time = 0ns;
+        u64                      first_plays    = 0;
+        std::chrono::nanoseconds first_play_max = 0ns;
+        std::chrono::nanoseconds bank_ready_max = 0ns;
+    };
+
     static sound_mgr_singleton& instance() {
         static sound_mgr_singleton inst;
         return inst;
     }
 
-    sf::Sound& get(std::string path, int id) {
-        auto [sound_pos, was_insert] = sounds.emplace(sound_key{path, id}, sound_data_t{});
-        if (was_insert) {
-            auto [sample_pos, was_insert] = samples.emplace(path, sf::SoundBuffer{});
-            if (was_insert &&
-                !sample_pos->second.loadFromFile(std::filesystem::current_path() / "data/sounds" / path)) {
-                if (path == "dummy.wav")
-                    throw std::runtime_error("Sound "s +
-                                             (std::filesystem::current_path() / "dummy.wav does not exists").string());
-                glog().error("Cannot load sound file: {}", path);
-                samples.erase(sample_pos);
-                sounds.erase(sound_pos);
-                return get("dummy.wav", id);
-            }
+    /* Registers the sound once and returns its handle.
+     * The sound is decoded on the background thread; unloadable sounds are replaced with dummy.wav */
+    sound_id register_sound(std::string_view path) {
+        auto [id, inserted] = emplace_sample(path);
+        if (inserted)
+            decoder.push(id, std::string(path));
+        return id;
+    }
+
+    /* Registers the sound decoded elsewhere (startup asset pipeline). Must be called from the main thread */
+    sound_id register_decoded(std::string_view path, const sound_decoder::decoded_t& decoded) {
+        auto id = emplace_sample(path).first;
+        upload(samples[id], decoded);
+        return id;
+    }
+
+    template <size_t N>
+    std::array<sound_id, N> register_sounds(const std::array<std::string_view, N>& paths) {
+        std::array<sound_id, N> result;
+        for (size_t i = 0; i < N; ++i) result[i] = register_sound(paths[i]);
+        return result;
+    }
+
+    /* Loads sounds in the background and emits sig_bank_ready(name) from update() when all of them are loaded */
+    void preload_bank(const std::string& name, std::vector<sound_id> bank_ids) {
+        auto& bank = banks.insert_or_assign(name, bank_t{std::move(bank_ids), std::chrono::steady_clock::now()})
+                         .first->second;
+        if (bank_ready(bank))
+            finish_bank(banks.find(name));
+    }
+
+    /* Uploads decoded sounds and emits signals for finished banks. Must be called from the main thread */
+    void update() {
+        decoder.take_decoded(decoded);
+        for (auto& d : decoded) upload(samples[d.id], d);
+        decoded.clear();
+
+        for (auto i = banks.begin(); i != banks.end();) {
+            auto next = std::next(i);
+            if (bank_ready(i->second))
+                finish_bank(i);
+            i = next;
+        }
+    }
 
-            if (sounds.size() == max_sounds) {
-                sounds.erase(sound_use.back());
-                sound_use.pop_back();
+    /* Plays the sound in the voice pool.
+     * The same sound of the same group restarts in its voice, otherwise a free voice is taken.
+     * If all voices are busy, the voice with the lowest (priority * distance attenuation) is stolen */
+    void play(sound_id id,
+              int      group,
+              vec2f    cam_relative_position,
+              float    pitch,
+              float    volume   = 100.f,
+              float    priority = sound_priority::normal) {
+        DFDH_ALLOC_SCOPE(sound);
+        ++_stats.plays;
+
+        auto& sample = samples[id];
+        if (!sample.played) {
+            auto start_time = std::chrono::steady_clock::now();
+            ensure_loaded(id);
+            sample.played = true;
+
+            ++_stats.first_plays;
+            _stats.first_play_max = std::max(
+                _stats.first_play_max,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_time));
+        }
+
+        auto score = play_score(cam_relative_position, volume, priority);
+
+        voice_t* free_voice = nullptr;
+        voice_t* victim     = nullptr;
+        for (auto& v : voices) {
+            if (v.id == id && v.group == group) {
+                ++_stats.voice_reuses;
+                start(v, id, group, cam_relative_position, pitch, volume, score);
+                return;
             }
 
-            sound_use.push_front({path, id});
-            sound_pos->second.sound.setBuffer(sample_pos->second);
-            sound_pos->second.use_i = sound_use.begin();
+            if (!free_voice) {
+                if (v.sound.getStatus() == sf::Sound::Stopped)
+                    free_voice = &v;
+                else if (!victim || v.score < victim->score)
+                    victim = &v;
+            }
         }
 
-        auto& snd = sound_pos->second;
-        if (snd.use_i != sound_use.begin())
-            sound_use.splice(sound_use.begin(), sound_use, snd.use_i, std::next(snd.use_i));
-        return snd.sound;
+        if (free_voice) {
+            start(*free_voice, id, group, cam_relative_position, pitch, volume, score);
+        }
+        else if (victim && victim->score <= score) {
+            ++_stats.voice_steals;
+            victim->sound.stop();
+            start(*victim, id, group, cam_relative_position, pitch, volume, score);
+        }
+        else {
+            ++_stats.dropped;
+        }
     }
 
-    void play(const std::string& path, int id, vec2f cam_relative_position, float pitch, float volume = 100.f) {
-        auto& snd = get(path, id);
-        snd.setPosition({cam_relative_position.x * position_coef, cam_relative_position.y * position_coef, 0.1f});
-        snd.setPitch(pitch);
-        snd.setVolume(volume * (volume_level * 0.01f));
-        snd.play();
+    void play(std::string_view path,
+              int              group,
+              vec2f            cam_relative_position,
+              float            pitch,
+              float            volume   = 100.f,
+              float            priority = sound_priority::normal) {
+        DFDH_ALLOC_SCOPE(sound);
+        auto found = ids.find(path);
+        sound_id id;
+        if (found != ids.end()) {
+            id = found->second;
+        }
+        else {
+            ++_stats.lazy_registrations;
+            id = register_sound(path);
+        }
+        play(id, group, cam_relative_position, pitch, volume, priority);
     }
 
     sound_mgr_singleton(const sound_mgr_singleton&) = delete;
@@ -75,26 +285,162 @@ public:
         volume_level = value;
     }
 
+    [[nodiscard]]
+    const stats_t& stats() const {
+        return _stats;
+    }
+
+    [[nodiscard]]
+    size_t active_voices() const {
+        size_t count = 0;
+        for (auto& v : voices) count += v.sound.getStatus() != sf::Sound::Stopped;
+        return count;
+    }
+
+    [[nodiscard]]
+    size_t registered_count() const {
+        return samples.size();
+    }
+
+    [[nodiscard]]
+    size_t loaded_count() const {
+        size_t count = 0;
+        for (auto& s : samples) count += s.loaded;
+        return count;
+    }
+
+    signal<void(const std::string&)> sig_bank_ready;
+
 private:
     sound_mgr_singleton() = default;
     ~sound_mgr_singleton() = default;
 
-    struct sound_key {
-        std::string path;
-        int         id;
-        auto operator<=>(const sound_key&) const = default;
+    static constexpr sound_id no_sound = std::numeric_limits<sound_id>::max();
+
+    struct sample_t {
+        sf::SoundBuffer buffer;
+        std::string     path;
+        bool            loaded = false;
+        bool            played = false;
     };
 
-    struct sound_data_t {
-        sf::Sound                      sound;
-        std::list<sound_key>::iterator use_i;
+    struct bank_t {
+        std::vector<sound_id>                 ids;
+        std::chrono::steady_clock::time_point start;
     };
 
+    bool bank_ready(const bank_t& bank) const {
+        for (auto id : bank.ids)
+            if (!samples[id].loaded)
+                return false;
+        return true;
+    }
+
+    void finish_bank(std::map<std::string, bank_t>::iterator bank) {
+        auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                         bank->second.start);
+        _stats.bank_ready_max = std::max(_stats.bank_ready_max, time);
+        glog().debug("sound bank {} ready: {} sounds in {}", bank->first, bank->second.ids.size(), time);
+
+        auto name = bank->first;
+        banks.erase(bank);
+        sig_bank_ready.emit_immediate(name);
+    }
+
+    void load_dummy(sample_t& sample) {
+        glog().error("Cannot load sound file: {}", sample.path);
+        auto asset = asset_file::try_open(sound_path("dummy.wav"));
+        if (!asset || !sample.buffer.loadFromMemory(asset->data(), asset->size()))
+            throw std::runtime_error("Sound "s + sound_path("dummy.wav").string() + " does not exists");
+        sample.loaded = true;
+    }
+
+    std::pair<sound_id, bool> emplace_sample(std::string_view path) {
+        auto found = ids.find(path);
+        if (found != ids.end())
+            return {found->second, false};
+
+        auto id = sound_id(samples.size());
+        samples.emplace_back().path = path;
+        ids.emplace(std::string(path), id);
+        return {id, true};
+    }
+
+    void upload(sample_t& sample, const sound_decoder::decoded_t& decoded) {
+        if (sample.loaded)
+            return;
+
+        if (!decoded.ok ||
+            !sample.buffer.loadFromSamples(
+                decoded.samples.data(), decoded.samples.size(), decoded.channels, decoded.sample_rate)) {
+            load_dummy(sample);
+            return;
+        }
+        sample.loaded = true;
+    }
+
+    /* Finishes loading on the main thread if the decoder didn't make it in time */
+    void ensure_loaded(sound_id id) {
+        auto& sample = samples[id];
+        if (sample.loaded)
+            return;
+
+        update();
+        if (sample.loaded)
+            return;
+
+        auto start_time = std::chrono::steady_clock::now();
+        auto asset = asset_file::try_open(sound_path(sample.path));
+        if (asset && sample.buffer.loadFromMemory(asset->data(), asset->size()))
+            sample.loaded = true;
+        else
+            load_dummy(sample);
+
+        ++_stats.sync_loads;
+        _stats.sync_load_time += std::chrono::steady_clock::now() - start_time;
+    }
+
+    struct voice_t {
+        sf::Sound sound;
+        sound_id  id    = no_sound;
+        int       group = 0;
+        float     score = 0.f;
+    };
+
+    static float play_score(const vec2f& cam_relative_position, float volume, float priority) {
+        return priority * volume * 0.01f / (1.f + magnitude(cam_relative_position) * position_coef);
+    }
+
+    void start(voice_t&     v,
+               sound_id     id,
+               int          group,
+               const vec2f& cam_relative_position,
+               float        pitch,
+               float        volume,
+               float        score) {
+        if (v.id != id) {
+            ++_stats.buffer_switches;
+            v.sound.setBuffer(samples[id].buffer);
+            v.id = id;
+        }
+        v.group = group;
+        v.score = score;
+        v.sound.setPosition({cam_relative_position.x * position_coef, cam_relative_position.y * position_coef, 0.1f});
+        v.sound.setPitch(pitch);
+        v.sound.setVolume(volume * (volume_level * 0.01f));
+        v.sound.play();
+    }
+
 private:
-    std::map<std::string, sf::SoundBuffer> samples;
-    std::map<sound_key, sound_data_t>      sounds;
-    std::list<sound_key>                   sound_use;
-    float                                  volume_level = 100.f;
+    /* Deque keeps buffers in place, voices hold pointers to them */
+    std::deque<sample_t>                          samples;
+    std::map<std::string, sound_id, std::less<>> ids;
+    std::map<std::string, bank_t>                 banks;
+    std::vector<sound_decoder::decoded_t>         decoded;
+    std::array<voice_t, max_voices>               voices;
+    stats_t                                       _stats;
+    float                                         volume_level = 100.f;
+    sound_decoder                                 decoder;
 };
 
 inline sound_mgr_singleton& sound_mgr() {
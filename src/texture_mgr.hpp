@@ -4,8 +4,10 @@
 #include <string>
 #include <filesystem>
 
+#include <SFML/Graphics/Image.hpp>
 #include <SFML/Graphics/Texture.hpp>
 
+#include "base/asset_pack.hpp"
 #include "base/log.hpp"
 
 namespace dfdh {
@@ -17,11 +19,31 @@ public:
         return inst;
     }
 
+    static std::string full_path(const std::string& path) {
+        return std::filesystem::current_path() / "data/textures" / path;
+    }
+
     sf::Texture& load(const std::string& path) {
-        auto p = std::string(std::filesystem::current_path() / "data/textures" / path);
+        auto p = full_path(path);
+        auto [pos, was_insert] = _textures.emplace(p, sf::Texture());
+        if (was_insert) {
+            auto asset = asset_file::try_open(p);
+            if (!asset || !pos->second.loadFromMemory(asset->data(), asset->size())) {
+                glog().error("Cannot load texture {}", p);
+                _textures.erase(pos);
+                return _textures.emplace("!!/dummy/!!", sf::Texture()).first->second;
+            }
+            pos->second.setSmooth(true);
+        }
+        return pos->second;
+    }
+
+    /* Uploads the image decoded elsewhere (startup asset pipeline); does nothing if the texture is already loaded */
+    sf::Texture& load(const std::string& path, const sf::Image& image) {
+        auto p = full_path(path);
         auto [pos, was_insert] = _textures.emplace(p, sf::Texture());
         if (was_insert) {
-            if (!pos->second.loadFromFile(p)) {
+            if (!pos->second.loadFromImage(image)) {
                 glog().error("Cannot load texture {}", p);
                 _textures.erase(pos);
                 return _textures.emplace("!!/dummy/!!", sf::Texture()).first->second;
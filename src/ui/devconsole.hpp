@@ -1,5 +1,7 @@
 #pragma once
 
+#include <deque>
+
 #include "base/log.hpp"
 #include "base/vec2.hpp"
 #include "nuklear.hpp"
@@ -92,29 +94,19 @@ public:
             sf::Color(255, 56, 56)
         };
 
-        static constexpr std::string_view level_str[] = {
-            ": [debug] "sv,
-            ": "sv,
-            ": [info] "sv,
-            ": [warn] "sv,
-            ": [error] "sv
-        };
+        sync_output();
 
-        auto scroll_rows      = scroll.y / uint(_row_height + 4.f);
-        auto max_content_rows = uint(content_h / (_row_height + 4.f));
-        auto row_padding      = content_h - (float(max_content_rows) * (_row_height + 4.f));
+        auto row_step         = _row_height + 4.f;
+        auto max_content_rows = size_t(content_h / row_step);
+        auto row_padding      = content_h - (float(max_content_rows) * row_step);
         row_padding           = std::clamp(row_padding, 1.f, 100.f);
 
-        auto records = log_ring->get_records(scroll_rows, max_content_rows + 1);
-
-        auto front_space_rows = records.start_pos() == 0 && records.end_pos() < max_content_rows
-                                    ? max_content_rows - records.end_pos()
-                                    : records.start_pos();
-        auto records_rows     = records.end_pos() - records.start_pos();
-        auto back_space_rows  = records.max_pos() - records.end_pos();
+        /* Lines are pushed to the bottom if they don't fill the whole output */
+        auto lines_count      = output_lines_count();
+        auto front_space_rows = lines_count < max_content_rows ? max_content_rows - lines_count : 0;
 
-        size_t total_rows   = front_space_rows + records_rows + back_space_rows;
-        float  total_height = row_padding + float(total_rows) * (_row_height + 4.f);
+        size_t total_rows   = front_space_rows + lines_count;
+        float  total_height = row_padding + float(total_rows) * row_step;
 
         auto max_scroll = total_height > content_h ? uint(total_height - content_h - 1) : 0;
         if (max_scroll_reached && (total_rows > prev_total_rows || max_scroll > prev_max_scroll))
@@ -124,49 +116,34 @@ public:
         prev_total_rows    = total_rows;
         max_scroll_reached = max_scroll == scroll.y;
 
-        /* Make ui */
+        auto first_row = std::min(size_t(float(scroll.y) / row_step), total_rows);
+        auto last_row  = std::min(first_row + max_content_rows + 1, total_rows);
+
+        /* Make ui: only visible rows are emitted, invisible ones are replaced with a single spacing */
         if (ui().group_scrolled_begin(&scroll, "devconsole_output", NK_WINDOW_BORDER)) {
-            ui().layout_row_dynamic(row_padding, 1);
-            ui().layout_row_dynamic(_row_height, 1);
+            ui().layout_row_dynamic(row_padding + float(first_row) * row_step, 1);
+            ui().spacing(1);
 
-            for (size_t i = 0; i < front_space_rows; ++i) ui().spacing(1);
-            for (auto& record : records) {
-                std::string msg;
-                if (_show_time)
-                    msg += record.time;
-                if (record.wt == log_acceptor_base::write_type::write_same && record.times > 1) {
-                    if (_show_level || _show_time)
-                        msg += ' ';
-                    if (record.times != std::numeric_limits<uint16_t>::max()) {
-                        msg += '(';
-                        msg += std::to_string(record.times);
-                        msg += " times)";
-                    }
-                    else {
-                        msg += "(repeats infinitely)";
-                    }
+            ui().layout_row_dynamic(_row_height, 1);
+            _wrap_columns = measure_columns(ui().layout_widget_bounds().w);
 
-                    if (!_show_level)
-                        msg += ' ';
+            for (auto row = first_row; row < last_row; ++row) {
+                if (row < front_space_rows) {
+                    ui().spacing(1);
+                    continue;
                 }
-                if (_show_level)
-                    msg += level_str[size_t(record.lvl)];
-                msg += record.msg;
 
-                ui().text_colored(msg.data(), int(msg.size()), NK_TEXT_LEFT, level_colors[size_t(record.lvl)]);
+                auto [entry, line] = output_line(row - front_space_rows);
+                ui().text_colored(line.data(), int(line.size()), NK_TEXT_LEFT, level_colors[size_t(entry->lvl)]);
+            }
+
+            if (last_row < total_rows) {
+                ui().layout_row_dynamic(float(total_rows - last_row) * row_step - 4.f, 1);
+                ui().spacing(1);
             }
-            for (size_t i = records.end_pos(); i < records.max_pos(); ++i) ui().spacing(1);
 
             ui().group_scrolled_end();
         }
-        /*
-        printfln("scroll: {} max scroll: {} reached: {} th: {} h: {}",
-                 scroll.y,
-                 max_scroll,
-                 max_scroll_reached,
-                 total_height,
-                 content_h);
-        */
     }
 
     void update() final {
@@ -326,6 +303,7 @@ public:
     }
 
     void show_time(bool value = true) {
+        _output_dirty |= _show_time != value;
         _show_time = value;
     }
 
@@ -335,6 +313,7 @@ public:
     }
 
     void show_level(bool value = true) {
+        _output_dirty |= _show_level != value;
         _show_level = value;
     }
 
@@ -357,6 +336,151 @@ public:
         log_ring->max_size(value);
     }
 
+private:
+    struct output_entry {
+        uint64_t          revision;
+        uint64_t          first_line;
+        string_arena::ref text;
+        u32               lines_count;
+        log_level         lvl;
+    };
+
+    [[nodiscard]]
+    uint measure_columns(float width) const {
+        auto font  = ui().nk_ctx()->style.font;
+        auto glyph = font->width(font->userdata, font->height, "0", 1);
+        return glyph > 0.f ? uint(std::max(width / glyph, 1.f)) : 0;
+    }
+
+    [[nodiscard]]
+    size_t output_lines_count() const {
+        if (_output.empty())
+            return 0;
+        return _output.back().first_line + _output.back().lines_count - _output.front().first_line;
+    }
+
+    static bool is_utf8_continuation(char c) {
+        return (u8(c) & 0xc0) == 0x80;
+    }
+
+    /* Returns the wrapped line with the specified index (counting from the first cached line) */
+    std::pair<const output_entry*, std::string_view> output_line(size_t idx) const {
+        auto abs_line = _output.front().first_line + idx;
+        auto entry    = std::ranges::upper_bound(_output, abs_line, {}, &output_entry::first_line) - 1;
+        auto text     = _output_arena.view(entry->text);
+
+        if (_output_columns == 0)
+            return {&*entry, text};
+
+        auto skip_cp = (abs_line - entry->first_line) * _output_columns;
+        auto b       = text.begin();
+        for (size_t cp = 0; b != text.end(); ++b)
+            if (!is_utf8_continuation(*b) && cp++ == skip_cp)
+                break;
+
+        auto e = b;
+        for (size_t cp = 0; e != text.end(); ++e)
+            if (!is_utf8_continuation(*e) && cp++ == _output_columns)
+                break;
+
+        return {&*entry, std::string_view(b, e)};
+    }
+
+    void compose_record(const log_acceptor_ring_buffer::reader& rd, const log_acceptor_ring_buffer::record& rec) {
+        static constexpr std::string_view level_str[] = {
+            ": [debug] "sv,
+            ": "sv,
+            ": [info] "sv,
+            ": [warn] "sv,
+            ": [error] "sv
+        };
+
+        _compose_buf.clear();
+        if (_show_time)
+            _compose_buf += rd.time(rec);
+        if (rec.wt == log_acceptor_base::write_type::write_same && rec.times > 1) {
+            if (_show_level || _show_time)
+                _compose_buf += ' ';
+            if (rec.times != std::numeric_limits<uint16_t>::max()) {
+                _compose_buf += '(';
+                _compose_buf += std::to_string(rec.times);
+                _compose_buf += " times)";
+            }
+            else {
+                _compose_buf += "(repeats infinitely)";
+            }
+
+            if (!_show_level)
+                _compose_buf += ' ';
+        }
+        if (_show_level)
+            _compose_buf += level_str[size_t(rec.lvl)];
+        _compose_buf += rd.msg(rec);
+    }
+
+    void pop_output_front() {
+        _output_arena.release(_output.front().text);
+        _output.pop_front();
+        ++_output_first_index;
+    }
+
+    void pop_output_back() {
+        _output_arena.release(_output.back().text);
+        _output.pop_back();
+    }
+
+    /* Wraps new and changed records from the log ring.
+     * Lines of unchanged records are cached until the wrap width or the output format changes */
+    void sync_output() {
+        auto rd = log_ring->read();
+
+        if (_wrap_columns != _output_columns) {
+            _output_columns = _wrap_columns;
+            _output_dirty   = true;
+        }
+
+        if (!_output_dirty && rd.revision() == _output_revision)
+            return;
+
+        if (_output_dirty) {
+            _output.clear();
+            _output_arena.clear();
+            _output_dirty = false;
+        }
+
+        /* Drop records evicted from the ring */
+        while (!_output.empty() && _output_first_index < rd.first_index()) pop_output_front();
+        if (_output.empty())
+            _output_first_index = rd.first_index();
+
+        /* Drop records popped from the ring and records changed since the last sync (always a tail) */
+        auto ring_offset = size_t(_output_first_index - rd.first_index());
+        while (!_output.empty() && ring_offset + _output.size() > rd.size()) pop_output_back();
+        while (!_output.empty() && rd[ring_offset + _output.size() - 1].revision > _output_revision)
+            pop_output_back();
+
+        for (auto i = ring_offset + _output.size(); i < rd.size(); ++i) {
+            auto& rec = rd[i];
+            compose_record(rd, rec);
+
+            size_t codepoints = 0;
+            for (auto c : _compose_buf) codepoints += !is_utf8_continuation(c);
+
+            auto lines_count = _output_columns == 0 ? 1 : (codepoints + _output_columns - 1) / _output_columns;
+            auto first_line  = _output.empty() ? 0 : _output.back().first_line + _output.back().lines_count;
+
+            _output.push_back(output_entry{
+                rec.revision, first_line, _output_arena.push(_compose_buf), u32(std::max(lines_count, 1UL)), rec.lvl});
+        }
+
+        if (_output_arena.compaction_required())
+            _output_arena.compact([this](auto&& rebind) {
+                for (auto& entry : _output) rebind(entry.text);
+            });
+
+        _output_revision = rd.revision();
+    }
+
 private:
     log_acceptor_ring_buffer* log_ring;
     ring_buffer<std::string>  _history{HISTORY_LEN};
@@ -377,6 +501,15 @@ private:
     int                               _command_len = 0;
 
     std::optional<std::string>        _last_help;
+
+    std::deque<output_entry> _output;
+    string_arena             _output_arena;
+    std::string              _compose_buf;
+    uint64_t                 _output_first_index = 0;
+    uint64_t                 _output_revision    = 0;
+    uint                     _output_columns     = 0;
+    uint                     _wrap_columns       = 0;
+    bool                     _output_dirty       = true;
 };
 
 } // namespace dfdh
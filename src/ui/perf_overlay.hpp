@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cmath>
+
+#include "base/perf_counters.hpp"
+#include "base/print.hpp"
+#include "base/profiler.hpp"
+#include "basic_view.hpp"
+
+namespace dfdh {
+
+/* Frame time and engine loop stage graphs with the counters of the subsystems.
+ * Samples come from the engine loop profiler, counters from the perf_counters snapshot */
+class perf_overlay : public basic_view {
+public:
+    static constexpr size_t history_size = 180;
+
+    struct stage_t {
+        const char*                     name;
+        sf::Color                       color;
+        profiler_scope_id               id      = {};
+        std::array<float, history_size> history = {};
+    };
+
+    perf_overlay(ui_ctx& ui):
+        basic_view(ui,
+                   "performance",
+                   {20.f, 20.f},
+                   {380.f, 540.f},
+                   ui_wnd_opt::title | ui_wnd_opt::border | ui_wnd_opt::movable | ui_wnd_opt::scalable |
+                       ui_wnd_opt::closable | ui_wnd_opt::minimizable) {
+        for (auto& stage : stages) stage.id = profiler::intern(stage.name);
+    }
+
+    void handle_event(const sf::Event& evt) final {
+        if (evt.type == sf::Event::KeyPressed && evt.key.code == sf::Keyboard::F3)
+            toggle();
+    }
+
+    /* Called once per frame after the loop stages */
+    void push_frame(const profiler& loop_prof) {
+        if (!is_active())
+            return;
+
+        auto now = std::chrono::steady_clock::now();
+        frames[pos] = std::chrono::duration<float, std::milli>(now - last_frame).count();
+        last_frame  = now;
+
+        for (auto& stage : stages) {
+            auto time = loop_prof.find(stage.id);
+            stage.history[pos] =
+                time ? std::chrono::duration<float, std::milli>(profiler::ticks_to_duration(time->last)).count() : 0.f;
+        }
+
+        pos    = (pos + 1) % history_size;
+        filled = std::min(filled + 1, history_size);
+    }
+
+    void update() final {
+        auto counters = perf_counters().snapshot();
+
+        float sum = 0.f, max = 0.f;
+        for (size_t i = 0; i < filled; ++i) {
+            sum += frames[i];
+            max = std::max(max, frames[i]);
+        }
+        auto avg = filled ? sum / float(filled) : 0.f;
+
+        text.clear();
+        format_into(text,
+                    "frame: {} ms avg, {} ms max, {} fps",
+                    round2(avg),
+                    round2(max),
+                    avg > 0.f ? int(1000.f / avg) : 0);
+        ui().layout_row_dynamic(20.f, 1);
+        ui().label(text.data(), NK_TEXT_LEFT);
+
+        /* The scale keeps 16.6ms frames in the lower part to show the spikes */
+        auto scale = std::max(33.4f, max);
+        ui().layout_row_dynamic(80.f, 1);
+        if (ui().chart_begin_colored(NK_CHART_LINES, {120, 220, 120}, {255, 255, 255}, int(filled), 0.f, scale)) {
+            for (size_t i = 0; i < filled; ++i) ui().chart_push(frames[index(i)]);
+            ui().chart_end();
+        }
+
+        float stage_max = 0.f;
+        for (auto& stage : stages)
+            for (size_t i = 0; i < filled; ++i) stage_max = std::max(stage_max, stage.history[i]);
+
+        ui().layout_row_dynamic(100.f, 1);
+        if (ui().chart_begin_colored(
+                NK_CHART_LINES, stages[0].color, {255, 255, 255}, int(filled), 0.f, std::max(stage_max, 1.f))) {
+            for (size_t s = 1; s < stages.size(); ++s)
+                ui().chart_add_slot_colored(
+                    NK_CHART_LINES, stages[s].color, {255, 255, 255}, int(filled), 0.f, std::max(stage_max, 1.f));
+
+            for (size_t i = 0; i < filled; ++i)
+                for (size_t s = 0; s < stages.size(); ++s) ui().chart_push_slot(stages[s].history[index(i)], int(s));
+            ui().chart_end();
+        }
+
+        ui().layout_row_dynamic(18.f, 2);
+        for (auto& stage : stages) {
+            text.clear();
+            format_into(text, "{}: {} ms", stage.name, round2(filled ? stage.history[index(filled - 1)] : 0.f));
+            ui().label_colored(text.data(), NK_TEXT_LEFT, stage.color);
+        }
+
+        ui().layout_row_dynamic(20.f, 1);
+        text.clear();
+        format_into(text, "physics: {} primitives, {} pair tests", counters.physic_primitives, counters.physic_pairs);
+        ui().label(text.data(), NK_TEXT_LEFT);
+
+        text.clear();
+        format_into(text, "bullets: {}", counters.bullets);
+        ui().label(text.data(), NK_TEXT_LEFT);
+
+        text.clear();
+        format_into(text,
+                    "ai worker: {}% busy, {} operators",
+                    round2(float(counters.ai_busy_permille) / 10.f),
+                    counters.ai_operators);
+        ui().label(text.data(), NK_TEXT_LEFT);
+
+        text.clear();
+        format_into(text,
+                    "ai snapshot: {} us old, {} us to publish",
+                    counters.ai_snapshot_age_us,
+                    counters.ai_publish_us);
+        ui().label(text.data(), NK_TEXT_LEFT);
+
+        text.clear();
+        if (counters.allocations)
+            format_into(text, "allocations: {} per frame, {} bytes", counters.allocations, counters.allocated_bytes);
+        else
+            text = "allocations: not tracked";
+        ui().label(text.data(), NK_TEXT_LEFT);
+
+        text.clear();
+        format_into(text, "sound voices: {}/{}", counters.sound_voices, counters.sound_max_voices);
+        ui().label(text.data(), NK_TEXT_LEFT);
+    }
+
+    void on_show() final {
+        perf_counters().enable(true);
+        last_frame = std::chrono::steady_clock::now();
+        filled     = 0;
+        pos        = 0;
+    }
+
+    void on_close() final {
+        perf_counters().enable(false);
+    }
+
+    void style_start() final {
+        auto style = &ui().nk_ctx()->style;
+        nk_style_push_color(ui().nk_ctx(), &style->window.background, nk_rgba(20, 20, 20, 180));
+        ui().style_push_style_item(&style->window.fixed_background, nk_style_item_color(nk_rgba(20, 20, 20, 180)));
+    }
+
+    void style_end() final {
+        ui().style_pop_color();
+        ui().style_pop_style_item();
+    }
+
+private:
+    /* The i-th sample from the oldest one */
+    [[nodiscard]]
+    size_t index(size_t i) const {
+        return (pos + history_size - filled + i) % history_size;
+    }
+
+    static float round2(float value) {
+        return std::round(value * 100.f) / 100.f;
+    }
+
+private:
+    std::array<stage_t, 6> stages = {{
+        {"logic", {230, 160, 60}},
+        {"events", {160, 160, 160}},
+        {"ui", {90, 170, 240}},
+        {"render", {220, 90, 90}},
+        {"swapbuffers", {180, 110, 220}},
+        {"commands", {230, 230, 90}},
+    }};
+
+    std::array<float, history_size>       frames = {};
+    size_t                                pos    = 0;
+    size_t                                filled = 0;
+    std::chrono::steady_clock::time_point last_frame;
+    std::string                           text;
+};
+
+} // namespace dfdh
@@ -1,11 +1,15 @@
 #pragma once
 
+#include <fstream>
+
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/Graphics/Sprite.hpp>
 
 #include "base/rand_pool.hpp"
 #include "base/cfg.hpp"
 #include "base/log.hpp"
+#include "base/md5.hpp"
+#include "base/serialization.hpp"
 #include "bullet.hpp"
 #include "texture_mgr.hpp"
 #include "physic/instant_kick.hpp"
@@ -34,25 +38,68 @@ struct weapon_anim_frame {
         vec2f position = {0.f, 0.f};
         vec2f scale    = {1.f, 1.f};
         float angle    = 0.f;
+
+        SS_SERIALIZE(position.x, position.y, scale.x, scale.y, angle)
     };
+};
 
-    std::vector<key_t>         _layers;
-    interpl_type               _intrpl;
-    float                      _time;
+enum class weapon_anim_id : u32 {
+    shot = 0,
+    reload,
+    load_start,
+    shell,
+    load_end,
+    count
 };
 
+inline constexpr std::array<std::string_view, size_t(weapon_anim_id::count)> weapon_anim_names = {
+    "shot", "reload", "load_start", "shell", "load_end"};
+
+inline std::optional<weapon_anim_id> weapon_anim_id_from_str(std::string_view name) {
+    for (size_t i = 0; i < weapon_anim_names.size(); ++i)
+        if (weapon_anim_names[i] == name)
+            return weapon_anim_id(i);
+    return {};
+}
+
+inline std::string_view weapon_anim_name(weapon_anim_id id) {
+    return weapon_anim_names[size_t(id)];
+}
+
 struct weapon_anim_sound_key {
-    std::string sound;
+    std::string path;
     u32         frame;
     float       time;
+    /* Resolved after loading, not cached */
+    sound_id    sound = 0;
+
+    SS_SERIALIZE(path, frame, time)
 };
 
+/* Compiled animation: the keys of frame f are _keys[f * _layers_count, (f + 1) * _layers_count) */
 struct weapon_anim {
-    std::vector<weapon_anim_frame>     _frames;
-    std::vector<weapon_anim_sound_key> _sounds;
-    float                              _duration;
+    std::vector<float>                           _times;
+    std::vector<weapon_anim_frame::interpl_type> _intrpl;
+    std::vector<weapon_anim_frame::key_t>        _keys;
+    std::vector<weapon_anim_sound_key>           _sounds;
+    u32                                          _layers_count = 0;
+    float                                        _duration     = 0.f;
+
+    [[nodiscard]]
+    size_t frames_count() const {
+        return _times.size();
+    }
+
+    [[nodiscard]]
+    const weapon_anim_frame::key_t* frame_keys(size_t frame) const {
+        return _keys.data() + frame * _layers_count;
+    }
+
+    SS_SERIALIZE(_times, _intrpl, _keys, _sounds, _layers_count, _duration)
 };
 
+using weapon_animations = std::array<std::optional<weapon_anim>, size_t(weapon_anim_id::count)>;
+
 class weapon {
 public:
     friend class weapon_instance;
@@ -120,7 +167,7 @@ public:
         _wpn_class       = weapon_class_from_str(sect.value<std::string>("class"));
         _bullet_vel_tier = sect.value<u32>("bullet_velocity_tier");
         _long_shot_angle = sect.value<float>("long_shot_angle");
-        _shot_snd_path   = sect.value_or_default("shot_sound", "none"s);
+        _shot_snd        = sound_mgr().register_sound(sect.value_or_default("shot_sound", "none"s));
         _mass            = sect.value_or_default("mass", 0.5f);
 
         if (_eject_shell) {
@@ -178,6 +225,16 @@ public:
         reload_layers();
     }
 
+    /* All sounds the weapon can play: shot and animation sounds */
+    [[nodiscard]]
+    std::vector<sound_id> sound_ids() const {
+        std::vector<sound_id> result{_shot_snd};
+        for (auto& anim : _animations)
+            if (anim)
+                for (auto& snd : anim->_sounds) result.push_back(snd.sound);
+        return result;
+    }
+
      [[nodiscard]]
     vec2f arm_position_factors(bool lefty) const {
             return lefty ? vec2f{1.f - _arm_pos_f.x, _arm_pos_f.y} : _arm_pos_f;
@@ -202,19 +259,89 @@ public:
     }
 
 private:
-    static std::map<std::string, weapon_anim> load_animations(const std::vector<sf::Sprite>& layers,
-                                                              const std::string&             section) {
-        decltype(_animations) new_animations;
+    static constexpr u32 anim_cache_version = 1;
+
+    static fs::path anim_cache_path(const std::string& section) {
+        return fs::current_path() / "data/cache/anim" / (section + ".bin");
+    }
 
+    /* Compiled animations are cached on disk and validated by the MD5 of the source sections */
+    static weapon_animations load_animations(const std::vector<sf::Sprite>& layers, const std::string& section) {
         auto anims = cfg::global().get_section(section).get<std::vector<std::string>>("animations").value();
 
         if (anims.empty())
             throw cfg_exception("Weapon " + section + " must have at least one animation");
 
-        for (auto& anim : anims)
-            new_animations.emplace(anim, load_anim(layers, section + "_" += anim));
+        auto source = format("{} {}\n", anim_cache_version, layers.size());
+        for (auto& anim : anims) {
+            source += anim;
+            if (auto sect = cfg::global().try_get_section(cfg_section_name(section + "_" + anim)))
+                source += format("{}", *sect);
+            source += '\n';
+        }
+        auto source_hash = md5(source);
+
+        auto new_animations = load_anim_cache(section, source_hash);
+        if (!new_animations) {
+            new_animations.emplace();
+            for (auto& anim : anims) {
+                auto id = weapon_anim_id_from_str(anim);
+                if (!id)
+                    throw cfg_exception("Weapon " + section + " has unknown animation " + anim);
+                (*new_animations)[size_t(*id)] = load_anim(layers, section + "_" += anim);
+            }
+            save_anim_cache(section, source_hash, *new_animations);
+        }
+
+        for (auto& anim : *new_animations)
+            if (anim)
+                for (auto& snd : anim->_sounds) snd.sound = sound_mgr().register_sound(snd.path);
+
+        return std::move(*new_animations);
+    }
 
-        return new_animations;
+    static std::optional<weapon_animations> load_anim_cache(const std::string& section, const md5_hash& source_hash) {
+        auto path = anim_cache_path(section);
+        std::error_code ec;
+        if (!fs::exists(path, ec))
+            return {};
+
+        try {
+            auto              data = file_view<char>(path.string().data());
+            ss::deserializer  ds{std::span(data.data(), data.size())};
+            md5_hash          hash;
+            weapon_animations result;
+            ds.read(hash.lo, hash.hi);
+            if (hash != source_hash)
+                return {};
+            for (auto& anim : result) {
+                ds.read(anim);
+                if (anim && (anim->_keys.size() != anim->frames_count() * anim->_layers_count ||
+                             anim->_intrpl.size() != anim->frames_count()))
+                    throw std::runtime_error("inconsistent frames");
+            }
+            return result;
+        }
+        catch (const std::exception& e) {
+            glog().warn("Animation cache for [{}] is broken: {}", section, e.what());
+            return {};
+        }
+    }
+
+    static void save_anim_cache(const std::string&       section,
+                                const md5_hash&          source_hash,
+                                const weapon_animations& animations) {
+        std::vector<char> data;
+        ss::serializer    s{data};
+        s.write(source_hash.lo, source_hash.hi);
+        for (auto& anim : animations) s.write(anim);
+
+        auto path = anim_cache_path(section);
+        std::error_code ec;
+        fs::create_directories(path.parent_path(), ec);
+        auto ofs = std::ofstream(path, std::ios::binary | std::ios::trunc);
+        if (!ofs.write(data.data(), std::streamsize(data.size())))
+            glog().warn("Cannot write animation cache {}", path.string());
     }
 
     static weapon_anim load_anim(const std::vector<sf::Sprite>& layers, const std::string& section) {
@@ -222,18 +349,20 @@ private:
 
         auto frames = sect.value<u32>("frames");
 
-        std::vector<weapon_anim_frame>     _animation;
-        std::vector<weapon_anim_sound_key> sounds;
-
-        auto duration = sect.value<float>("duration");
+        weapon_anim anim;
+        anim._layers_count = u32(layers.size());
+        anim._duration     = sect.value<float>("duration");
+        anim._times.reserve(frames);
+        anim._intrpl.reserve(frames);
+        anim._keys.reserve(frames * layers.size());
 
         for (u32 frame = 0; frame < frames; ++frame) {
             auto frame_str = std::to_string(frame);
-            weapon_anim_frame fr;
-            fr._time   = sect.value<float>(frame_str + "_time");
-            fr._intrpl = weapon_anim_frame::interpl_from_str(sect.value<std::string>(frame_str + "_intrpl"));
+            auto time      = sect.value<float>(frame_str + "_time");
+            anim._times.push_back(time);
+            anim._intrpl.push_back(weapon_anim_frame::interpl_from_str(sect.value<std::string>(frame_str + "_intrpl")));
             if (auto snd = sect.value_or_default(frame_str + "_sound", std::optional<std::string>{}))
-                sounds.push_back(weapon_anim_sound_key{*snd, frame, fr._time});
+                anim._sounds.push_back(weapon_anim_sound_key{*snd, frame, time});
 
             for (size_t layer = 0; layer < layers.size(); ++layer) {
                 auto layer_str = "_layer" + std::to_string(layer) + "_";
@@ -241,12 +370,10 @@ private:
                 auto scale_key = sect.value_or_default<vec2f>(frame_str + layer_str + "scale", {1.f, 1.f});
                 auto rot_key   = sect.value_or_default<float>(frame_str + layer_str + "rot", 0.f);
 
-                fr._layers.push_back(weapon_anim_frame::key_t{pos_key, scale_key, rot_key});
+                anim._keys.push_back(weapon_anim_frame::key_t{pos_key, scale_key, rot_key});
             }
-
-            _animation.push_back(std::move(fr));
         }
-        return {std::move(_animation), sounds, duration};
+        return anim;
     }
 
 private:
@@ -278,14 +405,14 @@ private:
     sf::Sprite _shell_sprite;
     float      _mass;
 
-    std::string _shot_snd_path;
+    sound_id _shot_snd;
 
     weapon_class _wpn_class;
     bool         _shot_flash;
     bool         _eject_shell;
 
     std::vector<sf::Sprite> _layers;
-    std::map<std::string, weapon_anim> _animations;
+    weapon_animations       _animations;
 
 public:
     [[nodiscard]]
@@ -390,14 +517,17 @@ public:
         auto found = _wpns.find(section);
         if (found != _wpns.end())
             return found->second;
-        else
-            return _wpns.emplace(section, weapon(section)).first->second;
+
+        auto& wpn = _wpns.emplace(section, weapon(section)).first->second;
+        sound_mgr().preload_bank(section, wpn.sound_ids());
+        return wpn;
     }
 
     void reload() {
-        for (auto& [_, wpn] : _wpns) {
+        for (auto& [section, wpn] : _wpns) {
             wpn.cfg_set();
             wpn.reload_layers();
+            sound_mgr().preload_bank(section, wpn.sound_ids());
         }
     }
 
@@ -406,6 +536,7 @@ public:
         if (found != _wpns.end()) {
             found->second.cfg_set();
             found->second.reload_layers();
+            sound_mgr().preload_bank(wpn_section, found->second.sound_ids());
         }
         else {
             /* TODO: do something with this */
@@ -423,6 +554,7 @@ public:
             found = _wpns.find(wpn_section);
             if (found != _wpns.end()) {
                 found->second.reload_layers();
+                sound_mgr().preload_bank(wpn_section, found->second.sound_ids());
             }
         }
         /* TODO: log if section not found? */
@@ -453,9 +585,9 @@ public:
     };
 
     struct anim_spec_t {
-        std::string _name;
-        timer   _timer = {};
-        bool        _stop_at_end = true;
+        weapon_anim_id _id;
+        timer          _timer       = {};
+        bool           _stop_at_end = true;
     };
 
     weapon_instance() = default;
@@ -496,20 +628,26 @@ public:
         return !empty();
     }
 
-    void play_animation(const std::string& name) {
+    void play_animation(weapon_anim_id id) {
         if (!_wpn)
             return;
 
-        auto found_anim = _wpn->_animations.find(name);
-        if (found_anim == _wpn->_animations.end()) {
-            std::cerr << "Animation " << name << " not found" << std::endl;
+        if (!_wpn->_animations[size_t(id)]) {
+            std::cerr << "Animation " << weapon_anim_name(id) << " not found" << std::endl;
             return;
         }
 
-        _current_anim = anim_spec_t{name, {}};
+        _current_anim = anim_spec_t{id, {}};
         _anim_played_sounds.clear();
     }
 
+    void play_animation(std::string_view name) {
+        if (auto id = weapon_anim_id_from_str(name))
+            play_animation(*id);
+        else
+            std::cerr << "Animation " << name << " not found" << std::endl;
+    }
+
     template <typename F = int, typename F2 = void (*)(const vec2f&, const vec2f&, float)>
     std::optional<float> update(const vec2f&       position,
                                 const vec2f&       cam_position,
@@ -529,9 +667,9 @@ public:
         if (_ammo_elapsed == 0 && !_current_anim && !_on_reload) {
             _on_reload = true;
             if (_wpn->_wpn_class == weapon::shotgun)
-                play_animation("load_start");
+                play_animation(weapon_anim_id::load_start);
             else
-                play_animation("reload");
+                play_animation(weapon_anim_id::reload);
             return {};
         }
 
@@ -643,29 +781,32 @@ public:
             return make_return(position, _wpn, LF, shot_angle_rad * LF);
         }
 
-        weapon_anim* anim;
-        std::vector<weapon_anim_frame>* frames;
-        float max_frame;
-        float cur_frame_time;
+        const weapon_anim* anim;
+        const float*       times;
+        size_t             frames_count;
+        float              max_frame;
+        float              cur_frame_time;
 
         for (bool repeat = true; repeat;) {
             repeat = false;
 
-            auto found_anim = _wpn->_animations.find(_current_anim->_name);
-            if (found_anim == _wpn->_animations.end()) {
-                glog().error("Animation '{}' not found in weapon [{}]", _current_anim->_name, _wpn->_section);
+            auto& found_anim = _wpn->_animations[size_t(_current_anim->_id)];
+            if (!found_anim) {
+                glog().error(
+                    "Animation '{}' not found in weapon [{}]", weapon_anim_name(_current_anim->_id), _wpn->_section);
                 _ammo_elapsed = _wpn->_mag_size;
-                if (_current_anim->_name == "shell")
-                    _current_anim = anim_spec_t{"load_end"};
+                if (_current_anim->_id == weapon_anim_id::shell)
+                    _current_anim = anim_spec_t{weapon_anim_id::load_end};
                 else
                     _current_anim.reset();
                 return make_return(position, _wpn, LF, shot_angle_rad * LF);
             }
-            anim = &found_anim->second;
+            anim = &*found_anim;
 
-            frames = &anim->_frames;
+            times        = anim->_times.data();
+            frames_count = anim->frames_count();
 
-            if (frames->empty()) {
+            if (frames_count == 0) {
                 _current_anim.reset();
                 draw(position, left_dir, enable_long_shot, wnd);
                 return make_return(position, _wpn, LF, shot_angle_rad * LF);
@@ -673,20 +814,20 @@ public:
 
             auto  dur      = anim->_duration;
             float time     = _current_anim->_timer.elapsed(_last_time_speed);
-            max_frame      = frames->back()._time;
+            max_frame      = times[frames_count - 1];
             cur_frame_time = max_frame / dur * time;
 
             if (cur_frame_time > max_frame && _current_anim->_stop_at_end) {
-                if (_current_anim->_name == "load_start") {
-                    _current_anim = anim_spec_t{"shell"};
+                if (_current_anim->_id == weapon_anim_id::load_start) {
+                    _current_anim = anim_spec_t{weapon_anim_id::shell};
                     repeat = true;
                 }
-                else if (_current_anim->_name == "shell") {
+                else if (_current_anim->_id == weapon_anim_id::shell) {
                     ++_ammo_elapsed;
                     if (_ammo_elapsed == _wpn->_mag_size)
-                        _current_anim = anim_spec_t{"load_end"};
+                        _current_anim = anim_spec_t{weapon_anim_id::load_end};
                     else
-                        _current_anim = anim_spec_t{"shell"};
+                        _current_anim = anim_spec_t{weapon_anim_id::shell};
                     repeat = true;
                 }
                 else {
@@ -699,10 +840,10 @@ public:
 
         cur_frame_time = std::fmod(cur_frame_time, max_frame);
 
-        auto beg = frames->begin();
-        auto end = frames->begin() + 1;
-        for (auto i = frames->begin(); i != frames->end() - 1; ++i) {
-            if (i->_time <= cur_frame_time && std::next(i)->_time >= cur_frame_time) {
+        size_t beg = 0;
+        size_t end = frames_count > 1 ? 1 : 0;
+        for (size_t i = 0; i + 1 < frames_count; ++i) {
+            if (times[i] <= cur_frame_time && times[i + 1] >= cur_frame_time) {
                 beg = i;
                 end = i + 1;
                 break;
@@ -711,7 +852,7 @@ public:
 
         /* Play sound */
         {
-            auto frame_i = u32(beg - frames->begin());
+            auto frame_i = u32(beg);
             for (size_t i = 0; i < anim->_sounds.size(); ++i) {
                 auto& snd = anim->_sounds[i];
                 if (snd.frame == frame_i && snd.time <= cur_frame_time &&
@@ -723,8 +864,8 @@ public:
         }
 
 
-        if (_wpn->_eject_shell && !_shell_ejected && _current_anim->_name == "shot" &&
-            beg - frames->begin() == _wpn->_shell_frame) {
+        if (_wpn->_eject_shell && !_shell_ejected && _current_anim->_id == weapon_anim_id::shot &&
+            beg == _wpn->_shell_frame) {
             _shell_ejected = true;
 
             auto vel = _wpn->_shell_vel + rand_float(-_wpn->_shell_vel * 0.1f, _wpn->_shell_vel * 0.1f);
@@ -750,14 +891,16 @@ public:
             throw std::runtime_error("WTF");
         };
 
-        float factor = inverse_lerp(beg->_time, end->_time, cur_frame_time);
-        std::vector<weapon_anim_frame::key_t> keys;
-        for (u32 i = 0; i < beg->_layers.size(); ++i) {
-            weapon_anim_frame::key_t key;
-            key.position = interpl(beg->_layers[i].position, end->_layers[i].position, factor, end->_intrpl);
-            key.scale    = interpl(beg->_layers[i].scale, end->_layers[i].scale, factor, end->_intrpl);
-            key.angle    = interpl(beg->_layers[i].angle, end->_layers[i].angle, factor, end->_intrpl);
-            keys.push_back(key);
+        float factor    = inverse_lerp(times[beg], times[end], cur_frame_time);
+        auto  intrpl    = anim->_intrpl[end];
+        auto  beg_keys  = anim->frame_keys(beg);
+        auto  end_keys  = anim->frame_keys(end);
+        auto& keys      = _anim_keys;
+        keys.resize(anim->_layers_count);
+        for (u32 i = 0; i < anim->_layers_count; ++i) {
+            keys[i].position = interpl(beg_keys[i].position, end_keys[i].position, factor, intrpl);
+            keys[i].scale    = interpl(beg_keys[i].scale, end_keys[i].scale, factor, intrpl);
+            keys[i].angle    = interpl(beg_keys[i].angle, end_keys[i].angle, factor, intrpl);
         }
 
         auto& layers = _wpn->_layers;
@@ -897,7 +1040,7 @@ private:
             }
         }
 
-        play_animation("shot");
+        play_animation(weapon_anim_id::shot);
 
         if (_wpn->_shot_flash) {
             _shot_flash.setRotation(rand_float(0.f, 360.f));
@@ -912,7 +1055,7 @@ private:
         _shell_ejected = false;
 
         --_ammo_elapsed;
-        sound_mgr().play(_wpn->_shot_snd_path, group, position - cam_position, _last_time_speed);
+        sound_mgr().play(_wpn->_shot_snd, group, position - cam_position, _last_time_speed);
     }
 
     struct shell_data {
@@ -951,7 +1094,9 @@ private:
         auto operator<=>(const played_sound_info&) const = default;
     };
     std::set<played_sound_info> _anim_played_sounds;
-    std::optional<std::string>  _anim_sound_to_play;
+    std::optional<sound_id>     _anim_sound_to_play;
+    /* Interpolated keys of the current frame, kept to avoid allocation per draw */
+    std::vector<weapon_anim_frame::key_t> _anim_keys;
 
 public:
     [[nodiscard]]
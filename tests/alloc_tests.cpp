@@ -0,0 +1,190 @@
+/* Counts the allocations of this test executable */
+#define DFDH_ALLOC_TRACKING
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+
+#include "base/alloc_tracker_operators.hpp"
+#include "base/log.hpp"
+#include "base/log_binary.hpp"
+#include "base/profiler.hpp"
+#include "base/signals.hpp"
+#include "physic/physic_simulation.hpp"
+#include "ai_types.hpp"
+
+using namespace dfdh;
+
+/* The counters of the calling thread only: allocations of the other threads do not disturb the checks */
+template <typename F>
+static u64 thread_allocs(F&& hot_loop) {
+    auto before = alloc_tracker::thread_count();
+    hot_loop();
+    return alloc_tracker::thread_count() - before;
+}
+
+TEST_CASE("Allocation tracking") {
+    auto allocs = [](alloc_tag tag) {
+        return alloc_tracker::totals()[size_t(tag)].count;
+    };
+
+    auto physics_before = allocs(alloc_tag::physics);
+    auto physics_thread = thread_allocs([] {
+        DFDH_ALLOC_SCOPE(physics);
+        auto ptr = std::make_unique<std::array<char, 100>>();
+        REQUIRE(ptr);
+    });
+    REQUIRE(physics_thread == 1);
+    REQUIRE(allocs(alloc_tag::physics) == physics_before + 1);
+    REQUIRE(alloc_tracker::totals()[size_t(alloc_tag::physics)].bytes >= 100);
+
+    /* The worker hands its counts back, the checks stay on the main thread */
+    u64 ai_thread = 0, ai_tagged = 0;
+    std::thread([&] {
+        DFDH_ALLOC_SCOPE(ai);
+        auto before = allocs(alloc_tag::ai);
+        ai_thread   = thread_allocs([] { std::vector<int> v(10); });
+        ai_tagged   = allocs(alloc_tag::ai) - before;
+    }).join();
+    REQUIRE(ai_thread == 1);
+    REQUIRE(ai_tagged == 1);
+}
+
+TEST_CASE("Zero allocation hot loops") {
+    SECTION("profiler, trace and log") {
+        profiler        prof;
+        std::string     text;
+        binlog_buffer   binbuf;
+        datetime_cache  time_cache(log_time_format);
+        log_histogram<> hist;
+
+        auto hot_loop = [&](int iterations) {
+            for (int i = 0; i < iterations; ++i) {
+                DFDH_PROF_SCOPE(prof, "alloc test scope");
+                DFDH_TRACE_SCOPE("alloc test trace");
+
+                text.clear();
+                format_into(text, "{} {} {}", i, 0.5 * i, "str");
+
+                binbuf.clear();
+                binlog_encode(binbuf, 0, 0, 42, tsc_now(), i, 0.5 * i, std::string_view("str"));
+
+                time_cache(std::chrono::system_clock::now());
+                hist.add(u64(i));
+            }
+        };
+
+        /* The buffers are warmed up by the first iterations */
+        hot_loop(100);
+        REQUIRE(thread_allocs([&] { hot_loop(10000); }) == 0);
+    }
+
+    SECTION("physics") {
+        physic_simulation sim;
+        sim.add_platform(physic_platform({5.f, 10.01f}, 10.f));
+
+        /* A player-like group standing on the platform, away from the origin where the line
+         * equation flips its sign */
+        auto body = physic_group::create({10.f, 10.f});
+        body->append(physic_point::create({0.f, 0.f}));
+        body->append(physic_point::create({0.f, -0.5f}));
+        body->allow_platform(true);
+        body->enable_gravity(true);
+        sim.add_primitive(body);
+
+        /* A bullet-like line which is thrown back after every hit */
+        auto bullet = physic_line::create({8.f, 9.f}, {0.f, 2.f}, {1.f, 0.f}, 50.f);
+        sim.add_primitive(bullet);
+
+        int hits = 0;
+        sim.add_collide_callback("hit", [&](physic_group*, physic_line* line, collision_result) {
+            ++hits;
+            line->position({8.f, 9.f});
+        });
+        sim.add_update_callback("update", [](const physic_simulation&, float) {});
+
+        auto now      = physic_simulation::tp_now();
+        auto hot_loop = [&](int ticks) {
+            for (int i = 0; i < ticks; ++i) sim.update_immediate(1.f / 60.f, now);
+        };
+
+        hot_loop(100);
+        REQUIRE(thread_allocs([&] { hot_loop(1000); }) == 0);
+        REQUIRE(hits > 10);
+    }
+
+    SECTION("signals") {
+        struct receiver : slot_holder {
+            void on_value(int value) {
+                sum += value;
+            }
+            int sum = 0;
+        } recv;
+
+        int               attached = 0;
+        signal<void(int)> sig;
+        sig.mode(signal_mode::immediate);
+        sig.connect_to(recv, &receiver::on_value);
+        sig.attach_function("attached", [&](int value) { attached += value; });
+
+        auto hot_loop = [&](int iterations) {
+            for (int i = 0; i < iterations; ++i) {
+                sig(1);
+                signal_slot_event_updater::instance().operate_tasks();
+            }
+        };
+
+        hot_loop(10);
+        REQUIRE(thread_allocs([&] { hot_loop(10000); }) == 0);
+        REQUIRE(recv.sum == 10010);
+        REQUIRE(attached == 10010);
+    }
+
+    SECTION("AI snapshots") {
+        ai_data_t data;
+        for (int i = 0; i < 4; ++i) {
+            auto name = player_name_t("player" + std::to_string(i));
+            data.players.insert_or_assign(name, ai_player_t{});
+        }
+        data.bullets.resize(7);
+        data.platforms.resize(8);
+        data.platform_map.resize(8, ai_plat_neighbours_t(3));
+        data.physic_sim.last_rps = 60;
+
+        ai_snapshot_buffer snapshots;
+        std::atomic<bool>  done          = false;
+        u64                reader_allocs = 0, acquired = 0;
+
+        /* Every slot gets the data once, then the reader takes snapshots while the writer publishes */
+        for (int i = 0; i < 3; ++i) {
+            snapshots.publish(data, 1);
+            snapshots.acquire();
+        }
+
+        std::thread reader([&] {
+            reader_allocs = thread_allocs([&] {
+                do {
+                    if (snapshots.acquire())
+                        ++acquired;
+                    if (snapshots.front().data.players.size() != 4)
+                        return;
+                } while (!done.load(std::memory_order_acquire));
+            });
+        });
+
+        auto writer_allocs = thread_allocs([&] {
+            for (int i = 0; i < 10000; ++i) {
+                for (auto& [_, player] : data.players) player.pos.x = float(i);
+                data.bullets.resize(size_t(i % 8));
+                snapshots.publish(data, 1);
+            }
+        });
+        done.store(true, std::memory_order_release);
+        reader.join();
+
+        REQUIRE(writer_allocs == 0);
+        REQUIRE(reader_allocs == 0);
+        REQUIRE(acquired > 0);
+        REQUIRE(snapshots.front().data.players.size() == 4);
+    }
+}
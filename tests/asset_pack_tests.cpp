@@ -0,0 +1,151 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+#include <fstream>
+
+#include "base/asset_pack.hpp"
+
+using namespace dfdh;
+
+static void write_test_file(const fs::path& path, std::string_view text) {
+    fs::create_directories(path.parent_path());
+    auto ofs = std::ofstream(path, std::ios::binary | std::ios::trunc);
+    ofs << text;
+}
+
+static std::string read_test_file(const fs::path& path) {
+    auto ifs = std::ifstream(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+}
+
+TEST_CASE("Asset pack") {
+    auto dir = fs::temp_directory_path() / "dfdh_asset_pack_test";
+    fs::remove_all(dir);
+
+    auto data = dir / "real";
+    write_test_file(data / "data/a.cfg", "a = 1\n");
+    write_test_file(data / "data/sub/b.bin", std::string("\0\1\2\3", 4));
+    write_test_file(data / "data/empty", "");
+
+    std::vector<asset_pack_input> files = {
+        {"data/a.cfg", data / "data/a.cfg"},
+        {"data/empty", data / "data/empty"},
+        {"data/sub/b.bin", data / "data/sub/b.bin"},
+    };
+    auto pack_path = data / "test.pak";
+    write_asset_pack(pack_path, files);
+
+    SECTION("round trip") {
+        auto pack = asset_pack(pack_path);
+        REQUIRE(pack.entries_count() == 3);
+        REQUIRE(pack.find(data / "data/a.cfg") == "a = 1\n");
+        REQUIRE(pack.find(data / "data/sub/../sub/b.bin") == std::string_view("\0\1\2\3", 4));
+        REQUIRE(pack.find(data / "data/empty") == "");
+        REQUIRE(!pack.find(data / "data/missing"));
+        REQUIRE(!pack.find(dir / "data/a.cfg"));
+    }
+
+    SECTION("symlinked install path") {
+        std::error_code ec;
+        fs::create_directory_symlink(data, dir / "link", ec);
+        if (ec) {
+            WARN("symlinks are not available: " << ec.message());
+            return;
+        }
+
+        auto pack = asset_pack(dir / "link/test.pak");
+        REQUIRE(pack.find(data / "data/a.cfg") == "a = 1\n");
+        REQUIRE(pack.find(dir / "link/data/a.cfg") == "a = 1\n");
+
+        auto real_pack = asset_pack(pack_path);
+        REQUIRE(real_pack.find(dir / "link/data/sub/b.bin"));
+    }
+
+    SECTION("pack wins") {
+        auto pack = asset_pack(pack_path);
+
+        write_test_file(data / "data/a.cfg", "a = 2\n");
+        auto packed = asset_file(pack, data / "data/a.cfg");
+        REQUIRE(packed.is_packed());
+        REQUIRE(std::string_view(packed.data(), packed.size()) == "a = 1\n");
+
+        /* Not packed paths are read from the loose files */
+        write_test_file(data / "data/c.cfg", "c = 1\n");
+        auto loose = asset_file(pack, data / "data/c.cfg");
+        REQUIRE(!loose.is_packed());
+        REQUIRE(std::string_view(loose.data(), loose.size()) == "c = 1\n");
+
+        REQUIRE_THROWS_AS(asset_file(pack, data / "data/missing"), cannot_open_file);
+    }
+
+    SECTION("mod directory and dev mode") {
+        auto pack = asset_pack(pack_path);
+        write_test_file(data / "data/a.cfg", "a = 2\n");
+        write_test_file(dir / "mod/data/sub/b.bin", "mod");
+
+        asset_file::mod_root = dir / "mod";
+        auto modded          = asset_file(pack, data / "data/sub/b.bin");
+        auto not_modded      = asset_file(pack, data / "data/a.cfg");
+        asset_file::mod_root.clear();
+
+        REQUIRE(!modded.is_packed());
+        REQUIRE(std::string_view(modded.data(), modded.size()) == "mod");
+        REQUIRE(not_modded.is_packed());
+
+        /* The files removed in the dev mode are still found in the pack */
+        fs::remove(data / "data/empty");
+        asset_file::loose_first = true;
+        auto dev                = asset_file(pack, data / "data/a.cfg");
+        auto dev_removed        = asset_file(pack, data / "data/empty");
+        asset_file::loose_first = false;
+
+        REQUIRE(!dev.is_packed());
+        REQUIRE(std::string_view(dev.data(), dev.size()) == "a = 2\n");
+        REQUIRE(dev_removed.is_packed());
+    }
+
+    SECTION("corrupted packs") {
+        auto original = read_test_file(pack_path);
+        auto header   = asset_pack_header{};
+        std::memcpy(&header, original.data(), sizeof(header));
+
+        auto write_corrupted = [&](auto&& corrupt) {
+            auto bytes = original;
+            corrupt(bytes);
+            write_test_file(pack_path, bytes);
+        };
+
+        auto entry_field = [&](std::string& bytes, size_t idx, size_t field_offset, uint64_t value) {
+            auto pos = header.index_offset + idx * sizeof(asset_pack_entry) + field_offset;
+            std::memcpy(bytes.data() + pos, &value, sizeof(value));
+        };
+
+        write_corrupted([&](std::string& bytes) { bytes.resize(bytes.size() - 1); });
+        REQUIRE_THROWS_AS(asset_pack(pack_path), asset_pack_error);
+
+        write_corrupted([&](std::string& bytes) {
+            auto h         = header;
+            h.index_offset = std::numeric_limits<uint64_t>::max() - 7;
+            std::memcpy(bytes.data(), &h, sizeof(h));
+        });
+        REQUIRE_THROWS_AS(asset_pack(pack_path), asset_pack_error);
+
+        write_corrupted([&](std::string& bytes) {
+            entry_field(bytes, 1, offsetof(asset_pack_entry, offset), std::numeric_limits<uint64_t>::max() - 1);
+        });
+        REQUIRE_THROWS_AS(asset_pack(pack_path), asset_pack_error);
+
+        write_corrupted([&](std::string& bytes) {
+            entry_field(bytes, 2, offsetof(asset_pack_entry, path_size), original.size());
+        });
+        REQUIRE_THROWS_AS(asset_pack(pack_path), asset_pack_error);
+
+        /* A damaged file is found by its checksum on the first access */
+        write_corrupted([&](std::string& bytes) { bytes[bytes.find("a = 1")] = 'b'; });
+        auto pack = asset_pack(pack_path);
+        REQUIRE(!pack.find(data / "data/a.cfg"));
+        REQUIRE(pack.find(data / "data/sub/b.bin"));
+    }
+
+    fs::remove_all(dir);
+}
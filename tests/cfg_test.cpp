@@ -1,8 +1,15 @@
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
 
+#include <bit>
+#include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
+#include <random>
+#include <sstream>
 #include "base/cfg.hpp"
+#include "base/cfg_watcher.hpp"
 #include "base/vec_math.hpp"
 
 using namespace std::string_view_literals;
@@ -141,6 +148,41 @@ TEST_CASE("Cfg test") {
         REQUIRE(format("{}", sect2) == std::string(section2));
     }
 
+    SECTION("value cache and bindings") {
+        auto size = sect2.get<std::tuple<int, int>>("size");
+        REQUIRE(size.value() == std::tuple{400, 200});
+        REQUIRE(sect2.get<std::string>("size").value() == "400 200");
+
+        auto size_rev = size.revision();
+        auto binding  = cfg_binding<std::tuple<int, int>>(cfg, "section2", "size");
+        REQUIRE(binding.refresh());
+        REQUIRE(binding.get() == std::tuple{400, 200});
+        REQUIRE(!binding.refresh());
+
+        /* Changes of other keys do not refresh the slot */
+        sect1.raw_set("health", "300");
+        REQUIRE(!binding.refresh());
+        REQUIRE(size.revision() == size_rev);
+
+        size.set({100, 50});
+        REQUIRE(size.revision() != size_rev);
+        REQUIRE(size.value() == std::tuple{100, 50});
+        REQUIRE(binding.refresh());
+        REQUIRE(binding.get() == std::tuple{100, 50});
+
+        size.clear();
+        REQUIRE(binding.refresh());
+        REQUIRE(!binding.get());
+        REQUIRE(binding.value_or({1, 2}) == std::tuple{1, 2});
+
+        sect2.delete_key("size");
+        REQUIRE(!binding.refresh());
+
+        sect2.set("size", std::tuple{10, 20});
+        REQUIRE(binding.refresh());
+        REQUIRE(binding.get() == std::tuple{10, 20});
+    }
+
     SECTION("remove/insert values") {
         REQUIRE(sect0.delete_key("some"));
         REQUIRE(sect0.get_values().empty());
@@ -341,3 +383,337 @@ TEST_CASE("Cfg test") {
         REQUIRE(format("{}", file2) == section3_part1);
     }
 }
+
+TEST_CASE("Cfg mapped mode") {
+    using namespace dfdh;
+
+    reinit_cfg();
+
+    auto cfg = dfdh::cfg("test_data/configs/test.cfg", cfg_mode::mapped);
+    REQUIRE(cfg.is_mapped());
+    REQUIRE(cfg == dfdh::cfg("test_data/configs/test.cfg"));
+    REQUIRE(format("{}", cfg) ==
+            build_string(global_section, section0, "\n"sv, section1, section2, section3_part0, section3_part1));
+
+    auto& sect1 = cfg.get_section("section1"_sect);
+    REQUIRE(sect1.get<int>("health").value() == 200);
+
+    /* Copy-on-write */
+    auto health = sect1.get<int>("health");
+    health.set(250);
+    REQUIRE(health.value() == 250);
+    REQUIRE(sect1.get<std::string>("name").value() == "super car");
+
+    sect1.set("new key", 1);
+    cfg.get_section("section0"_sect).delete_key("some");
+    cfg.create_section("section4"_sect).set("test", 100);
+
+    cfg.commit();
+    reread_and_compare(cfg);
+    REQUIRE(format("{}", sect1) == "[section1]\nnew key = 1\nhealth = 250\npower  = 100\nname   = super car\n\n");
+}
+
+TEST_CASE("Cfg binary cache") {
+    using namespace dfdh;
+
+    reinit_cfg();
+    fs::remove(cfg_cache::image_path("test_data/configs/test.cfg"));
+
+    auto plain = dfdh::cfg("test_data/configs/test.cfg");
+
+    {
+        auto cold = dfdh::cfg("test_data/configs/test.cfg", cfg_mode::binary_cache);
+        REQUIRE(cold.binary_cache()->misses() == 3);
+        REQUIRE(cold == plain);
+    }
+
+    {
+        auto warm = dfdh::cfg("test_data/configs/test.cfg", cfg_mode::binary_cache);
+        REQUIRE(warm.binary_cache()->hits() == 3);
+        REQUIRE(warm == plain);
+        REQUIRE(format("{}", warm) == format("{}", plain));
+    }
+
+    {
+        auto ofs = std::ofstream("test_data/configs/test3.cfg", std::ios::app);
+        ofs << "key5 = val5\n";
+    }
+
+    auto changed = dfdh::cfg("test_data/configs/test.cfg", cfg_mode::binary_cache);
+    REQUIRE(changed.binary_cache()->hits() == 2);
+    REQUIRE(changed.binary_cache()->misses() == 1);
+    REQUIRE(changed.get_section("section3"_sect).value<std::string>("key5") == "val5");
+    REQUIRE(changed == dfdh::cfg("test_data/configs/test.cfg"));
+}
+
+TEST_CASE("Cfg indexed lookup") {
+    using namespace dfdh;
+
+    reinit_cfg();
+    auto cfg = dfdh::cfg("test_data/configs/test.cfg");
+
+    static constexpr size_t keys_count = 512;
+
+    auto& sect = cfg.create_section("lookup"_sect);
+    for (size_t i = 0; i < keys_count; ++i)
+        sect.raw_set("key" + std::to_string(i), std::to_string(i));
+
+    REQUIRE(cfg.has_section("lookup"));
+    REQUIRE(cfg.try_get_section("lookup"_sect) == &sect);
+    REQUIRE(sect.list_keys().size() == keys_count);
+    for (size_t i = 0; i < keys_count; i += 37)
+        REQUIRE(sect.get<size_t>("key" + std::to_string(i)).value() == i);
+
+    for (size_t i = 0; i < keys_count; i += 2) REQUIRE(sect.delete_key("key" + std::to_string(i)));
+    for (size_t i = 0; i < keys_count; ++i) REQUIRE(sect.has_key("key" + std::to_string(i)) == (i % 2 == 1));
+
+    sect.raw_set("key0", "new");
+    REQUIRE(sect.get<std::string>("key0").value() == "new");
+
+    REQUIRE(cfg.try_remove_section("lookup"_sect));
+    REQUIRE(!cfg.try_get_section("lookup"_sect));
+    REQUIRE(cfg.get_section("section1"_sect).get<int>("health").value() == 200);
+
+    BENCHMARK("section lookup") {
+        return cfg.try_get_section("section2"_sect);
+    };
+
+    BENCHMARK("key lookup") {
+        return cfg.get_section("section1"_sect).try_get<std::string>("name");
+    };
+}
+
+TEST_CASE("Cfg watcher") {
+    using namespace dfdh;
+    using namespace std::chrono_literals;
+
+    reinit_cfg();
+    auto cfg = dfdh::cfg("test_data/configs/test.cfg");
+
+    std::vector<std::vector<std::string>> reloads;
+    auto watcher = cfg_watcher(&cfg, [&](const std::vector<std::string>& names) { reloads.push_back(names); }, 50ms);
+    watcher.watch_section(cfg.get_section("section1"_sect));
+    watcher.watch_section(cfg.get_section("section2"_sect));
+
+    auto write_file = [](std::string_view text) {
+        auto ofs = std::ofstream("test_data/configs/test.cfg");
+        ofs << text;
+    };
+
+    auto wait_reload = [&] {
+        for (int i = 0; i < 100 && reloads.empty(); ++i) {
+            std::this_thread::sleep_for(10ms);
+            signal_slot_event_updater::instance().operate_tasks();
+        }
+    };
+
+    /* Several writes in a row are coalesced; unchanged section2 is not reloaded */
+    write_file(build_string("#include test2.cfg\n"sv, section1));
+    write_file(build_string("#include test2.cfg\n"sv, section1, "new key = 1\n"sv, section2, section3_part0));
+    wait_reload();
+
+    REQUIRE(reloads == std::vector<std::vector<std::string>>{{"section1"}});
+    REQUIRE(cfg.get_section("section1"_sect).get<int>("new key").value() == 1);
+    REQUIRE(cfg.get_section("section2"_sect).get<std::string>("texture path").value() == "path/to/texture");
+
+    /* The watcher thread shows up in the trace */
+    auto threads = trace_recorder::instance().snapshot(5s);
+    auto watcher_thread =
+        std::ranges::find_if(threads, [](const trace_recorder::thread_events& te) { return te.name == "cfg watcher"; });
+    REQUIRE(watcher_thread != threads.end());
+    REQUIRE(std::ranges::any_of(watcher_thread->events,
+                                [](auto& e) { return profiler::name({e.id}) == "cfg watcher reload"; }));
+
+    /* Touching the file without changes does nothing */
+    reloads.clear();
+    write_file(build_string("#include test2.cfg\n"sv, section1, "new key = 1\n"sv, section2, section3_part0));
+    std::this_thread::sleep_for(200ms);
+    signal_slot_event_updater::instance().operate_tasks();
+    REQUIRE(reloads.empty());
+}
+
+TEST_CASE("Cfg async commit") {
+    using namespace dfdh;
+
+    auto&& [cfg, global_sect, sect0, sect1, sect2, sect3, file0, file1, file2] = reinit_cfg();
+
+    auto writes = cfg_writer::instance().writes_count();
+
+    /* Pending texts are replaced by the latest one */
+    for (int i = 0; i < 10; ++i) {
+        sect1.get<int>("health").set(i);
+        cfg.commit_async();
+    }
+    REQUIRE(!file0.commit_required);
+
+    cfg_writer::instance().flush();
+    REQUIRE(cfg_writer::instance().writes_count() - writes <= 2);
+    REQUIRE(!fs::exists("test_data/configs/test.cfg.tmp"));
+    reread_and_compare(cfg);
+
+    /* Files without changes are not written */
+    writes = cfg_writer::instance().writes_count();
+    cfg.commit();
+    REQUIRE(cfg_writer::instance().writes_count() == writes);
+
+    /* A path without the directory part syncs the current directory */
+    cfg_write_file_atomic("atomic_test.cfg", "key = 1\n");
+    REQUIRE(fs::file_size("atomic_test.cfg") == 8);
+    REQUIRE(!fs::exists("atomic_test.cfg.tmp"));
+    fs::remove("atomic_test.cfg");
+
+    REQUIRE_THROWS(cfg_write_file_atomic("test_data/missing dir/test.cfg", "key = 1\n"));
+}
+
+template <bool Vectorized>
+auto tokenize(std::string_view text) {
+    std::vector<std::pair<dfdh::cfg_token_t, std::string>> result;
+    auto tokenizer = dfdh::cfg_tokenizer<const char*, const char*, Vectorized>(text.data(), text.data() + text.size());
+    while (tokenizer) {
+        auto tk = tokenizer.next();
+        result.emplace_back(tk.type, tk.value.str());
+    }
+    return result;
+}
+
+TEST_CASE("Cfg vectorized tokenizer") {
+    using namespace dfdh;
+
+    auto corpus = build_string(global_section, section0, "\n"sv, section1, section2, section3_part0, section3_part1);
+    corpus += "#include test2.cfg\n"
+              "# comment = with 'quotes' and [brackets]\r\n"
+              "[long section name which is longer than one simd block]\r\n"
+              "  key with spaces and a long name to cross the block boundary   =   value 'with = quotes'  \n"
+              "quoted \"key = not eq\" = \"value ' with\n newline\"\n"
+              "\t\t   \n\n\n"
+              "empty =\n"
+              "[unterminated section\n"
+              "tail = 'unterminated quote";
+
+    /* Every split point, so the blocks start at each offset */
+    for (size_t i = 0; i <= corpus.size(); ++i) {
+        auto text = std::string_view(corpus).substr(i);
+        REQUIRE(tokenize<true>(text) == tokenize<false>(text));
+    }
+
+    auto args = std::vector<std::string>();
+    auto cmd  = std::string("cmd  'single quoted arg with spaces'  \"double 'quoted'\"\targ_with_a_long_name_longer_than_block x");
+    for (auto arg : cmd / split_when(skip_whitespace_outside_quotes()))
+        args.emplace_back(arg.begin(), arg.end());
+    REQUIRE(args == std::vector<std::string>{"cmd",
+                                             "single quoted arg with spaces",
+                                             "double 'quoted'",
+                                             "arg_with_a_long_name_longer_than_block",
+                                             "x"});
+}
+
+/* Exact float comparison without -Wfloat-equal */
+template <typename T>
+bool same_bits(T lhs, T rhs) {
+    using bits_t = std::conditional_t<sizeof(T) == sizeof(dfdh::u32), dfdh::u32, dfdh::u64>;
+    return std::bit_cast<bits_t>(lhs) == std::bit_cast<bits_t>(rhs);
+}
+
+template <typename T, typename F>
+void compare_with_std(const std::string& str, F&& std_parse) {
+    std::optional<T> expected;
+    size_t           expected_pos = 0;
+    bool             out_of_range = false;
+    try {
+        expected = std_parse(str, &expected_pos);
+    }
+    catch (const std::out_of_range&) {
+        out_of_range = true;
+    }
+    catch (const std::exception&) {}
+
+    auto res = dfdh::ston_parse<T>(str);
+    INFO(str);
+
+    /* std::sto* reports ERANGE for subnormal results too */
+    if constexpr (std::is_floating_point_v<T>)
+        if (out_of_range && res && std::fpclassify(res.value) == FP_SUBNORMAL)
+            return;
+
+    REQUIRE(bool(res) == expected.has_value());
+    if (expected) {
+        REQUIRE(res.pos == expected_pos);
+        if constexpr (std::is_floating_point_v<T>)
+            REQUIRE((same_bits(res.value, *expected) || (std::isnan(res.value) && std::isnan(*expected))));
+        else
+            REQUIRE(res.value == *expected);
+    }
+}
+
+TEST_CASE("Number parsing") {
+    using namespace dfdh;
+
+    auto rng = std::mt19937(42);
+    auto random_string = [&](std::string_view alphabet) {
+        std::string str(rng() % 24, ' ');
+        for (auto& c : str) c = alphabet[rng() % alphabet.size()];
+        return str;
+    };
+
+    std::vector<std::string> corpus = {
+        "", " ", "0", "-0", "+0", "+-1", "-+1", " \t\n42tail", "9223372036854775807", "9223372036854775808",
+        "-9223372036854775808", "18446744073709551615", "18446744073709551616", "1.5", ".5", "5.", "1e10", "1e",
+        "1e+", "-1.25e-3", "inf", "-inf", "infinity", "nan", "INF", "00012", "3.4028235e38", "1e300"};
+    for (int i = 0; i < 20000; ++i) corpus.push_back(random_string("0123456789+-.eE \tinfa"));
+    for (int i = 0; i < 5000; ++i) corpus.push_back(std::to_string(i64(rng()) * (i % 2 ? -1 : 1) * i64(rng() % 100000)));
+
+    for (auto& str : corpus) {
+        compare_with_std<long long>(str, [](auto& s, size_t* pos) { return std::stoll(s, pos); });
+        compare_with_std<double>(str, [](auto& s, size_t* pos) { return std::stod(s, pos); });
+        compare_with_std<float>(str, [](auto& s, size_t* pos) { return std::stof(s, pos); });
+        /* std::stoull wraps negative numbers around */
+        if (str.find('-') == std::string::npos)
+            compare_with_std<unsigned long long>(str, [](auto& s, size_t* pos) { return std::stoull(s, pos); });
+    }
+
+    /* Narrow types are range checked instead of truncated */
+    REQUIRE(ston_parse<u8>("255").value == 255);
+    REQUIRE(ston_parse<u8>("256").ec == std::errc::result_out_of_range);
+    REQUIRE(ston_parse<u32>("-1").ec == std::errc::invalid_argument);
+    /* Hex floats are not accepted, unlike std::stof */
+    REQUIRE(ston_parse<float>("0x10").pos == 1);
+    REQUIRE_THROWS_AS(ston<int>("x"), std::invalid_argument);
+    REQUIRE_THROWS_AS(ston<i8>("1000"), std::out_of_range);
+
+    /* Formatted numbers are parsed back to the same value */
+    for (int i = 0; i < 10000; ++i) {
+        auto f = std::bit_cast<float>(u32(rng()));
+        if (std::isfinite(f))
+            REQUIRE(same_bits(ston<float>(ntos(f)), f));
+    }
+    REQUIRE(cfg_str_cast(0.1f) == "0.1");
+    REQUIRE(cfg_str_cast(std::tuple{1, -2.5}) == "1 -2.5");
+
+    BENCHMARK("parse std::stof") {
+        float sum = 0.f;
+        for (auto& str : corpus) try { sum += std::stof(str); } catch (...) {}
+        return sum;
+    };
+
+    BENCHMARK("parse ston_parse<float>") {
+        float sum = 0.f;
+        for (auto& str : corpus) sum += ston_parse<float>(str).value;
+        return sum;
+    };
+
+    BENCHMARK("format stringstream") {
+        size_t size = 0;
+        for (int i = 0; i < 1000; ++i) {
+            std::stringstream ss;
+            ss << std::setprecision(9) << float(i) * 0.37f;
+            size += ss.str().size();
+        }
+        return size;
+    };
+
+    BENCHMARK("format ntos") {
+        size_t size = 0;
+        for (int i = 0; i < 1000; ++i) size += ntos(float(i) * 0.37f).size();
+        return size;
+    };
+}
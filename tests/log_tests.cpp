@@ -0,0 +1,379 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <bit>
+#include <filesystem>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "base/io.hpp"
+#include "base/log.hpp"
+#include "base/log_binary.hpp"
+#include "base/ston.hpp"
+
+namespace fs = std::filesystem;
+using namespace std::string_view_literals;
+
+struct format_test_point {
+    int x, y;
+};
+
+template <>
+struct dfdh::printer<format_test_point> {
+    void operator()(std::ostream& os, const format_test_point& p) const {
+        os << '(' << p.x << "; " << p.y << ')';
+    }
+};
+
+TEST_CASE("Formatting") {
+    using namespace dfdh;
+
+    REQUIRE(format("no placeholders") == "no placeholders");
+    REQUIRE(format("{}{}", 1, 2) == "12");
+    REQUIRE(format("a {} b {x} c", "str", std::string("s")) == "a str b s c");
+    REQUIRE(format("{} {} {} {}", true, 'c', u8(65), i8(-1)) == "true c A \xff");
+    REQUIRE(format("{}", std::optional<std::string>{}) == "(null)");
+    REQUIRE(format("{}", std::vector{1, 2, 3}) == "{1, 2, 3}");
+    REQUIRE(format("{}", format_test_point{1, 2}) == "(1; 2)");
+
+    /* Numbers are the same as the std::ostream output */
+    auto rng = std::mt19937(42);
+    for (int i = 0; i < 10000; ++i) {
+        auto f = std::bit_cast<float>(u32(rng()));
+        auto d = double(rng()) / double(rng() | 1);
+        auto l = i64(rng()) * i64(rng()) * (i % 2 ? -1 : 1);
+
+        std::stringstream ss;
+        ss << f << ' ' << d << ' ' << l;
+        REQUIRE(format("{} {} {}", f, d, l) == ss.str());
+    }
+
+    std::string buf;
+    format_into(buf, "{}:", 1);
+    format_into(buf, "{}", 2);
+    REQUIRE(buf == "1:2");
+
+    /* Old runtime parser through std::stringstream */
+    auto stream_format = [](std::string_view fmt, auto&&... args) {
+        std::stringstream ss;
+        auto print_next = [&](auto& arg) {
+            auto pos = fmt.find('{');
+            ss << fmt.substr(0, pos);
+            print_any(ss, arg);
+            fmt = fmt.substr(fmt.find('}', pos) + 1);
+        };
+        (print_next(args), ...);
+        ss << fmt;
+        return ss.str();
+    };
+
+    BENCHMARK("format stringstream runtime") {
+        size_t size = 0;
+        for (int i = 0; i < 1000; ++i)
+            size += stream_format("frame {}: {} objects, dt = {}, name = {}", i, i * 7, float(i) * 0.37f, "player").size();
+        return size;
+    };
+
+    BENCHMARK("format compile time") {
+        size_t size = 0;
+        for (int i = 0; i < 1000; ++i)
+            size += format("frame {}: {} objects, dt = {}, name = {}", i, i * 7, float(i) * 0.37f, "player").size();
+        return size;
+    };
+
+    BENCHMARK("format_into reused buffer") {
+        size_t size = 0;
+        std::string out;
+        for (int i = 0; i < 1000; ++i) {
+            out.clear();
+            format_into(out, "frame {}: {} objects, dt = {}, name = {}", i, i * 7, float(i) * 0.37f, "player");
+            size += out.size();
+        }
+        return size;
+    };
+}
+
+/* The old datetime() through std::stringstream */
+static std::string stream_datetime(std::string_view format, std::chrono::system_clock::time_point time_point) {
+    auto time = dfdh::get_time_info(time_point);
+    std::stringstream ss;
+
+    auto field = [&](char c) -> long long {
+        switch (c) {
+        case 'h': return time.hour.count();
+        case 'm': return time.minute.count();
+        case 's': return time.second.count();
+        case 'x': return time.millisecond.count();
+        case 'u': return time.microsecond.count();
+        case 'n': return time.nanosecond.count();
+        default: return -1;
+        }
+    };
+
+    for (size_t i = 0; i < format.size();) {
+        auto c = format[i];
+        if (std::string_view("DMYhmsxun").find(c) == std::string_view::npos) {
+            ss << c;
+            ++i;
+            continue;
+        }
+        auto end = std::min(format.find_first_not_of(c, i), format.size());
+        if (auto v = field(c); v >= 0)
+            ss << std::setfill('0') << std::setw(int(end - i)) << v;
+        i = end;
+    }
+    return ss.str();
+}
+
+TEST_CASE("Cached timestamps") {
+    using namespace dfdh;
+    using namespace std::chrono_literals;
+
+    auto rng = std::mt19937(42);
+
+    for (auto fmt : {"[hh:mm:ss.xxx]"sv, "h:m:s.x.u.n"sv, "YYYY-MM-DD hhmmss nnnnn"sv, "xxx sss"sv, "no fields"sv}) {
+        auto cache = datetime_cache(datetime_format(fmt));
+        auto tp    = std::chrono::system_clock::now();
+        for (int i = 0; i < 20000; ++i) {
+            tp += std::chrono::nanoseconds(rng() % (i % 2 ? 1000000000 : 1000000));
+            REQUIRE(cache(tp) == stream_datetime(fmt, tp));
+            REQUIRE(datetime(fmt, tp) == stream_datetime(fmt, tp));
+        }
+    }
+
+    REQUIRE_THROWS_AS(datetime_format(std::string(100, '-')), std::length_error);
+
+    struct null_acceptor : log_acceptor_base {
+        void write_handler(log_level, write_type, std::string_view time, std::string_view msg, uint64_t) final {
+            size += time.size() + msg.size();
+        }
+        size_t size = 0;
+    };
+
+    auto now   = std::chrono::system_clock::now();
+    auto cache = datetime_cache(log_time_format);
+
+    BENCHMARK("timestamp stringstream") {
+        size_t size = 0;
+        for (int i = 0; i < 1000; ++i) size += stream_datetime("[hh:mm:ss.xxx]", now + i * 10us).size();
+        return size;
+    };
+
+    BENCHMARK("timestamp datetime") {
+        size_t size = 0;
+        for (int i = 0; i < 1000; ++i) size += datetime("[hh:mm:ss.xxx]", now + i * 10us).size();
+        return size;
+    };
+
+    BENCHMARK("timestamp datetime_cache") {
+        size_t size = 0;
+        for (int i = 0; i < 1000; ++i) size += cache(now + i * 10us).size();
+        return size;
+    };
+
+    /* Like the ai profiler mode: a record for every ai worker measure */
+    logger log;
+    log.take_stream("stdout");
+    log.add_stream("null", std::make_unique<null_acceptor>());
+
+    BENCHMARK("logger profiler records") {
+        for (int i = 0; i < 1000; ++i) log.detail("ai worker: {}: {}us|{}us|{}us", "ai_operator", i, i * 2, i * 3);
+    };
+}
+
+TEST_CASE("Binary log") {
+    using namespace dfdh;
+
+    auto path = (fs::temp_directory_path() / "dfdh_binary_log_test.binlog").string();
+
+    struct text_acceptor : log_acceptor_base {
+        void write_handler(log_level, write_type, std::string_view, std::string_view msg, uint64_t) final {
+            msgs.emplace_back(msg);
+        }
+        std::vector<std::string> msgs;
+    };
+
+    std::vector<std::string> expected;
+    {
+        logger log;
+        log.take_stream("stdout");
+        log.add_stream("binary", log_acceptor_binary::create(path));
+        auto text_ptr = std::make_unique<text_acceptor>();
+        auto& text    = *text_ptr;
+
+        log.debug("{} {} {} {}", -12, u64(-1), 0.1f, 1.0 / 3.0);
+        log.info("{} {} {} {}", true, 'c', "literal", std::string("string"));
+        log.warn("{} {}", std::vector{1, 2}, format_test_point{3, 4});
+        log.error_update(1, "progress {}%", 50);
+        log.debug("{} {} {} {}", -12, u64(-1), 0.1f, 1.0 / 3.0);
+
+        /* The text acceptors are written as before */
+        log.add_stream("text", std::move(text_ptr));
+        log.info("with text {}", 1);
+        expected = {format("{} {} {} {}", -12, u64(-1), 0.1f, 1.0 / 3.0),
+                    "true c literal string",
+                    "{1, 2} (3; 4)",
+                    "progress 50%",
+                    format("{} {} {} {}", -12, u64(-1), 0.1f, 1.0 / 3.0),
+                    "with text 1"};
+        REQUIRE(text.msgs == std::vector<std::string>{"with text 1"});
+        log.remove_stream("text");
+    }
+
+    auto data   = file_view<char>(path.data());
+    auto reader = binlog_reader(std::span(data.data(), data.size()));
+    auto start  = std::chrono::system_clock::now() - std::chrono::minutes(1);
+
+    std::vector<binlog_record> records;
+    while (auto rec = reader.next()) records.push_back(std::move(*rec));
+
+    /* The "log close" record of the logger destructor is the last one */
+    REQUIRE(records.size() == expected.size() + 1);
+    for (size_t i = 0; i < expected.size(); ++i) REQUIRE(records[i].msg == expected[i]);
+    REQUIRE(records[0].level == u8(log_level::debug));
+    REQUIRE(records[3].level == u8(log_level::error));
+    REQUIRE(records[3].update_id == 1);
+    for (auto& rec : records) {
+        REQUIRE(rec.time > start);
+        REQUIRE(rec.time < std::chrono::system_clock::now() + std::chrono::minutes(1));
+    }
+
+    fs::remove(path);
+
+    logger log;
+    log.take_stream("stdout");
+    log.add_stream("binary", log_acceptor_binary::create("/dev/null"));
+
+    BENCHMARK("binary log profiler records") {
+        for (int i = 0; i < 1000; ++i) log.detail("ai worker: {}: {}us|{}us|{}us", "ai_operator", i, i * 2, i * 3);
+    };
+}
+
+TEST_CASE("Async logger") {
+    using namespace dfdh;
+
+    struct acceptor : log_acceptor_base {
+        void write_handler(log_level, write_type wt, std::string_view, std::string_view msg, uint64_t times) final {
+            while (blocked.load()) std::this_thread::yield();
+            records.push_back({wt, std::string(msg), times});
+        }
+
+        struct rec {
+            write_type  wt;
+            std::string msg;
+            uint64_t    times;
+        };
+        std::vector<rec>  records;
+        std::atomic<bool> blocked = false;
+    };
+
+    logger log;
+    log.take_stream("stdout");
+    auto acc_ptr = std::make_unique<acceptor>();
+    auto& acc    = *acc_ptr;
+    log.add_stream("test", std::move(acc_ptr));
+
+    SECTION("order, write_same and update") {
+        log.start_async(64, log_overflow::block);
+
+        static constexpr int threads_count = 4;
+        static constexpr int per_thread    = 1000;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threads_count; ++t)
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < per_thread; ++i) log.info("{} {}", t, i);
+            });
+        for (auto& t : threads) t.join();
+        log.flush();
+
+        REQUIRE(acc.records.size() == threads_count * per_thread);
+        std::array<int, threads_count> next = {};
+        for (auto& rec : acc.records) {
+            auto space = rec.msg.find(' ');
+            auto t     = ston<size_t>(rec.msg.substr(0, space));
+            auto i     = ston<int>(rec.msg.substr(space + 1));
+            REQUIRE(i == next[t]++);
+        }
+
+        acc.records.clear();
+        log.info("same");
+        log.info("same");
+        log.info_update(1, "progress 1");
+        log.info_update(1, "progress 2");
+        log.stop_async();
+
+        REQUIRE(acc.records.size() == 4);
+        REQUIRE(acc.records[1].wt == log_acceptor_base::write_type::write_same);
+        REQUIRE(acc.records[1].times == 2);
+        REQUIRE(acc.records[2].wt == log_acceptor_base::write_type::new_record);
+        REQUIRE(acc.records[3].wt == log_acceptor_base::write_type::update);
+        REQUIRE(acc.records[3].msg == "progress 2");
+    }
+
+    SECTION("drain thread renders the same texts") {
+        std::vector<int> ints = {1, 2, 3};
+        std::string      str  = "str";
+
+        log.start_async();
+        log.info("{} {} {} {} {} {} {} {}", -5, 42u, 0.1f, 2.5e10, true, 'c', str, "literal");
+        log.info("ints: {}", ints);
+        log.info("{}{}", std::string_view("a"), u8(7));
+        log.stop_async();
+
+        REQUIRE(acc.records.size() == 3);
+        REQUIRE(acc.records[0].msg == format("{} {} {} {} {} {} {} {}", -5, 42u, 0.1f, 2.5e10, true, 'c', str, "literal"));
+        REQUIRE(acc.records[1].msg == format("ints: {}", ints));
+        REQUIRE(acc.records[2].msg == format("{}{}", std::string_view("a"), u8(7)));
+    }
+
+    SECTION("overflow drop") {
+        log.start_async(4, log_overflow::drop);
+        acc.blocked = true;
+        for (int i = 0; i < 100; ++i) log.info("{}", i);
+        acc.blocked = false;
+        log.flush();
+        log.stop_async();
+
+        REQUIRE(log.dropped_count() > 0);
+        REQUIRE(acc.records.size() == 100 - log.dropped_count() + 1);
+        REQUIRE(acc.records.back().msg.find("records dropped") != std::string::npos);
+    }
+}
+
+TEST_CASE("Log ring buffer") {
+    using namespace dfdh;
+    using wt = log_acceptor_base::write_type;
+
+    auto ring = log_acceptor_ring_buffer(8);
+
+    SECTION("write_same stamps every line") {
+        ring.write_handler(log_level::info, wt::new_record, "t", "first", 1);
+        ring.write_handler(log_level::info, wt::new_record, "t", "a\nb\nc", 1);
+        auto synced = ring.read().revision();
+
+        ring.write_handler(log_level::info, wt::write_same, "t", "a\nb\nc", 2);
+        auto rd = ring.read();
+        REQUIRE(rd.size() == 4);
+        REQUIRE(rd[0].revision <= synced);
+        for (size_t i = 1; i < rd.size(); ++i) {
+            REQUIRE(rd[i].revision == rd.revision());
+            REQUIRE(rd[i].revision > synced);
+        }
+        REQUIRE(rd[1].times == 2);
+    }
+
+    SECTION("max_size keeps one record") {
+        for (int i = 0; i < 5; ++i) ring.write_handler(log_level::info, wt::new_record, "t", format("{}", i), 1);
+
+        ring.max_size(0);
+        REQUIRE(ring.max_size() == 1);
+
+        auto rd = ring.read();
+        REQUIRE(rd.size() == 1);
+        REQUIRE(rd.first_index() == 4);
+        REQUIRE(rd.msg(rd[0]) == "4");
+    }
+}
@@ -0,0 +1,238 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "base/profiler.hpp"
+#include "base/ston.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Profiler scopes") {
+    using namespace dfdh;
+
+    profiler prof;
+    auto     id = DFDH_PROF_ID("test scope");
+    REQUIRE(profiler::intern("test scope").value == id.value);
+    REQUIRE(profiler::name(id) == "test scope");
+
+    for (int i = 0; i < 10; ++i) {
+        DFDH_PROF_SCOPE(prof, "test scope");
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    {
+        DFDH_PROF_SCOPE(prof, "not counted", false);
+    }
+
+    auto time = prof.find(id);
+    REQUIRE(time);
+    REQUIRE(time->count == 10);
+    REQUIRE(profiler::ticks_to_duration(time->min_ticks) >= std::chrono::microseconds(100));
+    REQUIRE(time->max_ticks >= time->min_ticks);
+    REQUIRE(prof.find(DFDH_PROF_ID("not counted"))->count == 0);
+    REQUIRE(!prof.find(profiler::intern("never used")));
+
+    prof.short_print_format(false);
+    REQUIRE(format("{}", prof).starts_with("{{not counted, 0ns|0ns|"));
+    prof.reset();
+    REQUIRE(prof.find(id)->count == 0);
+
+    /* Two counter reads, an array update and a trace event per scope */
+    BENCHMARK("1000 profiler scopes") {
+        for (int i = 0; i < 1000; ++i) {
+            DFDH_PROF_SCOPE(prof, "bench scope");
+        }
+        return prof.find(DFDH_PROF_ID("bench scope"))->count;
+    };
+
+    BENCHMARK("1000 profiler scopes by name") {
+        for (int i = 0; i < 1000; ++i) {
+            auto scope = prof.scope(std::string("bench scope"));
+        }
+        return prof.find(DFDH_PROF_ID("bench scope"))->count;
+    };
+}
+
+TEST_CASE("Trace recorder") {
+    using namespace dfdh;
+
+    auto& rec = trace_recorder::instance();
+    REQUIRE(rec.is_enabled());
+
+    std::thread worker([] {
+        trace_recorder::set_thread_name("trace \"worker\"");
+        for (int i = 0; i < 3; ++i) {
+            DFDH_TRACE_SCOPE("worker scope");
+        }
+    });
+    worker.join();
+
+    {
+        profiler prof;
+        DFDH_PROF_SCOPE(prof, "main scope");
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    auto threads = rec.snapshot(std::chrono::seconds(5));
+    auto count   = [&](std::string_view name) {
+        size_t res = 0;
+        for (auto& te : threads)
+            for (auto& e : te.events) res += profiler::name({e.id}) == name;
+        return res;
+    };
+    REQUIRE(count("worker scope") == 3);
+    REQUIRE(count("main scope") == 1);
+
+    auto json = trace_recorder::chrome_json(threads, [](u32 id) { return profiler::name({id}); });
+    REQUIRE(json.starts_with("{\"displayTimeUnit\":\"ms\",\"traceEvents\":["));
+    REQUIRE(json.ends_with("]}\n"));
+    REQUIRE(json.find("\"args\":{\"name\":\"trace \\\"worker\\\"\"}") != std::string::npos);
+    REQUIRE(json.find("{\"name\":\"main scope\",\"ph\":\"X\",\"pid\":1,") != std::string::npos);
+
+    /* Events a few microseconds apart keep distinct timestamps seconds after the base */
+    auto ticks_per_us = tsc_frequency() / 1e6;
+    auto ticks        = [&](double us) { return u64(us * ticks_per_us); };
+    auto late_events  = std::vector<trace_recorder::event>{{ticks(0), ticks(1), 0}};
+    for (int i = 0; i < 4; ++i)
+        late_events.push_back({ticks(5e6 + 3 * i), ticks(5e6 + 3 * i + 2), 0});
+
+    auto late_json = trace_recorder::chrome_json({{"late", 1, late_events}}, [](u32) { return "late"; });
+    std::vector<double> timestamps;
+    for (auto pos = late_json.find("\"ts\":"); pos != std::string::npos; pos = late_json.find("\"ts\":", pos + 1)) {
+        auto value = late_json.substr(pos + 5, late_json.find(',', pos) - pos - 5);
+        REQUIRE(value.find('e') == std::string::npos);
+        timestamps.push_back(ston<double>(value));
+    }
+    REQUIRE(timestamps.size() == 5);
+    for (size_t i = 2; i < timestamps.size(); ++i) {
+        REQUIRE(timestamps[i] > timestamps[i - 1] + 2.0);
+        REQUIRE(timestamps[i] < timestamps[i - 1] + 4.0);
+    }
+
+    rec.enable(false);
+    {
+        DFDH_TRACE_SCOPE("disabled scope");
+    }
+    rec.enable(true);
+    threads = rec.snapshot(std::chrono::seconds(5));
+    REQUIRE(count("disabled scope") == 0);
+
+    BENCHMARK("1000 trace scopes") {
+        for (int i = 0; i < 1000; ++i) {
+            DFDH_TRACE_SCOPE("bench trace scope");
+        }
+    };
+}
+
+TEST_CASE("Percentile histograms") {
+    using namespace dfdh;
+
+    using hist_t = log_histogram<>;
+    for (u64 v : {u64(0), u64(31), u64(32), u64(1000), u64(123456789), std::numeric_limits<u64>::max()}) {
+        auto idx = hist_t::bucket_index(v);
+        REQUIRE(idx < hist_t::bucket_count);
+        REQUIRE(hist_t::bucket_upper(idx) >= v);
+        REQUIRE(hist_t::bucket_upper(idx) - v <= v / hist_t::sub_buckets);
+    }
+
+    std::mt19937_64  rng(42);
+    std::vector<u64> values;
+    hist_t           hist;
+    for (int i = 0; i < 100000; ++i) {
+        /* Mostly 16ms frames with rare stutters */
+        auto v = 16'000'000 + rng() % 1'000'000 + (i % 500 == 0 ? rng() % 50'000'000 : 0);
+        values.push_back(v);
+        hist.add(v);
+    }
+    std::ranges::sort(values);
+
+    for (double q : {0.5, 0.9, 0.99, 0.999}) {
+        auto exact = values[size_t(std::ceil(q * double(values.size()))) - 1];
+        auto p     = hist.percentile(q);
+        REQUIRE(p >= exact);
+        REQUIRE(double(p - exact) <= double(exact) / double(hist_t::sub_buckets));
+    }
+    REQUIRE(hist.percentile(1.0) == values.back());
+    REQUIRE(hist.max() == values.back());
+    REQUIRE(hist.min() == values.front());
+    hist.clear();
+    REQUIRE(hist.count() == 0);
+    REQUIRE(hist.percentile(0.5) == 0);
+
+    profiler prof("histogram test");
+    prof.set_window_period(0s);
+    for (int i = 0; i < 100; ++i) {
+        {
+            DFDH_PROF_SCOPE(prof, "split scope", false);
+        }
+        DFDH_PROF_SCOPE(prof, "split scope");
+        if (i == 99)
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    REQUIRE(profiler::ticks_to_duration(prof.find(DFDH_PROF_ID("split scope"))->last) >= 2ms);
+    prof.update_window();
+
+    auto windows = profiler::windows();
+    REQUIRE(windows.contains("histogram test"));
+    auto& stats = windows.at("histogram test");
+    REQUIRE(stats.size() == 1);
+    REQUIRE(stats[0].scope == "split scope");
+    REQUIRE(stats[0].count == 100);
+    REQUIRE(stats[0].p50 < 1ms);
+    REQUIRE(stats[0].max >= 2ms);
+    REQUIRE(stats[0].p999 == stats[0].max);
+
+    std::stringstream csv;
+    profiler::write_windows_csv(csv);
+    REQUIRE(csv.str().starts_with(
+        "profiler,scope,count,p50_us,p90_us,p99_us,p99.9_us,max_us,ipc,l1d_misses,llc_misses,branch_misses\n"));
+    REQUIRE(csv.str().find("\nhistogram test,split scope,100,") != std::string::npos);
+
+    BENCHMARK("1000 histogram adds") {
+        for (u64 i = 0; i < 1000; ++i) hist.add(i * 40503);
+        return hist.count();
+    };
+}
+
+TEST_CASE("Hardware counters") {
+    using namespace dfdh;
+
+    perf_event_group probe;
+    if (!probe.available()) {
+        WARN("hardware counters are not available: " << probe.error());
+        /* Scopes must work the same without the counters */
+        profiler::hw_counters(true);
+        profiler prof("hw test");
+        {
+            DFDH_PROF_SCOPE(prof, "hw scope");
+        }
+        profiler::hw_counters(false);
+        REQUIRE(prof.find(DFDH_PROF_ID("hw scope"))->count == 1);
+        return;
+    }
+
+    profiler::hw_counters(true);
+    profiler prof("hw test");
+    prof.set_window_period(0s);
+
+    std::vector<u32> data(1 << 20);
+    std::iota(data.begin(), data.end(), 0u);
+    u64 sum = 0;
+    for (int tick = 0; tick < 10; ++tick) {
+        DFDH_PROF_SCOPE(prof, "hw scope");
+        for (size_t i = 0; i < data.size(); i += 16) sum += data[(i * 7919) % data.size()];
+    }
+    profiler::hw_counters(false);
+    prof.update_window();
+    REQUIRE(sum > 0);
+
+    auto& st = profiler::windows().at("hw test").front();
+    REQUIRE(st.hw);
+    if (probe.has(hw_counter::cycles) && probe.has(hw_counter::instructions))
+        REQUIRE(st.ipc > 0.0);
+    WARN("per tick: ipc " << st.ipc << " l1d misses " << st.l1d_misses << " llc misses " << st.llc_misses
+                          << " branch misses " << st.branch_misses);
+}
@@ -0,0 +1,59 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <thread>
+
+#include "base/triple_buffer.hpp"
+
+TEST_CASE("Triple buffer") {
+    using namespace dfdh;
+
+    struct value_t {
+        u64 first  = 0;
+        u64 second = 0;
+    };
+
+    triple_buffer<value_t> buf;
+    REQUIRE_FALSE(buf.acquire());
+
+    buf.back() = {1, 1};
+    buf.publish();
+    buf.back() = {2, 2};
+    buf.publish();
+    REQUIRE(buf.acquire());
+    REQUIRE(buf.front().first == 2);
+    REQUIRE_FALSE(buf.acquire());
+    REQUIRE(buf.front().first == 2);
+
+    /* The reader sees complete values in the publish order */
+    constexpr u64     count = 200000;
+    std::atomic<bool> done  = false;
+
+    std::thread writer([&] {
+        for (u64 i = 3; i <= count; ++i) {
+            buf.back() = {i, i * 3};
+            buf.publish();
+        }
+        done = true;
+    });
+
+    u64  last       = 2;
+    bool consistent = true, ordered = true;
+    while (true) {
+        bool finished = done;
+        if (!buf.acquire()) {
+            if (finished)
+                break;
+            continue;
+        }
+        auto& value = buf.front();
+        consistent  = consistent && value.second == value.first * 3;
+        ordered     = ordered && value.first > last;
+        last        = value.first;
+    }
+    writer.join();
+
+    REQUIRE(consistent);
+    REQUIRE(ordered);
+    REQUIRE(last == count);
+}
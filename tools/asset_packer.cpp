@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "base/asset_pack.hpp"
+#include "base/print.hpp"
+
+using namespace dfdh;
+namespace fs = std::filesystem;
+
+static constexpr auto default_inputs = {
+    "data/textures", "data/sounds", "data/cfg", "data/scripts", "data/levels.cfg", "data/weapons.cfg"};
+
+void collect(const fs::path& pack_dir, const fs::path& input, std::vector<asset_pack_input>& files) {
+    auto add = [&](const fs::path& p) {
+        files.push_back({fs::path(asset_pack_normalize(p, false)).lexically_relative(pack_dir).generic_string(), p});
+    };
+
+    if (fs::is_directory(input)) {
+        for (auto& entry : fs::recursive_directory_iterator(input))
+            if (entry.is_regular_file())
+                add(entry.path());
+    }
+    else if (fs::is_regular_file(input)) {
+        add(input);
+    }
+    else {
+        fprintfln(std::cerr, "asset_packer: {} does not exist", input.string());
+    }
+}
+
+int pack(const fs::path& output, const std::vector<fs::path>& inputs) {
+    /* Paths as the game sees them from the pack directory, the lookups resolve symlinks if they do not match */
+    auto pack_dir = fs::path(asset_pack_normalize(fs::absolute(output).parent_path(), false));
+
+    std::vector<asset_pack_input> files;
+    for (auto& input : inputs)
+        collect(pack_dir, input, files);
+
+    std::sort(files.begin(), files.end(), [](auto& lhs, auto& rhs) { return lhs.path < rhs.path; });
+    files.erase(std::unique(files.begin(), files.end(), [](auto& lhs, auto& rhs) { return lhs.path == rhs.path; }),
+                files.end());
+
+    auto size = write_asset_pack(output, files);
+    printfln("{} files packed into {} ({} bytes)", files.size(), output.string(), size);
+    return 0;
+}
+
+int verify(const fs::path& path) {
+    auto pack = asset_pack(path);
+    int  rc   = 0;
+
+    for (auto& entry : pack) {
+        auto data = pack.entry_data(entry);
+        if (fnv1a64(data.data(), data.size()) != entry.checksum) {
+            fprintfln(std::cerr, "{}: checksum mismatch", pack.entry_path(entry));
+            rc = 1;
+        }
+    }
+
+    printfln("{}: {} entries, {}", path.string(), pack.entries_count(), rc ? "corrupted" : "ok");
+    return rc;
+}
+
+/* Usage:
+ *   asset_packer [-o data.pak] [input dirs or files...]  - pack (default inputs are listed in default_inputs)
+ *   asset_packer --verify data.pak                       - validate checksums of all entries */
+int main(int, char** argv) {
+    fs::path              output = asset_pack::default_path;
+    std::vector<fs::path> inputs;
+
+    for (auto argp = argv + 1; *argp; ++argp) {
+        auto arg = std::string_view(*argp);
+        if (arg == "-o" || arg == "--verify") {
+            ++argp;
+            if (!*argp) {
+                fprintfln(std::cerr, "asset_packer: {} requires an argument", arg);
+                return 1;
+            }
+            if (arg == "--verify")
+                return verify(*argp);
+            output = *argp;
+            continue;
+        }
+
+        inputs.emplace_back(arg);
+    }
+
+    if (inputs.empty())
+        for (auto input : default_inputs) inputs.emplace_back(input);
+
+    try {
+        return pack(output, inputs);
+    }
+    catch (const std::exception& e) {
+        fprintfln(std::cerr, "asset_packer: {}", e.what());
+        return 1;
+    }
+}
@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+#include "base/cfg.hpp"
+#include "base/print.hpp"
+
+using namespace dfdh;
+
+static std::atomic<size_t> allocations_count = 0;
+
+/* noinline: keeps gcc from pairing inlined malloc/free with new/delete expressions */
+[[gnu::noinline]] void* operator new(size_t size) {
+    allocations_count.fetch_add(1, std::memory_order_relaxed);
+    if (auto p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+static constexpr size_t files_count      = 10;
+static constexpr size_t keys_per_section = 20;
+static constexpr size_t default_lines    = 100000;
+
+/* Generates entry.cfg, which includes files_count files with lines_count lines total */
+fs::path generate(const fs::path& dir, size_t lines_count) {
+    fs::create_directories(dir);
+
+    auto entry = std::ofstream(dir / "entry.cfg");
+    size_t section = 0;
+
+    for (size_t file = 0; file < files_count; ++file) {
+        auto name = "part" + std::to_string(file) + ".cfg";
+        entry << "#include " << name << '\n';
+
+        auto ofs = std::ofstream(dir / name);
+        for (size_t line = 0; line < lines_count / files_count;) {
+            ofs << "[wpn_generated_" << section++ << "]\n";
+            ++line;
+            for (size_t key = 0; key < keys_per_section && line < lines_count / files_count; ++key, ++line)
+                ofs << "key_" << key << " = " << key * 3 << ' ' << float(key) * 0.5f << " path/to/texture.png\n";
+            ofs << '\n';
+        }
+    }
+
+    return dir / "entry.cfg";
+}
+
+void bench(const fs::path& path, cfg_mode mode, std::string_view name) {
+    auto allocs = allocations_count.load();
+    auto start  = std::chrono::steady_clock::now();
+
+    auto conf = std::make_unique<cfg>(path, mode, true);
+
+    auto parsed       = std::chrono::steady_clock::now();
+    auto parse_allocs = allocations_count.load() - allocs;
+
+    conf.reset();
+
+    auto destroyed = std::chrono::steady_clock::now();
+
+    printfln("{}: parse {} ({} allocations), destroy {}",
+             name,
+             std::chrono::duration_cast<std::chrono::microseconds>(parsed - start),
+             parse_allocs,
+             std::chrono::duration_cast<std::chrono::microseconds>(destroyed - parsed));
+}
+
+/* Tokenizes all generated files several times and prints throughput */
+template <bool Vectorized>
+void bench_tokenizer(const fs::path& dir, std::string_view name) {
+    static constexpr size_t repeats = 10;
+
+    std::vector<std::string> texts;
+    for (size_t file = 0; file < files_count; ++file) {
+        auto fv = file_view<char>((dir / ("part" + std::to_string(file) + ".cfg")).string().data());
+        texts.emplace_back(fv.data(), fv.size());
+    }
+
+    size_t bytes  = 0;
+    size_t tokens = 0;
+    auto   start  = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < repeats; ++i) {
+        for (auto& text : texts) {
+            auto tokenizer = cfg_tokenizer<const char*, const char*, Vectorized>(text.data(), text.data() + text.size());
+            while (tokenizer) {
+                tokenizer.next();
+                ++tokens;
+            }
+            bytes += text.size();
+        }
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printfln("{}: {} tokens, {} MB/s", name, tokens / repeats, u64(double(bytes) / seconds / 1e6));
+}
+
+/* Usage: cfg_bench [lines count] */
+int main(int, char** argv) {
+    size_t lines_count = argv[1] ? std::stoull(argv[1]) : default_lines;
+
+    auto path = generate(fs::temp_directory_path() / "dfdh_cfg_bench", lines_count);
+    printfln("{} lines in {} files", lines_count, files_count);
+
+    bench(path, cfg_mode::none, "plain       ");
+    bench(path, cfg_mode::mapped, "mapped      ");
+    bench(path, cfg_mode::binary_cache, "cache (cold)");
+    bench(path, cfg_mode::binary_cache, "cache (warm)");
+
+    bench_tokenizer<false>(path.parent_path(), "tokenizer (scalar)    ");
+    bench_tokenizer<true>(path.parent_path(), "tokenizer (vectorized)");
+
+    fs::remove_all(path.parent_path());
+}
@@ -0,0 +1,95 @@
+#include <iostream>
+#include <optional>
+
+#include "base/log.hpp"
+#include "base/print.hpp"
+#include "base/ston.hpp"
+
+using namespace dfdh;
+
+static constexpr std::string_view level_names[] = {"debug", "detail", "info", "warn", "error"};
+
+std::optional<log_level> parse_level(std::string_view name) {
+    for (size_t i = 0; i < std::size(level_names); ++i)
+        if (level_names[i] == name)
+            return log_level(i);
+    return {};
+}
+
+struct filter_t {
+    log_level level = log_level::debug;
+    double    from  = 0.0;
+    double    to    = std::numeric_limits<double>::infinity();
+};
+
+int decode(const std::string& path, const filter_t& filter) {
+    auto data   = file_view<char>(path.data());
+    auto reader = binlog_reader(std::span(data.data(), data.size()));
+    auto start  = reader.header().anchor.to_system(reader.header().anchor.tsc);
+    auto cache  = datetime_cache(log_time_format);
+
+    std::string line;
+    while (auto rec = reader.next()) {
+        auto since_start = std::chrono::duration<double>(rec->time - start).count();
+        if (rec->level < u8(filter.level) || since_start < filter.from || since_start > filter.to)
+            continue;
+
+        line.clear();
+        format_into(line, "{}: [{}] {}\n", cache(rec->time), level_names[std::min<size_t>(rec->level, 4)], rec->msg);
+        std::cout << line;
+    }
+    return 0;
+}
+
+/* Renders a binary log of log_acceptor_binary to text
+ *   log_decoder [--level info] [--from 10] [--to 60.5] file.binlog
+ * --level skips the records below the level, --from and --to are seconds since the log start */
+int main(int, char** argv) {
+    filter_t    filter;
+    std::string path;
+
+    for (auto argp = argv + 1; *argp; ++argp) {
+        auto arg = std::string_view(*argp);
+        if (arg == "--level" || arg == "--from" || arg == "--to") {
+            ++argp;
+            if (!*argp) {
+                fprintfln(std::cerr, "log_decoder: {} requires an argument", arg);
+                return 1;
+            }
+
+            auto value = std::string_view(*argp);
+            if (arg == "--level") {
+                auto level = parse_level(value);
+                if (!level) {
+                    fprintfln(std::cerr, "log_decoder: unknown level {}", value);
+                    return 1;
+                }
+                filter.level = *level;
+            }
+            else {
+                auto seconds = try_ston<double>(value);
+                if (!seconds) {
+                    fprintfln(std::cerr, "log_decoder: {} must be a number of seconds", arg);
+                    return 1;
+                }
+                (arg == "--from" ? filter.from : filter.to) = *seconds;
+            }
+            continue;
+        }
+
+        path = arg;
+    }
+
+    if (path.empty()) {
+        fprintfln(std::cerr, "usage: log_decoder [--level debug|detail|info|warn|error] [--from s] [--to s] file");
+        return 1;
+    }
+
+    try {
+        return decode(path, filter);
+    }
+    catch (const std::exception& e) {
+        fprintfln(std::cerr, "log_decoder: {}", e.what());
+        return 1;
+    }
+}